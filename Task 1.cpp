@@ -1,5 +1,5 @@
 // bresenham_cb.cpp
-// Bresenham Line (all octants) + Thick Lines via filled disk brush
+// Bresenham Line (all octants, 24.8 sub-pixel endpoints) + Thick Lines via filled disk brush
 // Designed to be Code::Blocks + FreeGLUT friendly on Windows
 
 #ifdef _WIN32
@@ -8,16 +8,31 @@
 #include <GL/glut.h>
 #include <cmath>
 #include <cstdlib>
+#include <cstdint>
+#include <cstdio>
 #include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#if !defined(_WIN32)
+    #include <sys/resource.h>
+#endif
 
 // -------- Config --------
 static int  winW = 900, winH = 600;
 static bool thickMode = true;
 static int  lineWidthW = 7; // odd values look nice: 3,5,7,...
+static bool headless   = false; // --bench: no window, GLUT-only calls skipped
+
+// 24.8 fixed point: integer pixel = v >> FX_SHIFT, pixel centers at integers
+static const int FX_SHIFT = 8;
+static const int FX_ONE   = 1 << FX_SHIFT;
 
-struct Point { int x, y; };
+struct Point   { int x, y; };
+struct PointFx { int x, y; }; // 24.8 fixed point
 static bool haveP1 = false, haveP2 = false;
-static Point P1{ 120, 120 }, P2{ 780, 460 };
+static PointFx P1{ 120 * FX_ONE, 120 * FX_ONE }, P2{ 780 * FX_ONE, 460 * FX_ONE };
 
 // -------- Utilities --------
 static inline int clampi(int v, int lo, int hi) {
@@ -25,6 +40,34 @@ static inline int clampi(int v, int lo, int hi) {
 }
 static inline int toGLY(int yTop) { return winH - 1 - yTop; }
 
+static void drawText(int x, int y, const char* s) {
+    glRasterPos2i(x, y);
+    if (headless) return;
+    for (const char* p = s; *p; ++p) glutBitmapCharacter(GLUT_BITMAP_9_BY_15, *p);
+}
+
+// Headless frames have no context to upload to: copy into a staging buffer
+// instead so the per-frame pixel traffic is still paid
+static std::vector<uint32_t> uploadStaging;
+static void presentPixels(int w, int h, const uint32_t* px) {
+    glRasterPos2i(0, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glDrawPixels(w, h, GL_RGBA, GL_UNSIGNED_BYTE, px);
+    if (headless) uploadStaging.assign(px, px + (size_t)w * h);
+}
+
+static void endFrame() {
+    if (!headless) glutSwapBuffers();
+}
+
+static inline int toFx(int v) { return v * FX_ONE; }
+
+// floor(a / b) for b > 0 (C++ division truncates toward zero)
+static inline int64_t floorDiv(int64_t a, int64_t b) {
+    int64_t q = a / b;
+    return (q * b > a) ? q - 1 : q;
+}
+
 // Submit a single pixel (expects GL_POINTS already begun by caller)
 static inline void plotPoint(int x, int y) {
     if ((unsigned)x >= (unsigned)winW || (unsigned)y >= (unsigned)winH) return;
@@ -40,16 +83,28 @@ static inline void drawHSpan(int x1, int x2, int y) {
     for (int x = x1; x <= x2; ++x) plotPoint(x, y);
 }
 
-// Filled disk with 8-way symmetry (midpoint circle), centered at (xc,yc), radius r
-static void drawFilledCircle(int xc, int yc, int r) {
-    if (r <= 0) { plotPoint(xc, yc); return; }
+// Draw a vertical span (y1..y2 inclusive) at column x
+static inline void drawVSpan(int x, int y1, int y2) {
+    if ((unsigned)x >= (unsigned)winW) return;
+    if (y1 > y2) { int t = y1; y1 = y2; y2 = t; }
+    y1 = clampi(y1, 0, winH - 1);
+    y2 = clampi(y2, 0, winH - 1);
+    for (int y = y1; y <= y2; ++y) plotPoint(x, y);
+}
+
+// Spans of a filled disk with 8-way symmetry (midpoint circle), centered at
+// (xc,yc), radius r; calls span(x0, y, x1, y). Rows near the top and bottom
+// come out more than once.
+template<typename SpanFunc>
+static void diskSpans(int xc, int yc, int r, const SpanFunc& span) {
+    if (r <= 0) { span(xc, yc, xc, yc); return; }
     int x = 0, y = r;
     int d = 1 - r;
     while (x <= y) {
-        drawHSpan(xc - x, xc + x, yc + y);
-        drawHSpan(xc - x, xc + x, yc - y);
-        drawHSpan(xc - y, xc + y, yc + x);
-        drawHSpan(xc - y, xc + y, yc - x);
+        span(xc - x, yc + y, xc + x, yc + y);
+        span(xc - x, yc - y, xc + x, yc - y);
+        span(xc - y, yc + x, xc + y, yc + x);
+        span(xc - y, yc - x, xc + y, yc - x);
 
         if (d < 0) d += (2 * x + 3);
         else { d += (2 * (x - y) + 5); --y; }
@@ -57,11 +112,6 @@ static void drawFilledCircle(int xc, int yc, int r) {
     }
 }
 
-static inline void plotThickPixel(int x, int y, int W) {
-    int r = W / 2;
-    drawFilledCircle(x, y, r);
-}
-
 // Integer Bresenham for all octants; calls plot(x,y) per pixel.
 template<typename PlotFunc>
 static void bresenhamLine(int x0, int y0, int x1, int y1, const PlotFunc& plot) {
@@ -91,28 +141,484 @@ static void bresenhamLine(int x0, int y0, int x1, int y1, const PlotFunc& plot)
     }
 }
 
-static void drawLine(int x0, int y0, int x1, int y1, int W) {
-    if (W <= 1) {
-        bresenhamLine(x0, y0, x1, y1, [](int x, int y){ plotPoint(x, y); });
-    } else {
-        bresenhamLine(x0, y0, x1, y1, [W](int x, int y){ plotThickPixel(x, y, W); });
+// Sub-pixel Bresenham for 24.8 endpoints; calls plot(x,y) per pixel.
+// The walk is done in a mirrored frame (major step +1, minor step 0/+1) where
+// pixel (U,V) is chosen with V = floor(v(U) + 1/2). The initial error term is
+// derived exactly from the fractional parts of both endpoints, so the inner
+// loop is the same integer loop as bresenhamLine(); for integer inputs the
+// error term is that of bresenhamLine() scaled by FX_ONE^2/2, giving identical output.
+struct FxWalk {
+    int sx, sy, su;
+    bool yMajor;
+    int64_t u0, du, U, U1, V, err, stepMajor, stepMinor;
+    int64_t N0; // N at column 0
+
+    FxWalk(PointFx p0, PointFx p1) {
+        int64_t dx = std::abs((int64_t)p1.x - p0.x);
+        int64_t dy = std::abs((int64_t)p1.y - p0.y);
+        sx = (p0.x < p1.x) ? 1 : -1;
+        sy = (p0.y < p1.y) ? 1 : -1;
+
+        yMajor = dy > dx;
+        su = yMajor ? sy : sx;
+        int64_t sv = yMajor ? sx : sy;
+        u0 = su * (int64_t)(yMajor ? p0.y : p0.x);
+        int64_t u1 = su * (int64_t)(yMajor ? p1.y : p1.x);
+        int64_t v0 = sv * (int64_t)(yMajor ? p0.x : p0.y);
+        du = yMajor ? dy : dx;
+        int64_t dv = yMajor ? dx : dy;
+
+        const int64_t half = FX_ONE / 2;
+        U  = floorDiv(u0 + half, FX_ONE);
+        U1 = floorDiv(u1 + half, FX_ONE);
+        if (du == 0) { // degenerate: both endpoints in the same spot
+            V = floorDiv(v0 + half, FX_ONE);
+            U1 = U; stepMajor = 1; stepMinor = 0; N0 = V; err = -1;
+            return;
+        }
+
+        // v at the center of column U, offset by 1/2 and scaled by du*FX_ONE:
+        //   N = (v0 + 1/2) * du + (U - u0) * dv,  V = floor(N / (du*FX_ONE))
+        stepMajor = du * FX_ONE; stepMinor = dv * FX_ONE;
+        N0 = (v0 + half) * du - u0 * dv;
+        skipTo(U);
+    }
+
+    int x() const { return (int)(sx * (yMajor ? V : U)); }
+    int y() const { return (int)(sy * (yMajor ? U : V)); }
+
+    void step() {
+        if (err >= 0) { ++V; err -= stepMajor; }
+        ++U;
+        err += stepMinor;
+    }
+
+    // Minor coordinate at column u without walking there
+    int64_t minorAt(int64_t u) const { return floorDiv(N0 + u * stepMinor, stepMajor); }
+
+    // Jump to column u (the state step() would reach)
+    void skipTo(int64_t u) {
+        int64_t N = N0 + u * stepMinor;
+        U = u;
+        V = floorDiv(N, stepMajor);
+        err = (N - V * stepMajor) + stepMinor - stepMajor;
+    }
+};
+
+template<typename PlotFunc>
+static void bresenhamLineFx(PointFx p0, PointFx p1, const PlotFunc& plot) {
+    FxWalk w(p0, p1);
+    for (;;) {
+        plot(w.x(), w.y());
+        if (w.U == w.U1) break;
+        w.step();
+    }
+}
+
+// -------- Thick lines: capsule and butt ends --------
+// Alternatives to stamping a disk at every center-line pixel, which writes
+// most covered pixels many times over and can only make round ends. Both
+// walk the major axis once and emit a single minor-axis span per column
+// (vertical spans for x-major lines, horizontal for y-major), so every
+// pixel is written exactly once:
+//  - butt: pixel centers inside the W-wide rectangle over P0-P1, scan-
+//    converted a column at a time. Each of its four edges (the two long
+//    sides, parallel to the center line, and the two square ends) gives a
+//    bound on the minor axis that is stepped per column with an integer
+//    error term; a column's span runs between the tighter bounds.
+//  - capsule: pixel centers within W/2 of the segment, i.e. the same
+//    rectangle joined with a disk at each end.
+// A pixel center is inside the rectangle when |cross| <= floor(W/2 * |d|)
+// and 0 <= along <= |d|^2 (cross/along against the direction d, in fx^2),
+// so both tests stay in integers.
+enum ThickStyle { THICK_STAMP, THICK_CAPSULE, THICK_BUTT, THICK_STYLES };
+static const char* THICK_NAMES[THICK_STYLES] = { "disk stamp", "capsule", "butt" };
+static ThickStyle thickStyle = THICK_STAMP;
+
+// floor((n0 + k * inc) / div) for k = 0, 1, 2, ... (div > 0), one k at a time
+struct EdgeWalk {
+    int64_t q, r, incQ, incR, div;
+
+    EdgeWalk(int64_t n0, int64_t inc, int64_t d) : div(d) {
+        q = floorDiv(n0, d); r = n0 - q * d;
+        incQ = floorDiv(inc, d); incR = inc - incQ * d;
+    }
+
+    void step() {
+        q += incQ; r += incR;
+        if (r >= div) { r -= div; ++q; }
+    }
+};
+
+// floor(sqrt(v)) for v >= 0
+static inline int64_t isqrt64(int64_t v) {
+    int64_t s = (int64_t)std::sqrt((double)v);
+    while (s * s > v) --s;
+    while ((s + 1) * (s + 1) <= v) ++s;
+    return s;
+}
+
+// Thick line from p0 to p1 with butt or round ends; calls span(x0, y0, x1, y1)
+// once per column, with x0 == x1 (vertical) or y0 == y1 (horizontal).
+// A zero-length line has no direction: butt ends draw nothing, round ends a disk.
+template<typename SpanFunc>
+static void thickLineFx(PointFx p0, PointFx p1, int W, bool roundEnds, const SpanFunc& span) {
+    int64_t dx = std::abs((int64_t)p1.x - p0.x), dy = std::abs((int64_t)p1.y - p0.y);
+    int sx = (p0.x < p1.x) ? 1 : -1, sy = (p0.y < p1.y) ? 1 : -1;
+    bool yMajor = dy > dx;
+    int su = yMajor ? sy : sx, sv = yMajor ? sx : sy;
+    // Mirrored frame as in FxWalk: major u, minor v, du >= dv >= 0
+    int64_t u0 = su * (int64_t)(yMajor ? p0.y : p0.x), v0 = sv * (int64_t)(yMajor ? p0.x : p0.y);
+    int64_t du = yMajor ? dy : dx, dv = yMajor ? dx : dy;
+    const int64_t F = FX_ONE, hw = (int64_t)W * FX_ONE / 2;     // half width, fx
+    if (du == 0 && !roundEnds) return;
+
+    auto emit = [&](int64_t U, int64_t lo, int64_t hi) {
+        int a = (int)(sv * lo), b = (int)(sv * hi), c = (int)(su * U);
+        if (a > b) std::swap(a, b);
+        if (yMajor) span(a, c, b, c);
+        else        span(c, a, c, b);
+    };
+    // Column U of the disk of radius hw about (uc, vc), as [lo, hi]
+    auto diskColumn = [&](int64_t U, int64_t uc, int64_t vc, int64_t& lo, int64_t& hi) {
+        int64_t a = U * F - uc;
+        if (a * a > hw * hw) return false;
+        int64_t s = isqrt64(hw * hw - a * a);
+        lo = floorDiv(vc - s + F - 1, F); hi = floorDiv(vc + s, F);
+        return lo <= hi;
+    };
+
+    int64_t Umin = floorDiv(u0 - hw + F - 1, F), Umax = floorDiv(u0 + du + hw, F);
+    if (du == 0) {
+        for (int64_t U = Umin, lo, hi; U <= Umax; ++U)
+            if (diskColumn(U, u0, v0, lo, hi)) emit(U, lo, hi);
+        return;
+    }
+
+    int64_t L2 = du * du + dv * dv;
+    int64_t H = (int64_t)std::floor((double)hw * std::sqrt((double)L2));
+    int64_t a0 = Umin * F - u0;
+    // Sides: V * F * du in [n - H, n + H], n = v0 * du + a * dv
+    int64_t n0 = v0 * du + a0 * dv;
+    EdgeWalk sideLo(n0 - H + F * du - 1, F * dv, F * du), sideHi(n0 + H, F * dv, F * du);
+    // Ends (dv > 0): V * F * dv in [m, m + L2], m = v0 * dv - a * du; with
+    // dv == 0 they are columns instead
+    int64_t m0 = v0 * dv - a0 * du, Fdv = std::max<int64_t>(F * dv, 1);
+    EdgeWalk endLo(m0 + Fdv - 1, -F * du, Fdv), endHi(m0 + L2, -F * du, Fdv);
+    int64_t Ubeg = floorDiv(u0 + F - 1, F), Uend = floorDiv(u0 + du, F);
+
+    for (int64_t U = Umin; U <= Umax; ++U) {
+        int64_t lo = sideLo.q, hi = sideHi.q;
+        if (dv > 0) { lo = std::max(lo, endLo.q); hi = std::min(hi, endHi.q); }
+        else if (U < Ubeg || U > Uend) { lo = 1; hi = 0; }
+        if (roundEnds) {
+            int64_t dl, dh;
+            if (diskColumn(U, u0, v0, dl, dh)) { if (lo > hi) { lo = dl; hi = dh; } else { lo = std::min(lo, dl); hi = std::max(hi, dh); } }
+            if (diskColumn(U, u0 + du, v0 + dv, dl, dh)) { if (lo > hi) { lo = dl; hi = dh; } else { lo = std::min(lo, dl); hi = std::max(hi, dh); } }
+        }
+        if (lo <= hi) emit(U, lo, hi);
+        sideLo.step(); sideHi.step();
+        if (dv > 0) { endLo.step(); endHi.step(); }
+    }
+}
+
+// Disk stamped at every center-line pixel (the original thick mode), as spans
+template<typename SpanFunc>
+static void stampLineFx(PointFx a, PointFx b, int W, const SpanFunc& span) {
+    bresenhamLineFx(a, b, [&](int x, int y){ diskSpans(x, y, W / 2, span); });
+}
+
+static void drawSpan(int x0, int y0, int x1, int y1) {
+    if (y0 == y1) drawHSpan(x0, x1, y0);
+    else          drawVSpan(x0, y0, y1);
+}
+
+// The line in the current style: thin pixels through plot(x, y), thick
+// ones as spans through span(x0, y0, x1, y1)
+template<typename PlotFunc, typename SpanFunc>
+static void lineFx(PointFx a, PointFx b, int W, const PlotFunc& plot, const SpanFunc& span) {
+    if (W <= 1)                       bresenhamLineFx(a, b, plot);
+    else if (thickStyle == THICK_STAMP) stampLineFx(a, b, W, span);
+    else                              thickLineFx(a, b, W, thickStyle == THICK_CAPSULE, span);
+}
+
+static void drawLineFx(PointFx a, PointFx b, int W) {
+    lineFx(a, b, W, [](int x, int y){ plotPoint(x, y); }, drawSpan);
+}
+
+// -------- Depth-buffered 3D lines --------
+// Lines are walked with FxWalk and carry reciprocal depth rz = NEAR/w as
+// 0.32 fixed point (larger = nearer, 0 = cleared/infinitely far). 1/w is
+// linear in screen space, so stepping rz by a constant per pixel is
+// perspective correct. The depth buffer is split in DEPTH_TILE^2 tiles that
+// keep the farthest rz stored in them; a line is walked in chunks that stay
+// in one tile column along the major axis, and a chunk whose nearest rz is
+// not in front of the tiles it touches is skipped without reading depth.
+static const int   DEPTH_TILE = 8;
+static const float MESH_NEAR  = 0.1f;
+
+struct DepthTarget {
+    int w = 0, h = 0, tilesX = 0, tilesY = 0;
+    std::vector<uint32_t> color, depth, tileFar;
+    std::vector<uint8_t>  tileOpen;   // pixels of the tile still at the cleared depth
+    long long chunks = 0, chunksRejected = 0, depthTests = 0, depthWrites = 0;
+
+    void resize(int W, int H) {
+        w = W; h = H;
+        tilesX = (W + DEPTH_TILE - 1) / DEPTH_TILE;
+        tilesY = (H + DEPTH_TILE - 1) / DEPTH_TILE;
+        color.assign((size_t)W * H, 0);
+        depth.assign((size_t)W * H, 0);
+        tileFar.assign((size_t)tilesX * tilesY, 0);
+        tileOpen.assign((size_t)tilesX * tilesY, 0);
+    }
+
+    void clear(uint32_t bg) {
+        std::fill(color.begin(), color.end(), bg);
+        std::fill(depth.begin(), depth.end(), 0u);
+        std::fill(tileFar.begin(), tileFar.end(), 0u);
+        for (int ty = 0; ty < tilesY; ++ty)
+            for (int tx = 0; tx < tilesX; ++tx)
+                tileOpen[(size_t)ty * tilesX + tx] = (uint8_t)((std::min(w, (tx + 1) * DEPTH_TILE) - tx * DEPTH_TILE) *
+                                                               (std::min(h, (ty + 1) * DEPTH_TILE) - ty * DEPTH_TILE));
+        chunks = chunksRejected = depthTests = depthWrites = 0;
+    }
+
+    void refreshTile(int tx, int ty) {
+        uint32_t far = 0xFFFFFFFFu;
+        int x1 = std::min(w, (tx + 1) * DEPTH_TILE), y1 = std::min(h, (ty + 1) * DEPTH_TILE);
+        for (int y = ty * DEPTH_TILE; y < y1; ++y)
+            for (int x = tx * DEPTH_TILE; x < x1; ++x)
+                far = std::min(far, depth[(size_t)y * w + x]);
+        tileFar[(size_t)ty * tilesX + tx] = far;
     }
+};
+
+static DepthTarget depthTarget;
+static bool hierZ = true;
+
+// Endpoints must lie on pixel centers inside the target (see clipToScreen)
+static void depthLineFx(DepthTarget& t, PointFx p0, uint32_t rz0, PointFx p1, uint32_t rz1, uint32_t color) {
+    FxWalk w(p0, p1);
+    // rz (32.16) at the center of column U, clamped to the segment's range
+    const double drz = (double)rz1 - (double)rz0;
+    const int64_t rzLo = (int64_t)std::min(rz0, rz1) << 16, rzHi = (int64_t)std::max(rz0, rz1) << 16;
+    const int64_t rzStep = w.du ? (int64_t)(drz * 65536.0 * FX_ONE / (double)w.du) : 0;
+    auto rzAt = [&](int64_t U) -> int64_t {
+        if (w.du == 0) return rzHi;
+        double frac = (double)(U * FX_ONE - w.u0) / (double)w.du;
+        int64_t v = ((int64_t)rz0 << 16) + (int64_t)(drz * 65536.0 * frac);
+        return std::max(rzLo, std::min(rzHi, v));
+    };
+
+    for (;;) {
+        // Chunk: from U to the end of its tile column along the major axis
+        int64_t s = w.su * w.U;
+        int64_t tileEnd = w.su > 0 ? (s / DEPTH_TILE + 1) * DEPTH_TILE - 1 : (s / DEPTH_TILE) * DEPTH_TILE;
+        int64_t Uend = std::min(w.U1, w.su * tileEnd);
+        ++t.chunks;
+
+        if (hierZ) {
+            int64_t Vend = (w.du == 0) ? w.V : w.minorAt(Uend);
+            int xa = w.x(), ya = w.y();
+            int xb = (int)(w.sx * (w.yMajor ? Vend : Uend)), yb = (int)(w.sy * (w.yMajor ? Uend : Vend));
+            uint32_t far = 0xFFFFFFFFu;
+            for (int ty = std::min(ya, yb) / DEPTH_TILE; ty <= std::max(ya, yb) / DEPTH_TILE; ++ty)
+                for (int tx = std::min(xa, xb) / DEPTH_TILE; tx <= std::max(xa, xb) / DEPTH_TILE; ++tx)
+                    far = std::min(far, t.tileFar[(size_t)ty * t.tilesX + tx]);
+            // same arithmetic as the walk below, so skipping never changes the image
+            int64_t rzA = rzAt(w.U), rzB = rzA + (Uend - w.U) * rzStep;
+            uint32_t nearest = (uint32_t)(std::max(rzLo, std::min(rzHi, std::max(rzA, rzB))) >> 16);
+            if (nearest <= far) {
+                ++t.chunksRejected;
+                if (Uend == w.U1) break;
+                w.skipTo(Uend + 1);
+                continue;
+            }
+        }
+
+        int64_t rz = rzAt(w.U);
+        int staleX[2] = { -1, -1 }, staleY[2] = { -1, -1 }, stale = 0;
+        for (;;) {
+            int x = w.x(), y = w.y();
+            size_t i = (size_t)y * t.w + x;
+            uint32_t z = (uint32_t)(std::max(rzLo, std::min(rzHi, rz)) >> 16);
+            ++t.depthTests;
+            if (z > t.depth[i]) {
+                int tx = x / DEPTH_TILE, ty = y / DEPTH_TILE;
+                size_t ti = (size_t)ty * t.tilesX + tx;
+                // A tile's far value stays 0 until its last cleared pixel is covered
+                bool farMoved = t.depth[i] == 0 ? --t.tileOpen[ti] == 0
+                                                : t.tileOpen[ti] == 0 && t.depth[i] == t.tileFar[ti];
+                if (farMoved && stale < 2 && !(stale && staleX[stale - 1] == tx && staleY[stale - 1] == ty)) {
+                    staleX[stale] = tx; staleY[stale] = ty; ++stale;
+                }
+                t.depth[i] = z;
+                t.color[i] = color;
+                ++t.depthWrites;
+            }
+            if (w.U == Uend) break;
+            w.step();
+            rz += rzStep;
+        }
+        // The farthest value of a tile can only have moved if it was overwritten
+        // (or the tile just became fully covered)
+        for (int k = 0; k < stale; ++k) t.refreshTile(staleX[k], staleY[k]);
+
+        if (Uend == w.U1) break;
+        w.step();
+    }
+}
+
+// Screen vertex: pixel position and reciprocal depth
+struct ScreenVtx { float x, y, rz; };
+
+// Liang-Barsky against the pixel-center rectangle; rz is linear in screen space
+static bool clipToScreen(ScreenVtx& a, ScreenVtx& b, int W, int H) {
+    float dx = b.x - a.x, dy = b.y - a.y, t0 = 0.f, t1 = 1.f;
+    float p[4] = { -dx, dx, -dy, dy };
+    float q[4] = { a.x, (W - 1) - a.x, a.y, (H - 1) - a.y };
+    for (int i = 0; i < 4; ++i) {
+        if (std::fabs(p[i]) < 1e-9f) { if (q[i] < 0) return false; continue; }
+        float r = q[i] / p[i];
+        if (p[i] < 0) t0 = std::max(t0, r); else t1 = std::min(t1, r);
+        if (t0 > t1) return false;
+    }
+    ScreenVtx c = a, d = a;
+    c.x += t0 * dx; c.y += t0 * dy; c.rz += t0 * (b.rz - a.rz);
+    d.x += t1 * dx; d.y += t1 * dy; d.rz += t1 * (b.rz - a.rz);
+    a = c; b = d;
+    return true;
+}
+
+static inline PointFx screenToFx(float x, float y, int W, int H) {
+    return { clampi((int)std::lround(x * FX_ONE), 0, (W - 1) * FX_ONE),
+             clampi((int)std::lround(y * FX_ONE), 0, (H - 1) * FX_ONE) };
+}
+
+static inline uint32_t toRz(float q) {
+    return (uint32_t)std::min(4294967295.0, std::max(0.0, (double)q * 4294967295.0));
+}
+
+// -------- Wireframe torus scene --------
+static bool  meshMode   = false;
+static int   meshLevel  = 1;
+static float meshAngle  = 0.f;
+static int   meshGen    = 0;
+static double meshMs    = 0.0;
+static const int MESH_SIZES[][2] = { { 64, 32 }, { 256, 128 }, { 1024, 512 } }; // 2*nu*nv edges
+static const uint32_t MESH_BG = 0xFF140F0Du; // glClearColor(0.05, 0.06, 0.08)
+
+// Transform the torus to camera space, sort its edges roughly front to back
+// (nearer lines fill tiles first, so more of the rest is rejected early)
+// and draw them with the depth test
+static void renderMesh() {
+    auto t0 = std::chrono::steady_clock::now();
+    DepthTarget& t = depthTarget;
+    if (t.w != winW || t.h != winH) t.resize(winW, winH);
+    t.clear(MESH_BG);
+
+    const int nu = MESH_SIZES[meshLevel][0], nv = MESH_SIZES[meshLevel][1];
+    static std::vector<float> cam;   // x, y, z per vertex
+    cam.resize((size_t)nu * nv * 3);
+    float ca = std::cos(meshAngle), sa = std::sin(meshAngle);
+    float cb = std::cos(meshAngle * 0.6f), sb = std::sin(meshAngle * 0.6f);
+    for (int i = 0; i < nu; ++i) {
+        float u = 6.2831853f * i / nu;
+        for (int j = 0; j < nv; ++j) {
+            float v = 6.2831853f * j / nv;
+            float px = (1.f + 0.35f * std::cos(v)) * std::cos(u);
+            float py = (1.f + 0.35f * std::cos(v)) * std::sin(u);
+            float pz = 0.35f * std::sin(v);
+            float x1 = ca * px + sa * pz, z1 = -sa * px + ca * pz;   // about y
+            float y2 = cb * py - sb * z1, z2 = sb * py + cb * z1;    // about x
+            float* c = &cam[((size_t)i * nv + j) * 3];
+            c[0] = x1; c[1] = y2; c[2] = z2 + 3.2f;
+        }
+    }
+
+    // Edges (i,j)-(i+1,j) and (i,j)-(i,j+1), bucketed by the nearer z
+    const int BUCKETS = 64;
+    const float zMin = 3.2f - 1.35f, zMax = 3.2f + 1.35f;
+    size_t edgeCount = (size_t)nu * nv * 2;
+    static std::vector<uint32_t> order, start;
+    order.resize(edgeCount);
+    start.assign(BUCKETS + 1, 0);
+    auto edgeEnds = [&](size_t e, size_t& a, size_t& b) {
+        size_t v = e >> 1;
+        int i = (int)(v / nv), j = (int)(v % nv);
+        a = v;
+        b = (e & 1) ? (size_t)i * nv + (j + 1) % nv : (size_t)((i + 1) % nu) * nv + j;
+    };
+    auto bucketOf = [&](size_t e) {
+        size_t a, b; edgeEnds(e, a, b);
+        float z = std::min(cam[a * 3 + 2], cam[b * 3 + 2]);
+        return clampi((int)((z - zMin) / (zMax - zMin) * BUCKETS), 0, BUCKETS - 1);
+    };
+    for (size_t e = 0; e < edgeCount; ++e) start[bucketOf(e) + 1]++;
+    for (int k = 0; k < BUCKETS; ++k) start[k + 1] += start[k];
+    {
+        std::vector<uint32_t> fill(start.begin(), start.end() - 1);
+        for (size_t e = 0; e < edgeCount; ++e) order[fill[bucketOf(e)]++] = (uint32_t)e;
+    }
+
+    const float f = 0.6f * std::min(winW, winH), cx = winW * 0.5f, cy = winH * 0.5f;
+    for (uint32_t e : order) {
+        size_t a, b; edgeEnds(e, a, b);
+        float A[3] = { cam[a * 3], cam[a * 3 + 1], cam[a * 3 + 2] };
+        float B[3] = { cam[b * 3], cam[b * 3 + 1], cam[b * 3 + 2] };
+        // Near plane
+        if (A[2] < MESH_NEAR && B[2] < MESH_NEAR) continue;
+        if (A[2] < MESH_NEAR || B[2] < MESH_NEAR) {
+            float* P = A[2] < MESH_NEAR ? A : B;
+            const float* Q = A[2] < MESH_NEAR ? B : A;
+            float s = (MESH_NEAR - P[2]) / (Q[2] - P[2]);
+            for (int k = 0; k < 3; ++k) P[k] += s * (Q[k] - P[k]);
+        }
+        ScreenVtx sa_ = { cx + f * A[0] / A[2], cy + f * A[1] / A[2], MESH_NEAR / A[2] };
+        ScreenVtx sb_ = { cx + f * B[0] / B[2], cy + f * B[1] / B[2], MESH_NEAR / B[2] };
+        if (!clipToScreen(sa_, sb_, winW, winH)) continue;
+
+        // Brighter when nearer
+        float zm = 0.5f * (A[2] + B[2]);
+        float k = clampi((int)(255.f * (1.f - (zm - zMin) / (zMax - zMin) * 0.8f)), 40, 255);
+        uint32_t col = 0xFF000000u | ((uint32_t)k << 16) | ((uint32_t)(k * 0.85f) << 8) | (uint32_t)(k * 0.35f);
+        depthLineFx(t, screenToFx(sa_.x, sa_.y, winW, winH), toRz(sa_.rz),
+                       screenToFx(sb_.x, sb_.y, winW, winH), toRz(sb_.rz), col);
+    }
+    meshMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+}
+
+static void meshTick(int gen) {
+    if (gen != meshGen || !meshMode) return;
+    meshAngle += 0.01f;
+    glutPostRedisplay();
+    glutTimerFunc(16, meshTick, gen);
+}
+
+static void drawMeshInfo() {
+    const DepthTarget& t = depthTarget;
+    char buf[200];
+    std::snprintf(buf, sizeof(buf), "M: 2D/3D | [ ]: mesh %d edges | H: tile reject %s | %.1f ms | chunks rejected %.0f%% | depth tests %lld, writes %lld",
+                  2 * MESH_SIZES[meshLevel][0] * MESH_SIZES[meshLevel][1], hierZ ? "ON" : "OFF", meshMs,
+                  t.chunks ? 100.0 * t.chunksRejected / t.chunks : 0.0, t.depthTests, t.depthWrites);
+    glColor3f(1, 1, 0);
+    drawText(10, winH - 20, buf);
 }
 
 static void drawInfo() {
     glColor3f(1, 1, 0);
-    std::string s = "Left-click to set P1,P2 | T: Thick ON/OFF | +/- : Width | C: Clear | R: Random | W="
-                    + std::to_string(lineWidthW) + (thickMode ? " (Thick)" : " (Thin)");
-    glRasterPos2i(10, winH - 20);
-    for (char c : s) glutBitmapCharacter(GLUT_BITMAP_9_BY_15, c);
+    std::string s = "Left-click to set P1,P2 | T: Thick ON/OFF | B: ends | +/- : Width | C: Clear | R: Random | M: 3D | W="
+                    + std::to_string(lineWidthW) + (thickMode ? " (Thick, " + std::string(THICK_NAMES[thickStyle]) + ")" : " (Thin)");
+    drawText(10, winH - 20, s.c_str());
 }
 
 static void drawEndpoints() {
     if (!(haveP1 && haveP2)) return;
     glPointSize(6.f);
     glBegin(GL_POINTS);
-    glVertex2i(P1.x, P1.y);
-    glVertex2i(P2.x, P2.y);
+    glVertex2f(P1.x / (float)FX_ONE, P1.y / (float)FX_ONE);
+    glVertex2f(P2.x / (float)FX_ONE, P2.y / (float)FX_ONE);
     glEnd();
 }
 
@@ -120,6 +626,14 @@ static void drawEndpoints() {
 static void displayCB() {
     glClear(GL_COLOR_BUFFER_BIT);
 
+    if (meshMode) {
+        renderMesh();
+        presentPixels(depthTarget.w, depthTarget.h, depthTarget.color.data());
+        drawMeshInfo();
+        endFrame();
+        return;
+    }
+
     // Draw axes (optional)
     glColor3f(0.15f, 0.15f, 0.16f);
     glBegin(GL_POINTS);
@@ -131,7 +645,7 @@ static void displayCB() {
     glColor3f(1, 1, 1);
     glBegin(GL_POINTS);
     if (haveP1 && haveP2) {
-        drawLine(P1.x, P1.y, P2.x, P2.y, thickMode ? lineWidthW : 1);
+        drawLineFx(P1, P2, thickMode ? lineWidthW : 1);
     }
     glEnd();
 
@@ -140,7 +654,7 @@ static void displayCB() {
     drawEndpoints();
     drawInfo();
 
-    glutSwapBuffers();
+    endFrame();
 }
 
 static void reshapeCB(int w, int h) {
@@ -159,10 +673,10 @@ static void mouseCB(int button, int state, int x, int yTop) {
     if (button == GLUT_LEFT_BUTTON && state == GLUT_DOWN) {
         int y = toGLY(yTop);
         if (!haveP1) {
-            P1 = { clampi(x, 0, winW - 1), clampi(y, 0, winH - 1) };
+            P1 = { toFx(clampi(x, 0, winW - 1)), toFx(clampi(y, 0, winH - 1)) };
             haveP1 = true; haveP2 = false;
         } else if (!haveP2) {
-            P2 = { clampi(x, 0, winW - 1), clampi(y, 0, winH - 1) };
+            P2 = { toFx(clampi(x, 0, winW - 1)), toFx(clampi(y, 0, winH - 1)) };
             haveP2 = true;
         } else {
             haveP1 = haveP2 = false;
@@ -176,6 +690,8 @@ static void keyboardCB(unsigned char key, int, int) {
         case 27: std::exit(0); break; // Esc
         case 't': case 'T':
             thickMode = !thickMode; glutPostRedisplay(); break;
+        case 'b': case 'B':
+            thickStyle = (ThickStyle)((thickStyle + 1) % THICK_STYLES); glutPostRedisplay(); break;
         case '+':
             lineWidthW = (lineWidthW < 99 ? lineWidthW + 1 : 99); glutPostRedisplay(); break;
         case '-':
@@ -184,14 +700,172 @@ static void keyboardCB(unsigned char key, int, int) {
             haveP1 = haveP2 = false; glutPostRedisplay(); break;
         case 'r': case 'R':
             haveP1 = haveP2 = true;
-            P1 = { std::rand() % winW, std::rand() % winH };
-            P2 = { std::rand() % winW, std::rand() % winH };
+            // random sub-pixel endpoints
+            P1 = { std::rand() % toFx(winW), std::rand() % toFx(winH) };
+            P2 = { std::rand() % toFx(winW), std::rand() % toFx(winH) };
             glutPostRedisplay(); break;
+        case 'm': case 'M':
+            meshMode = !meshMode;
+            if (meshMode) glutTimerFunc(16, meshTick, ++meshGen);
+            glutPostRedisplay(); break;
+        case '[':
+            meshLevel = (meshLevel > 0 ? meshLevel - 1 : 0); glutPostRedisplay(); break;
+        case ']':
+            meshLevel = (meshLevel < 2 ? meshLevel + 1 : 2); glutPostRedisplay(); break;
+        case 'h': case 'H':
+            hierZ = !hierZ; glutPostRedisplay(); break;
+    }
+}
+
+// -------- Headless benchmark --------
+// --bench [frames]: canonical scenes without a window, reporting the frame
+// time distribution and memory of each. Line scenes draw displayCB()'s 2D
+// scene (axes and the line) into a software framebuffer; the mesh scenes
+// render the torus as displayCB() does (already in software), and the mixed
+// one draws the thick line over it.
+static std::vector<uint32_t> lineTarget;
+
+// The current line (white, in the current style) into px, w x h
+static void overlayLine(uint32_t* px, int w, int h, bool axes) {
+    uint32_t color = 0xFF292626u;                            // axes (0.15, 0.15, 0.16)
+    auto span = [&](int x0, int y0, int x1, int y1) {
+        x0 = std::max(x0, 0); x1 = std::min(x1, w - 1);
+        y0 = std::max(y0, 0); y1 = std::min(y1, h - 1);
+        for (int y = y0; y <= y1; ++y)
+            for (int x = x0; x <= x1; ++x) px[(size_t)y * w + x] = color;
+    };
+    if (axes) {
+        span(0, h / 2, w - 1, h / 2);
+        span(w / 2, 0, w / 2, h - 1);
+    }
+    color = 0xFFFFFFFFu;
+    if (haveP1 && haveP2)
+        lineFx(P1, P2, thickMode ? lineWidthW : 1, [&](int x, int y){ span(x, y, x, y); }, span);
+}
+
+static void renderLineScene() {
+    lineTarget.assign((size_t)winW * winH, 0xFF140F0Du);    // glClearColor(0.05, 0.06, 0.08)
+    overlayLine(lineTarget.data(), winW, winH, true);
+    uploadStaging.assign(lineTarget.begin(), lineTarget.end());
+}
+
+static void renderMeshScene(bool withLine) {
+    renderMesh();
+    if (withLine) overlayLine(depthTarget.color.data(), depthTarget.w, depthTarget.h, false);
+    uploadStaging.assign(depthTarget.color.begin(), depthTarget.color.end());
+}
+
+static double peakRssMB() {
+#if !defined(_WIN32)
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    #ifdef __APPLE__
+        return ru.ru_maxrss / (1024.0 * 1024.0);
+    #else
+        return ru.ru_maxrss / 1024.0;
+    #endif
+#else
+    return 0.0;
+#endif
+}
+
+static void reportFrames(const char* scene, std::vector<double>& ms) {
+    std::sort(ms.begin(), ms.end());
+    double sum = 0;
+    for (double v : ms) sum += v;
+    auto pct = [&](double p) { return ms[std::min(ms.size() - 1, (size_t)(p * ms.size()))]; };
+    std::printf("%-30s %5zu frames  mean %8.3f  p50 %8.3f  p90 %8.3f  p99 %8.3f  max %8.3f ms  peak RSS %7.1f MB\n",
+                scene, ms.size(), sum / ms.size(), pct(0.5), pct(0.9), pct(0.99), ms.back(), peakRssMB());
+}
+
+static int benchMain(int argc, char** argv) {
+    int frames = argc > 2 ? std::max(1, std::atoi(argv[2])) : 60;
+    headless = true;
+    reshapeCB(winW, winH);
+    haveP1 = haveP2 = true;
+
+    struct Scene { const char* name; bool mesh; bool thick; int W; ThickStyle style; };
+    const Scene scenes[] = {
+        { "line W=1",                        false, false, 1,  THICK_STAMP   },
+        { "line W=7",                        false, true,  7,  THICK_STAMP   },
+        { "line W=99",                       false, true,  99, THICK_STAMP   },
+        { "line W=99 butt",                  false, true,  99, THICK_BUTT    },
+        { "1M-edge 3D torus",                true,  false, 1,  THICK_STAMP   },
+        { "mixed: torus + W=15 capsule",     true,  true,  15, THICK_CAPSULE },
+    };
+    std::printf("%dx%d, %d frames per scene (after 3 warm-up frames)\n", winW, winH, frames);
+    for (const Scene& sc : scenes) {
+        thickMode = sc.thick; lineWidthW = sc.W; thickStyle = sc.style;
+        meshMode = sc.mesh; meshLevel = 2; meshAngle = 0.f;
+        std::vector<double> ms;
+        for (int f = -3; f < frames; ++f) {
+            auto t0 = std::chrono::steady_clock::now();
+            if (sc.mesh) renderMeshScene(sc.thick);
+            else         renderLineScene();
+            double dt = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+            if (f >= 0) ms.push_back(dt);
+            meshAngle += 0.01f;
+        }
+        reportFrames(sc.name, ms);
     }
+    return 0;
+}
+
+// --thickbench [lines]: the same random sub-pixel lines drawn thick into a
+// 1920x1080 software framebuffer with each style, for W = 3..99. Reports
+// time, spans and pixel writes per line; "overdraw" is writes over the
+// ideal area W * length, so stamping shows its repeated writes and the
+// capsule its round ends.
+static int thickBenchMain(int argc, char** argv) {
+    int lines = argc > 2 ? std::max(1, std::atoi(argv[2])) : 2000;
+    const int FW = 1920, FH = 1080;
+    std::vector<uint32_t> fb((size_t)FW * FH);
+    std::vector<PointFx> ends((size_t)lines * 2);
+    double length = 0;
+    for (int i = 0; i < lines; ++i) {
+        PointFx& a = ends[2 * i];
+        PointFx& b = ends[2 * i + 1];
+        a = { std::rand() % toFx(FW), std::rand() % toFx(FH) };
+        b = { clampi(a.x + (std::rand() % toFx(600)) - toFx(300), 0, toFx(FW) - 1),
+              clampi(a.y + (std::rand() % toFx(600)) - toFx(300), 0, toFx(FH) - 1) };
+        length += std::hypot((double)(b.x - a.x), (double)(b.y - a.y)) / FX_ONE;
+    }
+    std::printf("%d lines, mean length %.1f px, into %dx%d\n", lines, length / lines, FW, FH);
+    std::printf("%4s  %-14s %10s %12s %14s %9s\n", "W", "style", "us/line", "spans/line", "writes/line", "overdraw");
+
+    long long spans = 0, writes = 0;
+    uint32_t color = 0;
+    auto span = [&](int x0, int y0, int x1, int y1) {
+        ++spans;
+        x0 = std::max(x0, 0); x1 = std::min(x1, FW - 1);
+        y0 = std::max(y0, 0); y1 = std::min(y1, FH - 1);
+        for (int y = y0; y <= y1; ++y) {
+            uint32_t* row = &fb[(size_t)y * FW];
+            for (int x = x0; x <= x1; ++x) row[x] = color;
+            writes += std::max(0, x1 - x0 + 1);
+        }
+    };
+    const int widths[] = { 3, 5, 9, 17, 33, 65, 99 };
+    for (int W : widths)
+        for (int style = THICK_STAMP; style < THICK_STYLES; ++style) {
+            spans = writes = 0;
+            auto t0 = std::chrono::steady_clock::now();
+            for (int i = 0; i < lines; ++i) {
+                color = 0xFF000000u | (uint32_t)i;
+                if (style == THICK_STAMP) stampLineFx(ends[2 * i], ends[2 * i + 1], W, span);
+                else thickLineFx(ends[2 * i], ends[2 * i + 1], W, style == THICK_CAPSULE, span);
+            }
+            double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count();
+            std::printf("%4d  %-14s %10.2f %12.1f %14.1f %8.2fx\n", W, THICK_NAMES[style], us / lines,
+                        (double)spans / lines, (double)writes / lines, writes / (W * length));
+        }
+    return 0;
 }
 
 int main(int argc, char** argv) {
     std::srand(20251024);
+    if (argc > 1 && std::strcmp(argv[1], "--bench") == 0) return benchMain(argc, argv);
+    if (argc > 1 && std::strcmp(argv[1], "--thickbench") == 0) return thickBenchMain(argc, argv);
 
     glutInit(&argc, argv);
     glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB);
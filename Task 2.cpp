@@ -2,8 +2,39 @@
 // Works in Code::Blocks on Windows with FreeGLUT.
 
 #include <GL/glut.h>
+#include <climits>
 #include <cmath>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
 #include <algorithm>
+#include <queue>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+// AVX2 code is built either natively (-mavx2) or, with GCC/Clang on x86,
+// as target("avx2") functions picked at run time
+#if defined(__AVX2__)
+    #include <immintrin.h>
+    #define HAVE_AVX2 1
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+    #include <immintrin.h>
+    #define HAVE_AVX2 1
+    #define AVX2_DISPATCH 1
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #include <emmintrin.h>
+    #define HAVE_SSE2 1
+#endif
+#if !defined(_WIN32)
+    #include <sys/resource.h>
+#endif
 
 // ---------- Window / scene params ----------
 static int winW = 800, winH = 600;
@@ -16,9 +47,39 @@ static int radiusStep   = 12;  // radius increment per circle
 static int baseThick    = 2;   // thickness of innermost ring
 static int thickStep    = 1;   // thickness increment per circle
 
+// Fixed-point annulus mode (sub-pixel center/radius) + slow drift animation
+static bool fxMode   = false;
+static bool animate  = false;
+static int  animTick = 0;
+static int  animGen  = 0; // invalidates timers left over from a previous toggle
+
+// Software framebuffer with incremental (diffed span) ring updates
+static bool incrMode    = false;
+static bool animRadius  = false; // baseRadius ping-pongs by 1px per frame
+static int  radiusDir   = 1;
+
+// Radial distance-table mode: per-pixel dist^2 cached until reshape
+static bool distMode    = false;
+
+// --bench: no window; GLUT-only calls are skipped
+static bool headless    = false;
+
+// 24.8 fixed point: pixel centers at integer coordinates
+static const int     FX_SHIFT = 8;
+static const int     FX_ONE   = 1 << FX_SHIFT;
+static const int64_t FX_SQ    = (int64_t)FX_ONE * FX_ONE;
+
 // ---------- Helpers ----------
 inline int clampi(int v, int lo, int hi){ return std::max(lo, std::min(hi, v)); }
 
+inline int toFx(int v){ return v * FX_ONE; }
+
+// floor(a / b) for b > 0
+inline int64_t floorDiv(int64_t a, int64_t b){
+    int64_t q = a / b;
+    return (q * b > a) ? q - 1 : q;
+}
+
 // Simple HSV→RGB (H in [0,1), S,V in [0,1])
 static void hsv2rgb(float h, float s, float v, float& r, float& g, float& b){
     if(s <= 1e-6f){ r = g = b = v; return; }
@@ -39,13 +100,19 @@ static void hsv2rgb(float h, float s, float v, float& r, float& g, float& b){
     }
 }
 
-// Draw filled square brush centered at (x,y), radius r (in pixels)
-static void putThickPixel(int x, int y, int r){
+// Filled square brush centered at (x,y), radius r (in pixels), clamped to
+// the window; calls rect(x0, y0, x1, y1) with inclusive corners
+template<typename RectFunc>
+static void putThickPixel(int x, int y, int r, const RectFunc& rect){
     int x0 = clampi(x - r, 0, winW - 1);
     int x1 = clampi(x + r, 0, winW - 1);
     int y0 = clampi(y - r, 0, winH - 1);
     int y1 = clampi(y + r, 0, winH - 1);
+    rect(x0, y0, x1, y1);
+}
 
+// One GL quad per brush rectangle
+static void glRect(int x0, int y0, int x1, int y1){
     glBegin(GL_QUADS);
     glVertex2i(x0, y0);
     glVertex2i(x1 + 1, y0);
@@ -55,19 +122,21 @@ static void putThickPixel(int x, int y, int r){
 }
 
 // Plot the 8-way symmetric points for a circle point (x,y) around center (xc,yc)
-static void plot8(int xc, int yc, int x, int y, int brushR){
-    putThickPixel(xc + x, yc + y, brushR);
-    putThickPixel(xc - x, yc + y, brushR);
-    putThickPixel(xc + x, yc - y, brushR);
-    putThickPixel(xc - x, yc - y, brushR);
-    putThickPixel(xc + y, yc + x, brushR);
-    putThickPixel(xc - y, yc + x, brushR);
-    putThickPixel(xc + y, yc - x, brushR);
-    putThickPixel(xc - y, yc - x, brushR);
-}
-
-// Midpoint (Bresenham) circle with thickness W (in pixels)
-static void drawCircleMidpoint(int xc, int yc, int radius, int W){
+template<typename RectFunc>
+static void plot8(int xc, int yc, int x, int y, int brushR, const RectFunc& rect){
+    putThickPixel(xc + x, yc + y, brushR, rect);
+    putThickPixel(xc - x, yc + y, brushR, rect);
+    putThickPixel(xc + x, yc - y, brushR, rect);
+    putThickPixel(xc - x, yc - y, brushR, rect);
+    putThickPixel(xc + y, yc + x, brushR, rect);
+    putThickPixel(xc - y, yc + x, brushR, rect);
+    putThickPixel(xc + y, yc - x, brushR, rect);
+    putThickPixel(xc - y, yc - x, brushR, rect);
+}
+
+// Midpoint (Bresenham) circle with thickness W (in pixels), as brush rects
+template<typename RectFunc>
+static void drawCircleMidpoint(int xc, int yc, int radius, int W, const RectFunc& rect){
     if(radius <= 0 || W <= 0) return;
 
     // Brush radius (square), 4-way symmetric stamp
@@ -78,7 +147,7 @@ static void drawCircleMidpoint(int xc, int yc, int radius, int W){
     int y = radius;
     int d = 1 - radius; // decision
 
-    plot8(xc, yc, x, y, brushR);
+    plot8(xc, yc, x, y, brushR, rect);
     while (x < y){
         x++;
         if (d < 0){
@@ -87,29 +156,1066 @@ static void drawCircleMidpoint(int xc, int yc, int radius, int W){
             y--;
             d += 2*(x - y) + 1;
         }
-        plot8(xc, yc, x, y, brushR);
+        plot8(xc, yc, x, y, brushR, rect);
+    }
+}
+
+// ---------- Fixed-point annulus (scanline midpoint) ----------
+// One edge of a circle on the current scanline. f is the midpoint decision
+// value r^2 - dy^2 - (X*FX_ONE - xc)^2 (scaled by FX_ONE^2 like the inputs),
+// g = f(X) - f(X+1). Moving X or the row only adds integer differences.
+struct CircleEdgeFx {
+    int64_t X, f, g;
+
+    void init(int64_t x, int xc, int64_t dyF, int r, int64_t bias){
+        int64_t dxF = x * FX_ONE - xc;
+        X = x;
+        f = (int64_t)r * r - dyF * dyF - dxF * dxF - bias;
+        g = (2 * dxF + FX_ONE) * FX_ONE;
+    }
+    int64_t fRight() const { return f - g; }
+    int64_t fLeft()  const { return f + g - 2 * FX_SQ; }
+    void stepRight(){ f -= g; g += 2 * FX_SQ; ++X; }
+    void stepLeft() { g -= 2 * FX_SQ; f += g; --X; }
+};
+
+// Walk the covered interval [L.X, R.X] of one circle to the current row.
+// col is the pixel column at/left of the center; a non-empty interval always
+// contains col or col+1, so the edges restart from there and an empty row
+// ends up as R = col-1, L = col+2.
+static void walkCircleRow(CircleEdgeFx& L, CircleEdgeFx& R, int64_t col){
+    while (R.X < col) R.stepRight();
+    while (R.fRight() >= 0) R.stepRight();
+    while (R.X >= col && R.f < 0) R.stepLeft();
+    while (L.X > col + 1) L.stepLeft();
+    while (L.fLeft() >= 0) L.stepLeft();
+    while (L.X <= col + 1 && L.f < 0) L.stepRight();
+}
+
+// Scanline spans of the annulus rIn <= dist <= rOut around (xc,yc), all 24.8.
+// Exact integer setup per circle, then only integer adds per row/column.
+// Calls span(x0, x1, y) with x0 <= x1 for every covered run.
+template<typename SpanFunc>
+static void annulusSpansFx(int xc, int yc, int rIn, int rOut, const SpanFunc& span){
+    if(rOut <= 0) return;
+    int64_t y0  = -floorDiv(-((int64_t)yc - rOut), FX_ONE); // ceil
+    int64_t y1  = floorDiv((int64_t)yc + rOut, FX_ONE);
+    int64_t col = floorDiv(xc, FX_ONE);
+    int64_t dyF = y0 * FX_ONE - yc;
+    bool hole = rIn > 0;
+
+    // Outer edges include dist == rOut; the hole is dist < rIn (bias 1), so the
+    // ring includes dist == rIn
+    CircleEdgeFx oL, oR, iL, iR;
+    oR.init(col, xc, dyF, rOut, 0);    oL.init(col + 1, xc, dyF, rOut, 0);
+    iR.init(col, xc, dyF, rIn, 1);     iL.init(col + 1, xc, dyF, rIn, 1);
+    int64_t gy = (2 * dyF + FX_ONE) * FX_ONE; // d(dy^2) for the next row
+
+    for(int64_t y = y0; y <= y1; ++y){
+        walkCircleRow(oL, oR, col);
+        if(oL.X <= oR.X){
+            bool inner = false;
+            if(hole){
+                walkCircleRow(iL, iR, col);
+                inner = iL.X <= iR.X;
+            }
+            if(!inner){
+                span((int)oL.X, (int)oR.X, (int)y);
+            } else {
+                if(oL.X < iL.X) span((int)oL.X, (int)(iL.X - 1), (int)y);
+                if(iR.X < oR.X) span((int)(iR.X + 1), (int)oR.X, (int)y);
+            }
+        } else if(hole){
+            walkCircleRow(iL, iR, col);
+        }
+        oL.f -= gy; oR.f -= gy; iL.f -= gy; iR.f -= gy;
+        gy += 2 * FX_SQ;
+    }
+}
+
+// Ring of (fractional) radius r and thickness W around (xc,yc), all 24.8;
+// calls span(x0, x1, y) per run, clamped to the window
+template<typename SpanFunc>
+static void drawRingFx(int xc, int yc, int r, int W, const SpanFunc& span){
+    if(r <= 0 || W <= 0) return;
+    annulusSpansFx(xc, yc, r - W / 2, r + W / 2, [&](int x0, int x1, int y){
+        if((unsigned)y >= (unsigned)winH) return;
+        span(clampi(x0, 0, winW - 1), clampi(x1, 0, winW - 1), y);
+    });
+}
+
+// Gradient: hue from 0.00 → 0.85 across circles
+static void ringColor(int i, float& r, float& g, float& b){
+    float t = (numCircles <= 1) ? 0.f : (float)i / (float)(numCircles - 1);
+    hsv2rgb(0.85f * t, 0.95f, 1.0f, r, g, b);
+}
+
+// Sub-pixel drift of center/radii (per frame, not per pixel)
+static void animatedCenter(int& cxFx, int& cyFx, int& breathFx){
+    cxFx = toFx(cx); cyFx = toFx(cy); breathFx = 0;
+    if(animate){
+        float t = animTick * 0.01f;
+        cxFx += (int)(24.0f * FX_ONE * std::cos(t));
+        cyFx += (int)(16.0f * FX_ONE * std::sin(1.3f * t));
+        breathFx = (int)(3.0f * FX_ONE * std::sin(0.7f * t));
+    }
+}
+
+// ---------- Span-run layers ----------
+// A layer stores, per scanline, sorted non-overlapping runs (x0..x1, RGBA).
+// Ring and line art is mostly empty space, so a layer costs a few runs per
+// row instead of width*height*4 bytes, and merging/diffing layers walks
+// runs rather than pixels. Gaps are transparent.
+struct Run { int x0, x1; uint32_t color; };
+typedef std::vector<Run> RunRow;
+
+struct TaggedSpan { int x0, x1, order; uint32_t color; };
+
+// Source-over for packed RGBA8 (straight alpha)
+static inline uint32_t blendOver(uint32_t top, uint32_t bottom){
+    uint32_t a = top >> 24;
+    if(a == 255) return top;
+    if(a == 0)   return bottom;
+    uint32_t out = 0;
+    for(int c = 0; c < 24; c += 8){
+        uint32_t t = (top >> c) & 255, b = (bottom >> c) & 255;
+        out |= ((t * a + b * (255 - a) + 127) / 255) << c;
+    }
+    uint32_t ab = bottom >> 24;
+    return out | ((a + (ab * (255 - a) + 127) / 255) << 24);
+}
+
+// Resolve overlapping spans (higher order = drawn later = wins) into runs
+static void compositeRow(std::vector<TaggedSpan>& spans, RunRow& out){
+    out.clear();
+    if(spans.empty()) return;
+    std::sort(spans.begin(), spans.end(),
+              [](const TaggedSpan& a, const TaggedSpan& b){ return a.x0 < b.x0; });
+
+    std::priority_queue<std::pair<int, int> > active; // (order, span index)
+    size_t next = 0;
+    int x = spans[0].x0;
+    while(next < spans.size() || !active.empty()){
+        if(active.empty()) x = std::max(x, spans[next].x0);
+        while(next < spans.size() && spans[next].x0 <= x){
+            active.push(std::make_pair(spans[next].order, (int)next));
+            ++next;
+        }
+        while(!active.empty() && spans[active.top().second].x1 < x) active.pop();
+        if(active.empty()) continue;
+
+        const TaggedSpan& top = spans[active.top().second];
+        int end = top.x1;
+        if(next < spans.size()) end = std::min(end, spans[next].x0 - 1);
+        if(!out.empty() && out.back().color == top.color && out.back().x1 + 1 == x)
+            out.back().x1 = end;
+        else
+            out.push_back({ x, end, top.color });
+        x = end + 1;
+    }
+}
+
+// Walk two run rows together, calling f(x0, x1, colorA, hasA, colorB, hasB)
+// for every maximal piece of [0, w) that is covered by at least one of them
+template<typename F>
+static void sweepRows(const RunRow& a, const RunRow& b, int w, const F& f){
+    size_t i = 0, j = 0;
+    int x = 0;
+    while(x < w){
+        while(i < a.size() && a[i].x1 < x) ++i;
+        while(j < b.size() && b[j].x1 < x) ++j;
+        if(i == a.size() && j == b.size()) break;
+
+        bool inA = false, inB = false;
+        int end = w - 1;
+        if(i < a.size()){
+            if(a[i].x0 <= x){ inA = true; end = std::min(end, a[i].x1); }
+            else end = std::min(end, a[i].x0 - 1);
+        }
+        if(j < b.size()){
+            if(b[j].x0 <= x){ inB = true; end = std::min(end, b[j].x1); }
+            else end = std::min(end, b[j].x0 - 1);
+        }
+        if(inA || inB)
+            f(x, end, inA ? a[i].color : 0u, inA, inB ? b[j].color : 0u, inB);
+        x = end + 1;
+    }
+}
+
+// out = top over bottom for one row, in O(runs)
+static void mergeRowOver(const RunRow& top, const RunRow& bottom, int w, RunRow& out){
+    out.clear();
+    sweepRows(top, bottom, w, [&](int x0, int x1, uint32_t ct, bool inT, uint32_t cb, bool inB){
+        uint32_t c = !inT ? cb : (!inB ? ct : blendOver(ct, cb));
+        if(!out.empty() && out.back().color == c && out.back().x1 + 1 == x0) out.back().x1 = x1;
+        else out.push_back({ x0, x1, c });
+    });
+}
+
+struct SpanLayer {
+    int w = 0, h = 0;
+    std::vector<RunRow> rows;
+
+    void resize(int lw, int lh){ w = lw; h = lh; rows.assign(h, RunRow()); }
+    void clear(){ for(auto& r : rows) r.clear(); }
+
+    size_t runCount() const {
+        size_t n = 0;
+        for(const auto& r : rows) n += r.size();
+        return n;
+    }
+    size_t bytes() const { return runCount() * sizeof(Run) + rows.size() * sizeof(RunRow); }
+
+    // Paint an opaque-overwrite span directly into the runs (clipped)
+    void paintSpan(int y, int x0, int x1, uint32_t color){
+        if((unsigned)y >= (unsigned)h) return;
+        x0 = std::max(x0, 0); x1 = std::min(x1, w - 1);
+        if(x0 > x1) return;
+        RunRow& r = rows[y];
+        size_t i = std::lower_bound(r.begin(), r.end(), x0,
+                       [](const Run& run, int x){ return run.x1 < x; }) - r.begin();
+        size_t j = i;
+        while(j < r.size() && r[j].x0 <= x1) ++j;
+
+        Run piece[3];
+        int n = 0;
+        if(i < j && r[i].x0 < x0)     piece[n++] = { r[i].x0, x0 - 1, r[i].color };
+        piece[n++] = { x0, x1, color };
+        if(i < j && r[j - 1].x1 > x1) piece[n++] = { x1 + 1, r[j - 1].x1, r[j - 1].color };
+        r.erase(r.begin() + i, r.begin() + j);
+        r.insert(r.begin() + i, piece, piece + n);
+    }
+
+    // out = top over this, row by row in O(runs)
+    void mergeOver(const SpanLayer& top, SpanLayer& out) const {
+        if(out.w != w || out.h != h) out.resize(w, h);
+        for(int y = 0; y < h; ++y) mergeRowOver(top.rows[y], rows[y], w, out.rows[y]);
+    }
+
+    // Write the runs over a dense framebuffer (opaque runs, gaps untouched)
+    void rasterize(uint32_t* fbuf, int stride) const {
+        for(int y = 0; y < h; ++y){
+            uint32_t* row = fbuf + (size_t)y * stride;
+            for(const Run& r : rows[y]){
+                if((r.color >> 24) == 255) std::fill(row + r.x0, row + r.x1 + 1, r.color);
+                else for(int x = r.x0; x <= r.x1; ++x) row[x] = blendOver(r.color, row[x]);
+            }
+        }
+    }
+};
+
+// ---------- Glow post-process ----------
+// Adds a blurred copy of the rings over fb into glow.out; fb itself is left
+// alone because the incremental path diffs against it. The blur is
+// separable running-sum box passes (one: box, three: approximate Gaussian),
+// so a pixel costs the same at any radius. Only 64px tiles whose fb pixels
+// changed are redone, grown by the blur's reach. Horizontal passes split
+// rows and vertical passes split column bands across threads, on SSE2.
+enum GlowMode { GLOW_OFF, GLOW_BOX, GLOW_GAUSSIAN, GLOW_MODES };
+static const char* GLOW_NAMES[GLOW_MODES] = { "off", "box", "gaussian" };
+
+struct GlowBox { int x0, y0, x1, y1; };
+
+// Helper threads for parallelRanges, started on first use and parked on a
+// condition variable between calls, so a small dirty box costs a wake-up
+// rather than thread creation. Driven from one thread (the GLUT thread).
+struct RangeWorkers {
+    std::vector<std::thread> threads;
+    std::mutex lock;
+    std::condition_variable start, done;
+    void (*call)(const void*, size_t, size_t) = nullptr;
+    const void* job = nullptr;
+    size_t n = 0, parts = 0, remaining = 0;
+    uint64_t generation = 0;
+    bool quit = false;
+
+    ~RangeWorkers(){
+        { std::lock_guard<std::mutex> g(lock); quit = true; }
+        start.notify_all();
+        for(auto& t : threads) t.join();
+    }
+
+    // Part 0 runs on the caller, parts 1 .. parts-1 on the helpers
+    void run(size_t count, size_t partCount, void (*fn)(const void*, size_t, size_t), const void* ctx){
+        while(threads.size() + 1 < partCount) threads.emplace_back(&RangeWorkers::loop, this, threads.size() + 1, generation);
+        {
+            std::lock_guard<std::mutex> g(lock);
+            call = fn; job = ctx; n = count; parts = partCount; remaining = partCount - 1;
+            ++generation;
+        }
+        start.notify_all();
+        fn(ctx, 0, count / partCount);
+        std::unique_lock<std::mutex> g(lock);
+        done.wait(g, [&]{ return remaining == 0; });
+    }
+
+    void loop(size_t index, uint64_t seen){
+        std::unique_lock<std::mutex> g(lock);
+        for(;;){
+            start.wait(g, [&]{ return quit || generation != seen; });
+            if(quit) return;
+            seen = generation;
+            if(index >= parts) continue;
+            size_t b = n * index / parts, e = n * (index + 1) / parts;
+            g.unlock();
+            call(job, b, e);
+            g.lock();
+            if(--remaining == 0) done.notify_one();
+        }
+    }
+};
+
+static RangeWorkers rangeWorkers;
+
+// Run f(begin, end) over [0, n) on up to hardware_concurrency threads
+template<typename F>
+static void parallelRanges(size_t n, size_t minChunk, const F& f){
+    size_t threads = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), std::max<size_t>(1, n / minChunk));
+    if(threads <= 1){ f((size_t)0, n); return; }
+    rangeWorkers.run(n, threads, [](const void* ctx, size_t b, size_t e){ (*(const F*)ctx)(b, e); }, &f);
+}
+
+// One running-sum box pass over n 4-channel values, zero outside [0, n)
+static inline void boxPass(const int32_t* src, int32_t* dst, int n, int stride, int r, float inv){
+#ifdef HAVE_SSE2
+    const __m128 k = _mm_set1_ps(inv);
+    auto at = [&](int i){ return _mm_loadu_si128((const __m128i*)(src + (size_t)i * stride)); };
+    __m128i sum = _mm_setzero_si128();
+    for(int i = 0; i <= std::min(r, n - 1); ++i) sum = _mm_add_epi32(sum, at(i));
+    for(int i = 0; i < n; ++i){
+        _mm_storeu_si128((__m128i*)(dst + (size_t)i * stride), _mm_cvtps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(sum), k)));
+        if(i + r + 1 < n) sum = _mm_add_epi32(sum, at(i + r + 1));
+        if(i - r >= 0)    sum = _mm_sub_epi32(sum, at(i - r));
+    }
+#else
+    for(int c = 0; c < 4; ++c){
+        int32_t sum = 0;
+        for(int i = 0; i <= std::min(r, n - 1); ++i) sum += src[(size_t)i * stride + c];
+        for(int i = 0; i < n; ++i){
+            dst[(size_t)i * stride + c] = (int32_t)std::lrint(sum * inv);
+            if(i + r + 1 < n) sum += src[(size_t)(i + r + 1) * stride + c];
+            if(i - r >= 0)    sum -= src[(size_t)(i - r) * stride + c];
+        }
+    }
+#endif
+}
+
+struct Glow {
+    enum { TILE = 64 };
+
+    GlowMode mode = GLOW_OFF;
+    int radius = 6;             // per box pass
+    int strength = 224;         // glow gain, of 256
+    int w = 0, h = 0, tilesX = 0, tilesY = 0;
+    std::vector<uint32_t> out;  // composited frame
+    std::vector<uint8_t> dirty; // per tile: input changed since the last apply
+    bool allDirty = true;
+    long long pxBlurred = 0;    // by the last apply
+    std::vector<int32_t> buf[2];
+
+    int passes() const { return mode == GLOW_GAUSSIAN ? 3 : 1; }
+    int reach() const { return passes() * radius; }
+
+    void resize(int gw, int gh){
+        w = gw; h = gh;
+        tilesX = (w + TILE - 1) / TILE; tilesY = (h + TILE - 1) / TILE;
+        out.assign((size_t)w * h, 0);
+        dirty.assign((size_t)tilesX * tilesY, 0);
+        allDirty = true;
+    }
+
+    void markDirty(int x0, int y0, int x1, int y1){
+        if(x1 < 0 || y1 < 0 || x0 >= w || y0 >= h) return;
+        int tx0 = clampi(x0 / TILE, 0, tilesX - 1), tx1 = clampi(x1 / TILE, 0, tilesX - 1);
+        int ty0 = clampi(y0 / TILE, 0, tilesY - 1), ty1 = clampi(y1 / TILE, 0, tilesY - 1);
+        for(int ty = ty0; ty <= ty1; ++ty)
+            std::fill(&dirty[(size_t)ty * tilesX + tx0], &dirty[(size_t)ty * tilesX + tx1] + 1, 1);
+    }
+
+    void markAll(){ allDirty = true; }
+
+    // Dirty tiles -> pixel boxes: runs per tile row, merged down the rows
+    std::vector<GlowBox> dirtyBoxes() const {
+        std::vector<GlowBox> boxes;
+        if(allDirty){ boxes.push_back({ 0, 0, w - 1, h - 1 }); return boxes; }
+        std::vector<size_t> open, next;        // boxes touching the previous tile row
+        for(int ty = 0; ty < tilesY; ++ty){
+            next.clear();
+            for(int tx = 0; tx < tilesX; ){
+                if(!dirty[(size_t)ty * tilesX + tx]){ ++tx; continue; }
+                int run0 = tx;
+                while(tx < tilesX && dirty[(size_t)ty * tilesX + tx]) ++tx;
+                GlowBox b = { run0 * TILE, ty * TILE, std::min(w, tx * TILE) - 1, std::min(h, (ty + 1) * TILE) - 1 };
+                size_t k = 0;
+                while(k < open.size() && (boxes[open[k]].x1 < b.x0 || boxes[open[k]].x0 > b.x1)) ++k;
+                if(k < open.size()){
+                    GlowBox& o = boxes[open[k]];
+                    o = { std::min(o.x0, b.x0), o.y0, std::max(o.x1, b.x1), b.y1 };
+                    if(std::find(next.begin(), next.end(), open[k]) == next.end()) next.push_back(open[k]);
+                } else {
+                    next.push_back(boxes.size());
+                    boxes.push_back(b);
+                }
+            }
+            open.swap(next);
+        }
+        return boxes;
+    }
+
+    // Recompute out where the input changed; isSource(pixel) says whether
+    // a base pixel glows
+    template<typename IsSource>
+    void apply(const uint32_t* base, const IsSource& isSource){
+        pxBlurred = 0;
+        const int M = reach();
+        for(const GlowBox& d : dirtyBoxes()){
+            GlowBox o = { std::max(0, d.x0 - M), std::max(0, d.y0 - M), std::min(w - 1, d.x1 + M), std::min(h - 1, d.y1 + M) };
+            blurInto(base, o, isSource);
+            pxBlurred += (long long)(o.x1 - o.x0 + 1) * (o.y1 - o.y0 + 1);
+        }
+        std::fill(dirty.begin(), dirty.end(), 0);
+        allDirty = false;
+    }
+
+    template<typename IsSource>
+    void blurInto(const uint32_t* base, const GlowBox& o, const IsSource& isSource){
+        const int M = reach(), r = radius;
+        const int bx0 = o.x0 - M, by0 = o.y0 - M;
+        const int bw = o.x1 - o.x0 + 1 + 2 * M, bh = o.y1 - o.y0 + 1 + 2 * M;
+        const float inv = 1.0f / (2 * r + 1);
+        for(auto& b : buf) b.resize((size_t)bw * bh * 4);
+        int32_t* A = buf[0].data();
+        int32_t* B = buf[1].data();
+
+        // Horizontal passes, rows in parallel; the source mask is applied on load
+        parallelRanges((size_t)bh, 64, [&](size_t y0, size_t y1){
+            std::vector<int32_t> ping((size_t)bw * 4), pong((size_t)bw * 4);
+            for(size_t yy = y0; yy < y1; ++yy){
+                int y = by0 + (int)yy;
+                int32_t* row = A + yy * bw * 4;
+                for(int x = 0; x < bw; ++x){
+                    int ix = bx0 + x;
+                    uint32_t c = (y >= 0 && y < h && ix >= 0 && ix < w) ? base[(size_t)y * w + ix] : 0;
+                    if(!isSource(c)) c = 0;
+                    ping[4 * x] = c & 255; ping[4 * x + 1] = (c >> 8) & 255; ping[4 * x + 2] = (c >> 16) & 255; ping[4 * x + 3] = 0;
+                }
+                const int32_t* src = ping.data();
+                for(int p = 0; p < passes(); ++p){
+                    int32_t* dst = p + 1 == passes() ? row : (src == ping.data() ? pong.data() : ping.data());
+                    boxPass(src, dst, bw, 4, r, inv);
+                    src = dst;
+                }
+            }
+        });
+
+        // Vertical passes over the columns that matter, column bands in parallel
+        const int cols = o.x1 - o.x0 + 1;
+        parallelRanges((size_t)cols, 64, [&](size_t c0, size_t c1){
+            for(size_t c = c0; c < c1; ++c){
+                const int32_t* src = A + (M + c) * 4;
+                for(int p = 0; p < passes(); ++p){
+                    int32_t* dst = (p & 1 ? A : B) + (M + c) * 4;
+                    boxPass(src, dst, bh, bw * 4, r, inv);
+                    src = dst;
+                }
+            }
+        });
+        const int32_t* blurred = passes() & 1 ? B : A;
+
+        // out = base + strength * blur, saturated
+        for(int y = o.y0; y <= o.y1; ++y){
+            const int32_t* g = blurred + ((size_t)(y - by0) * bw + M) * 4;
+            const uint32_t* src = base + (size_t)y * w;
+            uint32_t* dst = out.data() + (size_t)y * w;
+            int x = o.x0;
+#ifdef HAVE_SSE2
+            const __m128i k = _mm_set1_epi16((short)strength), alpha = _mm_set1_epi32((int)0xFF000000u);
+            for(; x + 4 <= o.x1 + 1; x += 4){
+                const int32_t* gp = g + (size_t)(x - o.x0) * 4;
+                __m128i lo = _mm_packs_epi32(_mm_loadu_si128((const __m128i*)gp), _mm_loadu_si128((const __m128i*)(gp + 4)));
+                __m128i hi = _mm_packs_epi32(_mm_loadu_si128((const __m128i*)(gp + 8)), _mm_loadu_si128((const __m128i*)(gp + 12)));
+                lo = _mm_srli_epi16(_mm_mullo_epi16(lo, k), 8);
+                hi = _mm_srli_epi16(_mm_mullo_epi16(hi, k), 8);
+                __m128i px = _mm_adds_epu8(_mm_loadu_si128((const __m128i*)(src + x)), _mm_packus_epi16(lo, hi));
+                _mm_storeu_si128((__m128i*)(dst + x), _mm_or_si128(px, alpha));
+            }
+#endif
+            for(; x <= o.x1; ++x){
+                const int32_t* gp = g + (size_t)(x - o.x0) * 4;
+                uint32_t c = 0xFF000000u;
+                for(int ch = 0; ch < 3; ++ch){
+                    int v = (int)((src[x] >> (8 * ch)) & 255) + ((gp[ch] * strength) >> 8);
+                    c |= (uint32_t)std::min(255, v) << (8 * ch);
+                }
+                dst[x] = c;
+            }
+        }
+    }
+};
+
+static Glow glow;
+
+// ---------- Software framebuffer / incremental rings ----------
+// The scene is kept as span layers: rings rasterize straight into runs and
+// the optional guide layer is merged over them. Each ring's spans stay in
+// rowSpans (tagged with the ring) between frames, together with the
+// parameters they were made from. A frame re-rasterizes only rings whose
+// center, radii or color changed, swapping their old spans for new ones,
+// and re-composites, merges and diffs only the rows those rings cover
+// (all rows when the guides move). The diff then rewrites just the pixels
+// whose color changed. Rings and rows that did not change cost nothing;
+// when every ring moves (drift, radius animation) every ring is redone.
+static std::vector<uint32_t> fb;        // RGBA8, row 0 = bottom (glDrawPixels order)
+static SpanLayer ringLayer, guideLayer; // ring runs per row / guide line art
+static SpanLayer shown;                 // merged runs in fb
+static std::vector<std::vector<TaggedSpan> > rowSpans; // every ring's spans, by row
+
+struct RingState {
+    bool live = false;
+    int cxFx = 0, cyFx = 0, rIn = 0, rOut = 0;
+    uint32_t color = 0;
+    int y0 = 1, y1 = 0;                 // visible rows holding its spans
+};
+static std::vector<RingState> ringState; // what rowSpans holds, per ring
+static std::vector<uint8_t> rowDirty;    // ROW_RINGS | ROW_MERGE
+static const uint8_t ROW_RINGS = 1, ROW_MERGE = 2;
+static bool guidesShown = false;
+static int  guideCx = 0, guideCy = 0, guideR = 0;
+static long long rowsRedone = 0;          // rows merged and diffed by the last frame
+static bool showGuides = false;
+static const uint32_t BG_COLOR    = 0xFF1A120Fu; // glClearColor(0.06, 0.07, 0.10)
+static const uint32_t GUIDE_COLOR = 0x60FFFFFFu; // translucent white
+static long long changedPx = 0;           // pixels rewritten by the last frame
+static bool fbHasRuns = true;             // fb holds exactly the runs in 'shown'
+
+static inline uint32_t packRGB(float r, float g, float b){
+    return 0xFF000000u | ((uint32_t)(b * 255.f + 0.5f) << 16)
+                       | ((uint32_t)(g * 255.f + 0.5f) << 8) | (uint32_t)(r * 255.f + 0.5f);
+}
+
+static void resizeFramebuffer(){
+    fb.assign((size_t)winW * winH, BG_COLOR);
+    ringLayer.resize(winW, winH);
+    guideLayer.resize(winW, winH);
+    shown.resize(winW, winH);
+    rowSpans.assign(winH, std::vector<TaggedSpan>());
+    ringState.clear();
+    rowDirty.assign(winH, ROW_RINGS | ROW_MERGE);
+    guidesShown = false;
+    glow.resize(winW, winH);
+}
+
+// Rewrite only the pixels where two run rows disagree (gaps = background)
+static void diffRow(const RunRow& before, const RunRow& after, uint32_t* row){
+    sweepRows(before, after, winW, [&](int x0, int x1, uint32_t cb, bool inB, uint32_t ca, bool inA){
+        uint32_t b = inB ? blendOver(cb, BG_COLOR) : BG_COLOR;
+        uint32_t a = inA ? blendOver(ca, BG_COLOR) : BG_COLOR;
+        if(a != b){
+            std::fill(row + x0, row + x1 + 1, a);
+            changedPx += x1 - x0 + 1;
+            int y = (int)((row - fb.data()) / winW);
+            glow.markDirty(x0, y, x1, y);
+        }
+    });
+}
+
+// Crosshair and a square around the outermost ring, as line art in runs
+static void buildGuides(int cxPx, int cyPx, int rOut){
+    guideLayer.clear();
+    guideLayer.paintSpan(cyPx, 0, winW - 1, GUIDE_COLOR);
+    for(int y = 0; y < winH; ++y) guideLayer.paintSpan(y, cxPx, cxPx, GUIDE_COLOR);
+    guideLayer.paintSpan(cyPx - rOut, cxPx - rOut, cxPx + rOut, GUIDE_COLOR);
+    guideLayer.paintSpan(cyPx + rOut, cxPx - rOut, cxPx + rOut, GUIDE_COLOR);
+    for(int y = cyPx - rOut; y <= cyPx + rOut; ++y){
+        guideLayer.paintSpan(y, cxPx - rOut, cxPx - rOut, GUIDE_COLOR);
+        guideLayer.paintSpan(y, cxPx + rOut, cxPx + rOut, GUIDE_COLOR);
+    }
+}
+
+static void markRows(int y0, int y1, uint8_t bits){
+    for(int y = std::max(y0, 0); y <= std::min(y1, winH - 1); ++y) rowDirty[y] |= bits;
+}
+
+static void renderIncremental(){
+    if(!fbHasRuns){
+        std::fill(fb.begin(), fb.end(), BG_COLOR);
+        shown.clear();
+        markRows(0, winH - 1, ROW_MERGE);
+        fbHasRuns = true;
+        glow.markAll();
+    }
+
+    int cxFx, cyFx, breathFx;
+    animatedCenter(cxFx, cyFx, breathFx);
+
+    // Swap the spans of rings whose parameters changed
+    int rMax = 0;
+    size_t rings = std::max((size_t)numCircles, ringState.size());
+    ringState.resize(rings);
+    for(size_t k = 0; k < rings; ++k){
+        int i = (int)k;
+        RingState want;
+        if(i < numCircles){
+            int r = baseRadius + i * radiusStep;
+            int W = std::max(1, baseThick + i * thickStep);
+            float rr, gg, bb;
+            ringColor(i, rr, gg, bb);
+            int rFx = toFx(r) + breathFx, wFx = toFx(W);
+            want.live = true;
+            want.cxFx = cxFx; want.cyFx = cyFx;
+            want.rIn = rFx - wFx / 2; want.rOut = rFx + wFx / 2;
+            want.color = packRGB(rr, gg, bb);
+            rMax = std::max(rMax, want.rOut >> FX_SHIFT);
+        }
+        RingState& have = ringState[k];
+        if(have.live == want.live && (!want.live || (have.cxFx == want.cxFx && have.cyFx == want.cyFx &&
+           have.rIn == want.rIn && have.rOut == want.rOut && have.color == want.color)))
+            continue;
+        for(int y = std::max(have.y0, 0); y <= std::min(have.y1, winH - 1); ++y){
+            std::vector<TaggedSpan>& spans = rowSpans[y];
+            spans.erase(std::remove_if(spans.begin(), spans.end(), [i](const TaggedSpan& t){ return t.order == i; }), spans.end());
+        }
+        markRows(have.y0, have.y1, ROW_RINGS | ROW_MERGE);
+        if(want.live){
+            int ylo = INT_MAX, yhi = INT_MIN;
+            annulusSpansFx(want.cxFx, want.cyFx, want.rIn, want.rOut, [&](int x0, int x1, int y){
+                if((unsigned)y >= (unsigned)winH || x1 < 0 || x0 >= winW) return;
+                rowSpans[y].push_back({ std::max(x0, 0), std::min(x1, winW - 1), i, want.color });
+                ylo = std::min(ylo, y); yhi = std::max(yhi, y);
+            });
+            want.y0 = ylo; want.y1 = yhi;
+            markRows(ylo, yhi, ROW_RINGS | ROW_MERGE);
+        }
+        have = want;
+    }
+    ringState.resize(numCircles);
+
+    // The guides cross every row, so moving them redoes every row
+    int gcx = cxFx >> FX_SHIFT, gcy = cyFx >> FX_SHIFT, gr = rMax + 2;
+    if(showGuides != guidesShown || (showGuides && (gcx != guideCx || gcy != guideCy || gr != guideR))){
+        if(showGuides) buildGuides(gcx, gcy, gr);
+        guidesShown = showGuides; guideCx = gcx; guideCy = gcy; guideR = gr;
+        markRows(0, winH - 1, ROW_MERGE);
+    }
+
+    changedPx = 0;
+    rowsRedone = 0;
+    RunRow merged;
+    for(int y = 0; y < winH; ++y){
+        if(!rowDirty[y]) continue;
+        if(rowDirty[y] & ROW_RINGS) compositeRow(rowSpans[y], ringLayer.rows[y]);
+        if(showGuides) mergeRowOver(guideLayer.rows[y], ringLayer.rows[y], winW, merged);
+        else merged = ringLayer.rows[y];
+        diffRow(shown.rows[y], merged, &fb[(size_t)y * winW]);
+        shown.rows[y].swap(merged);
+        rowDirty[y] = 0;
+        ++rowsRedone;
+    }
+}
+
+// ---------- Radial distance table ----------
+// With a fixed center, each pixel's squared distance never changes, only the
+// ring a distance maps to does. dist2 is rebuilt on reshape; a parameter
+// change rebuilds the small dist^2 -> color table and re-shades the screen
+// in one gather pass, whatever numCircles or the thicknesses are. Ring
+// membership matches annulusSpansFx: rIn^2 <= d^2 <= rOut^2.
+static std::vector<uint32_t> dist2;     // per pixel, same layout as fb
+static std::vector<uint32_t> ringLut;   // dist^2 -> packed color
+
+static void buildDistanceTable(){
+    dist2.resize((size_t)winW * winH);
+    uint32_t maxD2 = 0;
+    for(int y = 0; y < winH; ++y){
+        uint32_t dy2 = (uint32_t)((y - cy) * (y - cy));
+        uint32_t* row = &dist2[(size_t)y * winW];
+        for(int x = 0; x < winW; ++x) row[x] = (uint32_t)((x - cx) * (x - cx)) + dy2;
+        maxD2 = std::max(maxD2, std::max(row[0], row[winW - 1]));
+    }
+    ringLut.assign((size_t)maxD2 + 1, BG_COLOR);
+}
+
+static void buildRingLut(int breathFx){
+    std::fill(ringLut.begin(), ringLut.end(), BG_COLOR);
+    int64_t maxD2 = (int64_t)ringLut.size() - 1;
+    for(int i = 0; i < numCircles; ++i){
+        int r = baseRadius + i * radiusStep;
+        int W = std::max(1, baseThick + i * thickStep);
+        int64_t rFx = toFx(r) + breathFx, wFx = toFx(W);
+        int64_t rIn = rFx - wFx / 2, rOut = rFx + wFx / 2;
+        if(rOut <= 0) continue;
+        int64_t lo = rIn > 0 ? (rIn * rIn + FX_SQ - 1) / FX_SQ : 0; // ceil
+        int64_t hi = std::min((rOut * rOut) / FX_SQ, maxD2);
+        if(lo > hi) continue;
+        float rr, gg, bb;
+        ringColor(i, rr, gg, bb);
+        std::fill(ringLut.begin() + lo, ringLut.begin() + hi + 1, packRGB(rr, gg, bb));
     }
 }
 
+#ifdef HAVE_AVX2
+// out[i] = lut[d[i]] 8 at a time; returns how many were done
+#ifdef AVX2_DISPATCH
+__attribute__((target("avx2")))
+#endif
+static size_t gatherAvx2(const uint32_t* d, const uint32_t* lut, uint32_t* out, size_t n){
+    size_t i = 0;
+    for(; i + 8 <= n; i += 8){
+        __m256i idx = _mm256_loadu_si256((const __m256i*)(d + i));
+        _mm256_storeu_si256((__m256i*)(out + i), _mm256_i32gather_epi32((const int*)lut, idx, 4));
+    }
+    return i;
+}
+#endif
+
+// fb[i] = ringLut[dist2[i]], 8 pixels per gather where the CPU has AVX2
+static void shadeFromDistance(){
+    const uint32_t* d = dist2.data();
+    const uint32_t* lut = ringLut.data();
+    uint32_t* out = fb.data();
+    size_t n = fb.size(), i = 0;
+#if defined(AVX2_DISPATCH)
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    if(avx2) i = gatherAvx2(d, lut, out, n);
+#elif defined(HAVE_AVX2)
+    i = gatherAvx2(d, lut, out, n);
+#endif
+    for(; i < n; ++i) out[i] = lut[d[i]];
+}
+
+static void renderDistanceTable(){
+    int cxFx, cyFx, breathFx;
+    animatedCenter(cxFx, cyFx, breathFx); // center drift does not apply here
+    buildRingLut(breathFx);
+    shadeFromDistance();
+    fbHasRuns = false;
+    glow.markAll();
+}
+
+// ---------- Frame recorder ----------
+// --record PATH writes every frame as video: Y4M, or raw I420 when PATH ends
+// in .yuv; "-" is stdout and "|cmd" pipes into cmd. The render thread copies
+// the frame into a free slot of a fixed pool and queues it; a writer thread
+// converts RGBA to YUV 4:2:0 (SSE2) and does the I/O. With no free slot the
+// frame is dropped and counted, so rendering never waits on disk. The size
+// is fixed by the first frame (cropped to even); later frames are cropped or
+// padded to it. Frames come from fb in the software modes and from a
+// readback of the window otherwise (nothing to read back when headless).
+static const int RECORD_FPS = 60;
+
+// Full-range BT.601 (Y4M C420jpeg), chroma from the 2x2 average.
+// Top-down RGBA, w and h even.
+static void rgbaToI420(const uint32_t* px, int w, int h, uint8_t* Y, uint8_t* U, uint8_t* V){
+    for(int y = 0; y < h; y += 2){
+        const uint32_t* r0 = px + (size_t)y * w;
+        const uint32_t* r1 = r0 + w;
+        uint8_t* y0 = Y + (size_t)y * w;
+        uint8_t* y1 = y0 + w;
+        uint8_t* u = U + (size_t)(y / 2) * (w / 2);
+        uint8_t* v = V + (size_t)(y / 2) * (w / 2);
+        int x = 0;
+#ifdef HAVE_SSE2
+        const __m128i m8 = _mm_set1_epi32(0xFF), ones = _mm_set1_epi16(1);
+        const __m128i kR = _mm_set1_epi16(77), kG = _mm_set1_epi16(150), kB = _mm_set1_epi16(29), half = _mm_set1_epi16(128);
+        const __m128i kU = _mm_setr_epi16(-43, -85, -43, -85, -43, -85, -43, -85);
+        const __m128i kV = _mm_setr_epi16(-107, -21, -107, -21, -107, -21, -107, -21);
+        const __m128i c128 = _mm_set1_epi32(128), two = _mm_set1_epi32(2);
+        // 8 pixels -> 8 x 16-bit values of one channel
+        auto chan = [&](__m128i a, __m128i b, int shift){
+            return _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(a, shift), m8), _mm_and_si128(_mm_srli_epi32(b, shift), m8));
+        };
+        // the weighted sum stays below 2^16, so unsigned 16-bit lanes are exact
+        auto luma = [&](__m128i r, __m128i g, __m128i b){
+            __m128i s = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(r, kR), _mm_mullo_epi16(g, kG)),
+                                      _mm_add_epi16(_mm_mullo_epi16(b, kB), half));
+            return _mm_srli_epi16(s, 8);
+        };
+        auto avg2x2 = [&](__m128i a, __m128i b){
+            return _mm_srli_epi32(_mm_add_epi32(_mm_add_epi32(_mm_madd_epi16(a, ones), _mm_madd_epi16(b, ones)), two), 2);
+        };
+        auto pack4 = [](__m128i v32, uint8_t* dst){
+            __m128i p = _mm_packs_epi32(v32, v32);
+            int bytes = _mm_cvtsi128_si32(_mm_packus_epi16(p, p));
+            std::memcpy(dst, &bytes, 4);
+        };
+        for(; x + 8 <= w; x += 8){
+            __m128i a0 = _mm_loadu_si128((const __m128i*)(r0 + x)), a1 = _mm_loadu_si128((const __m128i*)(r0 + x + 4));
+            __m128i b0 = _mm_loadu_si128((const __m128i*)(r1 + x)), b1 = _mm_loadu_si128((const __m128i*)(r1 + x + 4));
+            __m128i ra = chan(a0, a1, 0), ga = chan(a0, a1, 8), ba = chan(a0, a1, 16);
+            __m128i rb = chan(b0, b1, 0), gb = chan(b0, b1, 8), bb = chan(b0, b1, 16);
+            _mm_storel_epi64((__m128i*)(y0 + x), _mm_packus_epi16(luma(ra, ga, ba), _mm_setzero_si128()));
+            _mm_storel_epi64((__m128i*)(y1 + x), _mm_packus_epi16(luma(rb, gb, bb), _mm_setzero_si128()));
+            __m128i R = avg2x2(ra, rb), G = avg2x2(ga, gb), B = avg2x2(ba, bb);
+            __m128i cu = _mm_add_epi32(_mm_add_epi32(_mm_madd_epi16(_mm_or_si128(R, _mm_slli_epi32(G, 16)), kU), _mm_slli_epi32(B, 7)), c128);
+            __m128i cv = _mm_add_epi32(_mm_add_epi32(_mm_madd_epi16(_mm_or_si128(G, _mm_slli_epi32(B, 16)), kV), _mm_slli_epi32(R, 7)), c128);
+            pack4(_mm_add_epi32(_mm_srai_epi32(cu, 8), c128), u + x / 2);
+            pack4(_mm_add_epi32(_mm_srai_epi32(cv, 8), c128), v + x / 2);
+        }
+#endif
+        auto lumaOf = [](uint32_t c){
+            return (uint8_t)((77 * (c & 255) + 150 * ((c >> 8) & 255) + 29 * ((c >> 16) & 255) + 128) >> 8);
+        };
+        for(; x < w; x += 2){
+            y0[x] = lumaOf(r0[x]); y0[x + 1] = lumaOf(r0[x + 1]);
+            y1[x] = lumaOf(r1[x]); y1[x + 1] = lumaOf(r1[x + 1]);
+            int R = 2, G = 2, B = 2;
+            for(uint32_t c : { r0[x], r0[x + 1], r1[x], r1[x + 1] }){
+                R += c & 255; G += (c >> 8) & 255; B += (c >> 16) & 255;
+            }
+            R >>= 2; G >>= 2; B >>= 2;
+            u[x / 2] = (uint8_t)clampi(((-43 * R - 85 * G + 128 * B + 128) >> 8) + 128, 0, 255);
+            v[x / 2] = (uint8_t)clampi(((128 * R - 107 * G - 21 * B + 128) >> 8) + 128, 0, 255);
+        }
+    }
+}
+
+struct FrameRecorder {
+    enum { SLOTS = 8 };
+
+    std::string path;
+    FILE* out = nullptr;
+    bool isPipe = false, y4m = true;
+    int w = 0, h = 0;
+    std::vector<std::vector<uint32_t> > slots;
+    std::vector<int> freeSlots;
+    std::deque<int> ready;
+    std::mutex lock;
+    std::condition_variable wake;
+    std::thread writer;
+    bool stopping = false, failed = false;
+    uint64_t written = 0, dropped = 0;
+    size_t maxQueued = 0;
+
+    bool active() const { return !path.empty(); }
+
+    void start(const char* target){
+        path = target;
+        size_t n = path.size();
+        y4m = !(n > 4 && path.compare(n - 4, 4, ".yuv") == 0);
+    }
+
+    // First frame: open the output and start the writer
+    bool openOutput(int fw, int fh){
+        w = fw & ~1; h = fh & ~1;
+        if(w == 0 || h == 0) return false;
+#ifdef SIGPIPE
+        // A reader that quits early must fail the write, not kill the process
+        if(path == "-" || path[0] == '|') std::signal(SIGPIPE, SIG_IGN);
+#endif
+        if(path == "-") out = stdout;
+        else if(path[0] == '|'){
+#ifdef _WIN32
+            out = _popen(path.c_str() + 1, "wb");
+#else
+            out = popen(path.c_str() + 1, "w");
+#endif
+            isPipe = true;
+        }
+        else out = std::fopen(path.c_str(), "wb");
+        if(!out){ std::perror(path.c_str()); path.clear(); return false; }
+        if(y4m) std::fprintf(out, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", w, h, RECORD_FPS);
+        slots.assign(SLOTS, std::vector<uint32_t>((size_t)w * h));
+        for(int i = SLOTS - 1; i >= 0; --i) freeSlots.push_back(i);
+        writer = std::thread([this]{ writerLoop(); });
+        return true;
+    }
+
+    // Queue a bottom-up frame; never waits for the writer
+    void push(const uint32_t* px, int fw, int fh){
+        if(!active() || (!out && !openOutput(fw, fh))) return;
+        int slot;
+        {
+            std::lock_guard<std::mutex> g(lock);
+            if(freeSlots.empty()){ ++dropped; return; }
+            slot = freeSlots.back();
+            freeSlots.pop_back();
+        }
+        uint32_t* dst = slots[slot].data();
+        int cw = std::min(w, fw);
+        for(int y = 0; y < h; ++y){
+            int sy = fh - 1 - y;
+            uint32_t* row = dst + (size_t)y * w;
+            if(sy < 0){ std::fill(row, row + w, 0xFF000000u); continue; }
+            std::memcpy(row, px + (size_t)sy * fw, (size_t)cw * 4);
+            std::fill(row + cw, row + w, 0xFF000000u);
+        }
+        {
+            std::lock_guard<std::mutex> g(lock);
+            ready.push_back(slot);
+            maxQueued = std::max(maxQueued, ready.size());
+        }
+        wake.notify_one();
+    }
+
+    void writerLoop(){
+        std::vector<uint8_t> yuv((size_t)w * h * 3 / 2);
+        for(;;){
+            int slot;
+            {
+                std::unique_lock<std::mutex> g(lock);
+                wake.wait(g, [this]{ return stopping || !ready.empty(); });
+                if(ready.empty()) return;
+                slot = ready.front();
+                ready.pop_front();
+            }
+            rgbaToI420(slots[slot].data(), w, h, yuv.data(), yuv.data() + (size_t)w * h, yuv.data() + (size_t)w * h * 5 / 4);
+            bool ok = !failed && (!y4m || std::fputs("FRAME\n", out) >= 0) && std::fwrite(yuv.data(), 1, yuv.size(), out) == yuv.size();
+            std::lock_guard<std::mutex> g(lock);
+            freeSlots.push_back(slot);
+            if(ok) ++written;
+            else { failed = true; ++dropped; }
+        }
+    }
+
+    std::string describe(){
+        std::lock_guard<std::mutex> g(lock);
+        char buf[256];
+        std::snprintf(buf, sizeof(buf), "recording %s: written %llu, queued %zu (max %zu of %d), dropped %llu",
+                      path.c_str(), (unsigned long long)written, ready.size(), maxQueued, (int)SLOTS,
+                      (unsigned long long)dropped);
+        return buf;
+    }
+
+    // Drain the queue, close the output and report
+    void stop(){
+        if(!active()) return;
+        if(writer.joinable()){
+            { std::lock_guard<std::mutex> g(lock); stopping = true; }
+            wake.notify_one();
+            writer.join();
+        }
+        if(out && out != stdout){
+#ifdef _WIN32
+            if(isPipe) _pclose(out); else std::fclose(out);
+#else
+            if(isPipe) pclose(out); else std::fclose(out);
+#endif
+        }
+        else if(out) std::fflush(out);
+        std::fprintf(stderr, "recorded %llu frames (%dx%d %s) to %s, dropped %llu, max queued %zu of %d%s\n",
+                     (unsigned long long)written, w, h, y4m ? "y4m" : "raw i420", path.c_str(),
+                     (unsigned long long)dropped, maxQueued, (int)SLOTS, failed ? ", write failed" : "");
+        out = nullptr;
+        path.clear();
+    }
+};
+
+static FrameRecorder recorder;
+static std::vector<uint32_t> readback;  // window pixels for the recorder in GL modes
+
+// Headless frames have no context to upload to: the copy into a staging
+// buffer stands in for it so the per-frame pixel traffic is still paid
+static std::vector<uint32_t> uploadStaging;
+
+// fb, or fb with the glow over it
+static const uint32_t* framePixels(){
+    return glow.mode != GLOW_OFF ? glow.out.data() : fb.data();
+}
+
+static void presentFramebuffer(){
+    if(glow.mode != GLOW_OFF) glow.apply(fb.data(), [](uint32_t c){ return c != BG_COLOR; });
+    const uint32_t* px = framePixels();
+    glRasterPos2i(0, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glDrawPixels(winW, winH, GL_RGBA, GL_UNSIGNED_BYTE, px);
+    if(headless) uploadStaging.assign(px, px + fb.size());
+}
+
+static void endFrame(){
+    if(recorder.active()){
+        if(distMode || incrMode || headless) recorder.push(framePixels(), winW, winH);
+        else{
+            readback.resize((size_t)winW * winH);
+            glPixelStorei(GL_PACK_ALIGNMENT, 4);
+            glReadPixels(0, 0, winW, winH, GL_RGBA, GL_UNSIGNED_BYTE, readback.data());
+            recorder.push(readback.data(), winW, winH);
+        }
+        if(!headless) glutSetWindowTitle(("Concentric Circles - " + recorder.describe()).c_str());
+    }
+    if(!headless) glutSwapBuffers();
+}
+
+// The GL circle modes drawn into fb instead: same rings, same pixels, for
+// headless runs that have no context to draw into
+static void renderRingsSoftware(){
+    std::fill(fb.begin(), fb.end(), BG_COLOR);
+    int cxFx, cyFx, breathFx;
+    animatedCenter(cxFx, cyFx, breathFx);
+    for(int i = 0; i < numCircles; ++i){
+        int r  = baseRadius + i * radiusStep;
+        int W  = std::max(1, baseThick + i * thickStep);
+        float rr, gg, bb;
+        ringColor(i, rr, gg, bb);
+        uint32_t color = packRGB(rr, gg, bb);
+        auto rect = [&](int x0, int y0, int x1, int y1){
+            for(int y = y0; y <= y1; ++y) std::fill(&fb[(size_t)y * winW + x0], &fb[(size_t)y * winW + x1] + 1, color);
+        };
+        if(fxMode) drawRingFx(cxFx, cyFx, toFx(r) + breathFx, toFx(W), [&](int x0, int x1, int y){ rect(x0, y, x1, y); });
+        else       drawCircleMidpoint(cx, cy, r, W, rect);
+    }
+    fbHasRuns = false;
+    glow.markAll();
+}
+
 // ---------- Rendering ----------
 static void display(){
     glClear(GL_COLOR_BUFFER_BIT);
 
+    if(distMode){
+        renderDistanceTable();
+        presentFramebuffer();
+        endFrame();
+        return;
+    }
+
+    if(incrMode){
+        renderIncremental();
+        presentFramebuffer();
+        std::string title = "Concentric Circles - incremental, changed px: " + std::to_string(changedPx)
+                            + ", rows redone: " + std::to_string(rowsRedone)
+                            + ", runs: " + std::to_string(shown.runCount())
+                            + " (" + std::to_string(shown.bytes() / 1024) + " KB vs "
+                            + std::to_string(fb.size() * 4 / 1024) + " KB dense)";
+        if(glow.mode != GLOW_OFF)
+            title += ", glow " + std::string(GLOW_NAMES[glow.mode]) + " r" + std::to_string(glow.radius)
+                     + ": " + std::to_string(glow.pxBlurred) + " px reblurred";
+        if(!headless) glutSetWindowTitle(title.c_str());
+        endFrame();
+        return;
+    }
+
+    if(headless){
+        renderRingsSoftware();
+        presentFramebuffer();
+        endFrame();
+        return;
+    }
+
+    int cxFx, cyFx, breathFx;
+    animatedCenter(cxFx, cyFx, breathFx);
+
     // Draw concentric circles
     for(int i = 0; i < numCircles; ++i){
         int r  = baseRadius + i * radiusStep;
         int W  = std::max(1, baseThick + i * thickStep);
 
-        // Gradient: hue from 0.00 → 0.85 across circles
-        float t  = (numCircles <= 1) ? 0.f : (float)i / (float)(numCircles - 1);
         float rr, gg, bb;
-        hsv2rgb(0.85f * t, 0.95f, 1.0f, rr, gg, bb);
+        ringColor(i, rr, gg, bb);
         glColor3f(rr, gg, bb);
 
-        drawCircleMidpoint(cx, cy, r, W);
+        if(fxMode){
+            glBegin(GL_QUADS);
+            drawRingFx(cxFx, cyFx, toFx(r) + breathFx, toFx(W), [](int x0, int x1, int y){
+                glVertex2i(x0, y);
+                glVertex2i(x1 + 1, y);
+                glVertex2i(x1 + 1, y + 1);
+                glVertex2i(x0, y + 1);
+            });
+            glEnd();
+        }
+        else drawCircleMidpoint(cx, cy, r, W, glRect);
     }
 
-    glutSwapBuffers();
+    endFrame();
 }
 
 static void reshape(int w, int h){
@@ -117,6 +1223,8 @@ static void reshape(int w, int h){
     winH = std::max(1, h);
     cx = winW / 2;
     cy = winH / 2;
+    resizeFramebuffer();
+    buildDistanceTable();
 
     glViewport(0, 0, winW, winH);
 
@@ -136,6 +1244,27 @@ static void resetParams(){
     thickStep  = 1;
 }
 
+// One animation step of whichever animations are on
+static void advanceAnimation(){
+    if(animate) ++animTick;
+    if(animRadius){
+        if(baseRadius + radiusDir < 1 || baseRadius + radiusDir > 120) radiusDir = -radiusDir;
+        baseRadius += radiusDir;
+    }
+}
+
+static void timer(int gen){
+    if(!(animate || animRadius) || gen != animGen) return;
+    advanceAnimation();
+    glutPostRedisplay();
+    glutTimerFunc(16, timer, gen);
+}
+
+// (Re)arm the animation timer after toggling one of the animations on
+static void startTimer(){
+    glutTimerFunc(16, timer, ++animGen);
+}
+
 static void keyboard(unsigned char key, int, int){
     switch(key){
         case 27: case 'q': case 'Q': std::exit(0); break;
@@ -149,6 +1278,25 @@ static void keyboard(unsigned char key, int, int){
         case ',': radiusStep = std::max(1,   radiusStep - 1); glutPostRedisplay(); break;
 
         case 'r': case 'R': resetParams(); glutPostRedisplay(); break;
+
+        case 'f': case 'F': fxMode = !fxMode; glutPostRedisplay(); break;
+        case 'm': case 'M':
+            animate = !animate;
+            if(animate){ fxMode = true; startTimer(); }
+            glutPostRedisplay(); break;
+        case 'i': case 'I': incrMode = !incrMode; glutPostRedisplay(); break;
+        case 'g': case 'G': showGuides = !showGuides; glutPostRedisplay(); break;
+        case 'd': case 'D': distMode = !distMode; glutPostRedisplay(); break;
+        case 'b': case 'B':
+            animRadius = !animRadius;
+            if(animRadius) startTimer();
+            glutPostRedisplay(); break;
+        // Glow (incremental / distance-table modes): off -> box -> gaussian, 9/0 radius
+        case 'o': case 'O':
+            glow.mode = (GlowMode)((glow.mode + 1) % GLOW_MODES);
+            glow.markAll(); glutPostRedisplay(); break;
+        case '9': glow.radius = std::max(1,  glow.radius - 1); glow.markAll(); glutPostRedisplay(); break;
+        case '0': glow.radius = std::min(64, glow.radius + 1); glow.markAll(); glutPostRedisplay(); break;
     }
 }
 
@@ -159,7 +1307,85 @@ static void initGL(){
     glDisable(GL_BLEND);
 }
 
+// ---------- Headless benchmark ----------
+// --bench [frames]: canonical scenes run through display() without a window
+// with the animations stepped once per frame; reports the frame time
+// distribution and memory of each. There is no GL context, so the midpoint
+// and fixed-point circle modes rasterize into fb (renderRingsSoftware).
+static double peakRssMB(){
+#if !defined(_WIN32)
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    #ifdef __APPLE__
+        return ru.ru_maxrss / (1024.0 * 1024.0);
+    #else
+        return ru.ru_maxrss / 1024.0;
+    #endif
+#else
+    return 0.0;
+#endif
+}
+
+static void reportFrames(const char* scene, std::vector<double>& ms){
+    std::sort(ms.begin(), ms.end());
+    double sum = 0;
+    for(double v : ms) sum += v;
+    auto pct = [&](double p){ return ms[std::min(ms.size() - 1, (size_t)(p * ms.size()))]; };
+    std::printf("%-34s %5zu frames  mean %8.3f  p50 %8.3f  p90 %8.3f  p99 %8.3f  max %8.3f ms  peak RSS %7.1f MB\n",
+                scene, ms.size(), sum / ms.size(), pct(0.5), pct(0.9), pct(0.99), ms.back(), peakRssMB());
+}
+
+static int benchMain(int argc, char** argv){
+    int frames = argc > 2 ? std::max(1, std::atoi(argv[2])) : 120;
+    headless = true;
+    reshape(winW, winH);
+
+    struct Scene { const char* name; int rings; bool fx, anim, incr, radius, guides, dist; GlowMode glow; };
+    const Scene scenes[] = {
+        { "default (midpoint)",               18, false, false, false, false, false, false, GLOW_OFF },
+        { "default (fixed point, drifting)",  18, true,  true,  false, false, false, false, GLOW_OFF },
+        { "200 rings (midpoint)",            200, false, false, false, false, false, false, GLOW_OFF },
+        { "200 rings (fixed point, drifting)",200, true,  true,  false, false, false, false, GLOW_OFF },
+        { "200 rings (distance table)",      200, false, true,  false, false, false, true,  GLOW_OFF },
+        { "mixed: incremental + guides",     200, true,  true,  true,  true,  true,  false, GLOW_OFF },
+        { "incremental + gaussian glow",      18, false, false, true,  true,  false, false, GLOW_GAUSSIAN },
+    };
+    std::printf("%dx%d, %d frames per scene (after 3 warm-up frames)\n", winW, winH, frames);
+    for(const Scene& sc : scenes){
+        resetParams();
+        numCircles = sc.rings;
+        fxMode = sc.fx; animate = sc.anim; incrMode = sc.incr;
+        animRadius = sc.radius; showGuides = sc.guides; distMode = sc.dist;
+        glow.mode = sc.glow; glow.markAll();
+        animTick = 0; radiusDir = 1;
+        std::vector<double> ms;
+        for(int f = -3; f < frames; ++f){
+            auto t0 = std::chrono::steady_clock::now();
+            display();
+            double dt = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+            if(f >= 0) ms.push_back(dt);
+            advanceAnimation();
+        }
+        reportFrames(sc.name, ms);
+    }
+    return 0;
+}
+
 int main(int argc, char** argv){
+    // --record PATH may appear anywhere; the other modes never see it
+    for(int i = 1; i + 1 < argc; ++i)
+        if(std::strcmp(argv[i], "--record") == 0){
+            recorder.start(argv[i + 1]);
+            std::atexit([]{ recorder.stop(); });
+            for(int k = i; k + 2 <= argc; ++k) argv[k] = argv[k + 2];
+            argc -= 2;
+            break;
+        }
+    if(argc > 1 && std::strcmp(argv[1], "--bench") == 0){
+        if(recorder.path == "-"){ std::fprintf(stderr, "--record - would mix video into the --bench table on stdout\n"); recorder.path.clear(); return 1; }
+        return benchMain(argc, argv);
+    }
+
     glutInit(&argc, argv);
     glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB);
     glutInitWindowSize(winW, winH);
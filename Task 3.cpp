@@ -5,20 +5,55 @@
 #include <GL/glut.h>
 #include <vector>
 #include <algorithm>
+#include <climits>
 #include <cmath>
+#include <cstdint>
+#include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <ctime>
+#include <thread>
+#include <string>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#ifndef _WIN32
+    #include <sys/resource.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <poll.h>
+    #include <sys/socket.h>
+    #include <sys/un.h>
+    #include <cerrno>
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #include <emmintrin.h>
+    #define HAVE_SSE2 1
+#endif
 
 struct Pt { int x, y; };
 struct Seg { Pt a, b; };
 
+// Axis-aligned box; empty when x0 > x1
+struct Box { int x0, y0, x1, y1; };
+static const Box EMPTY_BOX = { INT_MAX, INT_MAX, INT_MIN, INT_MIN };
+
 static int winW = 900, winH = 600;
 
 // Clipping window (ensure xmin<=xmax, ymin<=ymax)
 static int xminC = 200, yminC = 150, xmaxC = 700, ymaxC = 450;
 
-// Data
-static std::vector<Seg> segments;
+// --bench: no window; GLUT-only calls are skipped
+static bool headless = false;
+
+// Data: see SegmentStore / SegmentBVH below
+struct SegmentStore;
+struct SegmentBVH;
 
 // Mouse helpers
 static bool haveFirst = false;
@@ -61,72 +96,3756 @@ bool liangBarskyClip(int xmin, int ymin, int xmax, int ymax,
     return true;
 }
 
-// --------------- Drawing helpers ---------------
-void drawClippingRect()
+// --------------- Metrics ---------------
+// Counters and histograms are kept in per-thread shards: a thread only ever
+// writes its own shard (relaxed load + store, no read-modify-write), and a
+// dump sums all shards. Shards of exited threads go back to a free list with
+// their counts, so totals never go backwards. Dumps use the Prometheus text
+// exposition format and go to stdout or --metrics-out FILE on SIGUSR1 or M.
+enum Metric {
+    M_FRAMES, M_PIXELS_PLOTTED, M_SEGMENTS_ACCEPTED, M_SEGMENTS_CLIPPED, M_SEGMENTS_REJECTED,
+    M_TILE_HITS, M_TILE_MISSES, M_PAN_PIXELS_REUSED, M_PAN_PIXELS_RENDERED, M_BYTES_UPLOADED,
+    M_BVH_NODES_BUILT, M_POSTER_STRIPS, M_SEGMENTS_INGESTED,
+    M_STREAM_FRAMES_SENT, M_STREAM_FRAMES_COALESCED, M_STREAM_TILES_SENT, M_STREAM_BYTES_SENT, M_STREAM_RAW_BYTES,
+    M_SERVE_JOBS, M_SERVE_JOB_ERRORS, M_SERVE_BYTES_OUT, M_SERVE_FB_REUSED, M_SERVE_FB_ALLOCATED,
+    M_COUNT
+};
+static const char* METRIC_NAMES[M_COUNT][2] = {
+    { "frames_total",               "Frames rendered" },
+    { "pixels_plotted_total",       "Line pixels written by the software rasterizers" },
+    { "segments_accepted_total",    "Segments drawn unclipped (entirely inside the clip window)" },
+    { "segments_clipped_total",     "Segments clipped to a visible part" },
+    { "segments_rejected_total",    "Segments clipped away entirely" },
+    { "canvas_tile_hits_total",     "Canvas tiles reused on redraw" },
+    { "canvas_tile_misses_total",   "Canvas tiles re-rasterized" },
+    { "pan_pixels_reused_total",    "Pan view pixels kept by the scroll blit" },
+    { "pan_pixels_rendered_total",  "Pan view pixels re-rasterized" },
+    { "bytes_uploaded_total",       "Framebuffer bytes handed to glDrawPixels" },
+    { "bvh_nodes_built_total",      "BVH nodes built (all threads)" },
+    { "poster_strips_total",        "Poster strips rendered and written" },
+    { "segments_ingested_total",    "Segments appended by producer threads" },
+    { "stream_frames_sent_total",      "Delta frames sent to stream clients" },
+    { "stream_frames_coalesced_total", "Published frames folded into a later delta for a busy client" },
+    { "stream_tiles_sent_total",       "Tiles sent to stream clients" },
+    { "stream_bytes_sent_total",       "Encoded bytes written to stream sockets" },
+    { "stream_raw_bytes_total",        "Pixel bytes of the tiles sent, before encoding" },
+    { "serve_jobs_total",              "Render server jobs completed" },
+    { "serve_job_errors_total",        "Render server jobs that failed" },
+    { "serve_bytes_out_total",         "Reply bytes written by the render server" },
+    { "serve_framebuffers_reused_total",    "Render server framebuffers taken from the pool" },
+    { "serve_framebuffers_allocated_total", "Render server framebuffers allocated (pool empty or too small)" },
+};
+
+enum Histogram { H_FRAME_MS, H_SERVE_QUEUE_MS, H_SERVE_JOB_MS, H_COUNT };
+static const char* HISTOGRAM_NAMES[H_COUNT][2] = {
+    { "frame_time_ms", "Time spent in display()" },
+    { "serve_queue_ms", "Time render server jobs waited for a worker" },
+    { "serve_job_ms", "Time render server workers spent rendering and encoding a job" },
+};
+// Bucket k holds values <= 0.125 * 2^(k/2) ms; the last one is +Inf
+static const int HIST_BUCKETS = 26;
+
+inline double bucketBound(int k) { return 0.125 * std::pow(2.0, k * 0.5); }
+
+struct MetricShard {
+    std::atomic<uint64_t> counter[M_COUNT];
+    std::atomic<uint64_t> bucket[H_COUNT][HIST_BUCKETS];
+    std::atomic<double>   sum[H_COUNT];
+
+    MetricShard()
+    {
+        for (auto& c : counter) c.store(0, std::memory_order_relaxed);
+        for (auto& h : bucket) for (auto& b : h) b.store(0, std::memory_order_relaxed);
+        for (auto& v : sum) v.store(0.0, std::memory_order_relaxed);
+    }
+};
+
+struct MetricsRegistry {
+    std::mutex lock;                      // registration and dumps only
+    std::deque<MetricShard> shards;
+    std::vector<MetricShard*> freeShards;
+
+    MetricShard* acquire()
+    {
+        std::lock_guard<std::mutex> g(lock);
+        if (!freeShards.empty()) { MetricShard* s = freeShards.back(); freeShards.pop_back(); return s; }
+        shards.emplace_back();
+        return &shards.back();
+    }
+
+    void release(MetricShard* s)
+    {
+        std::lock_guard<std::mutex> g(lock);
+        freeShards.push_back(s);
+    }
+
+    void dump(FILE* out);
+};
+
+static MetricsRegistry metrics;
+
+// Returns the thread's shard to the registry when the thread exits
+struct ShardLease {
+    MetricShard* shard = nullptr;
+    ~ShardLease() { if (shard) metrics.release(shard); }
+};
+
+inline MetricShard& myShard()
 {
-    glColor3ub(255, 210, 60); // yellow
-    glLineWidth(2.0f);
-    glBegin(GL_LINE_LOOP);
-    glVertex2i(xminC, yminC);
-    glVertex2i(xmaxC, yminC);
-    glVertex2i(xmaxC, ymaxC);
-    glVertex2i(xminC, ymaxC);
-    glEnd();
-    glLineWidth(1.0f);
+    static thread_local ShardLease lease;
+    if (!lease.shard) lease.shard = metrics.acquire();
+    return *lease.shard;
 }
 
-void drawSegments()
+inline void metricAdd(Metric m, uint64_t n = 1)
 {
-    // Original segments (gray)
-    glColor3ub(140, 140, 150);
-    glBegin(GL_LINES);
-    for (const auto& s : segments) {
-        glVertex2i(s.a.x, s.a.y);
-        glVertex2i(s.b.x, s.b.y);
+    std::atomic<uint64_t>& c = myShard().counter[m];
+    c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+inline void metricObserve(Histogram h, double ms)
+{
+    MetricShard& s = myShard();
+    int k = 0;
+    while (k < HIST_BUCKETS - 1 && ms > bucketBound(k)) ++k;
+    s.bucket[h][k].store(s.bucket[h][k].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    s.sum[h].store(s.sum[h].load(std::memory_order_relaxed) + ms, std::memory_order_relaxed);
+}
+
+void MetricsRegistry::dump(FILE* out)
+{
+    std::lock_guard<std::mutex> g(lock);
+    uint64_t c[M_COUNT] = {};
+    for (const MetricShard& s : shards)
+        for (int m = 0; m < M_COUNT; ++m) c[m] += s.counter[m].load(std::memory_order_relaxed);
+    for (int m = 0; m < M_COUNT; ++m)
+        std::fprintf(out, "# HELP %s %s\n# TYPE %s counter\n%s %llu\n", METRIC_NAMES[m][0], METRIC_NAMES[m][1],
+                     METRIC_NAMES[m][0], METRIC_NAMES[m][0], (unsigned long long)c[m]);
+
+    auto ratio = [&](const char* name, const char* help, uint64_t hit, uint64_t miss) {
+        std::fprintf(out, "# HELP %s %s\n# TYPE %s gauge\n%s %.6f\n", name, help, name, name,
+                     hit + miss ? (double)hit / (double)(hit + miss) : 0.0);
+    };
+    ratio("canvas_tile_hit_ratio", "Share of canvas tiles reused", c[M_TILE_HITS], c[M_TILE_MISSES]);
+    ratio("pan_pixel_hit_ratio", "Share of pan view pixels kept by the blit", c[M_PAN_PIXELS_REUSED], c[M_PAN_PIXELS_RENDERED]);
+    ratio("serve_framebuffer_reuse_ratio", "Share of render server framebuffers taken from the pool",
+          c[M_SERVE_FB_REUSED], c[M_SERVE_FB_ALLOCATED]);
+
+    for (int h = 0; h < H_COUNT; ++h) {
+        uint64_t b[HIST_BUCKETS] = {}, count = 0;
+        double sum = 0;
+        for (const MetricShard& s : shards) {
+            for (int k = 0; k < HIST_BUCKETS; ++k) b[k] += s.bucket[h][k].load(std::memory_order_relaxed);
+            sum += s.sum[h].load(std::memory_order_relaxed);
+        }
+        const char* name = HISTOGRAM_NAMES[h][0];
+        std::fprintf(out, "# HELP %s %s\n# TYPE %s histogram\n", name, HISTOGRAM_NAMES[h][1], name);
+        for (int k = 0; k < HIST_BUCKETS; ++k) {
+            count += b[k];
+            if (k < HIST_BUCKETS - 1) std::fprintf(out, "%s_bucket{le=\"%g\"} %llu\n", name, bucketBound(k), (unsigned long long)count);
+            else                      std::fprintf(out, "%s_bucket{le=\"+Inf\"} %llu\n", name, (unsigned long long)count);
+        }
+        std::fprintf(out, "%s_sum %.3f\n%s_count %llu\n", name, sum, name, (unsigned long long)count);
+
+        // Percentiles interpolated inside their bucket
+        std::fprintf(out, "# HELP %s_quantile Estimated from the histogram buckets\n# TYPE %s_quantile gauge\n", name, name);
+        const double qs[3] = { 0.5, 0.9, 0.99 };
+        for (double q : qs) {
+            double target = q * count, seen = 0, v = 0;
+            for (int k = 0; k < HIST_BUCKETS && count; ++k) {
+                if (seen + b[k] >= target && b[k]) {
+                    double lo = k ? bucketBound(k - 1) : 0.0;
+                    double hi = k < HIST_BUCKETS - 1 ? bucketBound(k) : lo;
+                    v = lo + (hi - lo) * (target - seen) / b[k];
+                    break;
+                }
+                seen += b[k];
+            }
+            std::fprintf(out, "%s_quantile{quantile=\"%g\"} %.3f\n", name, q, v);
+        }
     }
-    glEnd();
+}
 
-    // Clipped visible parts (cyan)
-    glColor3ub(90, 240, 255);
-    glLineWidth(2.0f);
-    glBegin(GL_LINES);
-    for (const auto& s : segments) {
+static const char* metricsPath = nullptr;        // --metrics-out; stdout when unset
+static volatile std::sig_atomic_t metricsRequested = 0;
+
+extern "C" void onMetricsSignal(int) { metricsRequested = 1; }
+
+// Write a snapshot; files are replaced atomically so readers never see half a dump
+void dumpMetrics()
+{
+    metricsRequested = 0;
+    if (!metricsPath) { metrics.dump(stdout); std::fflush(stdout); return; }
+    std::string tmp = std::string(metricsPath) + ".tmp";
+    FILE* f = std::fopen(tmp.c_str(), "w");
+    if (!f) { std::perror(tmp.c_str()); return; }
+    metrics.dump(f);
+    std::fclose(f);
+    if (std::rename(tmp.c_str(), metricsPath) != 0) std::perror(metricsPath);
+}
+
+// --------------- Segment store (stable handles) ---------------
+// Segments live in slots that never move, so a handle (slot + generation)
+// stays valid until that segment is removed. Removed slots go to a free
+// list and are reused by later adds; the generation rejects stale handles.
+typedef uint64_t SegHandle;
+static const SegHandle NO_SEGMENT = ~(SegHandle)0;
+
+struct SegmentStore
+{
+    std::vector<Seg>      seg;       // by slot
+    std::vector<uint32_t> gen;       // bumped when the slot is freed
+    std::vector<uint8_t>  alive;
+    std::vector<uint32_t> freeSlots;
+    std::vector<uint32_t> touched;   // slots added/edited/removed since the last index sync
+    size_t   live  = 0;
+    uint32_t epoch = 0;              // bumped by clear() so indexes start over
+
+    static SegHandle makeHandle(uint32_t slot, uint32_t g) { return ((SegHandle)g << 32) | slot; }
+    static uint32_t  slotOf(SegHandle h) { return (uint32_t)h; }
+
+    bool valid(SegHandle h) const
+    {
+        uint32_t i = slotOf(h);
+        return i < seg.size() && alive[i] && gen[i] == (uint32_t)(h >> 32);
+    }
+
+    SegHandle handleOf(uint32_t slot) const { return makeHandle(slot, gen[slot]); }
+
+    SegHandle add(const Seg& s)
+    {
+        uint32_t i;
+        if (!freeSlots.empty()) { i = freeSlots.back(); freeSlots.pop_back(); seg[i] = s; }
+        else { i = (uint32_t)seg.size(); seg.push_back(s); gen.push_back(0); alive.push_back(0); }
+        alive[i] = 1;
+        touched.push_back(i);
+        ++live;
+        return makeHandle(i, gen[i]);
+    }
+
+    bool update(SegHandle h, const Seg& s)
+    {
+        if (!valid(h)) return false;
+        seg[slotOf(h)] = s;
+        touched.push_back(slotOf(h));
+        return true;
+    }
+
+    bool remove(SegHandle h)
+    {
+        if (!valid(h)) return false;
+        uint32_t i = slotOf(h);
+        alive[i] = 0;
+        ++gen[i];
+        freeSlots.push_back(i);
+        touched.push_back(i);
+        --live;
+        return true;
+    }
+
+    // Batched edits: invalid handles are skipped; returns how many applied
+    size_t updateBatch(const std::vector<std::pair<SegHandle, Seg> >& edits)
+    {
+        size_t n = 0;
+        for (const auto& e : edits) n += update(e.first, e.second) ? 1 : 0;
+        return n;
+    }
+
+    size_t removeBatch(const std::vector<SegHandle>& hs)
+    {
+        size_t n = 0;
+        for (SegHandle h : hs) n += remove(h) ? 1 : 0;
+        return n;
+    }
+
+    void clear()
+    {
+        seg.clear(); gen.clear(); alive.clear();
+        freeSlots.clear(); touched.clear();
+        live = 0;
+        ++epoch;
+    }
+
+    size_t size() const { return live; }
+
+    template<typename F> void forEach(F f) const
+    {
+        for (uint32_t i = 0; i < (uint32_t)seg.size(); ++i)
+            if (alive[i]) f(i, seg[i]);
+    }
+};
+
+// --------------- BVH over the store ---------------
+inline Box segBox(const Seg& s)
+{
+    return { std::min(s.a.x, s.b.x), std::min(s.a.y, s.b.y),
+             std::max(s.a.x, s.b.x), std::max(s.a.y, s.b.y) };
+}
+inline Box boxUnion(const Box& a, const Box& b)
+{
+    return { std::min(a.x0, b.x0), std::min(a.y0, b.y0),
+             std::max(a.x1, b.x1), std::max(a.y1, b.y1) };
+}
+inline bool boxEqual(const Box& a, const Box& b)
+{
+    return a.x0 == b.x0 && a.y0 == b.y0 && a.x1 == b.x1 && a.y1 == b.y1;
+}
+inline bool boxDisjoint(const Box& a, const Box& b)
+{
+    return a.x1 < b.x0 || b.x1 < a.x0 || a.y1 < b.y0 || b.y1 < a.y0;
+}
+inline bool boxInside(const Box& inner, const Box& outer)
+{
+    return inner.x0 >= outer.x0 && inner.x1 <= outer.x1 &&
+           inner.y0 >= outer.y0 && inner.y1 <= outer.y1;
+}
+inline double segLength(const Seg& s)
+{
+    return std::sqrt((double)(s.b.x - s.a.x) * (s.b.x - s.a.x) + (double)(s.b.y - s.a.y) * (s.b.y - s.a.y));
+}
+// Perimeter-based cost (2D surface area heuristic); empty boxes cost nothing
+inline long long boxCost(const Box& b)
+{
+    return b.x0 > b.x1 ? 0 : 2LL * ((long long)(b.x1 - b.x0) + (b.y1 - b.y0));
+}
+
+// Summary of the segments against a clip window
+struct ClipStats {
+    size_t visible = 0;    // segments with any part inside
+    size_t inside  = 0;    // segments entirely inside
+    double length  = 0;    // total visible length
+    size_t clipped = 0;    // boundary segments that needed Liang-Barsky
+};
+
+// Median-split BVH. Small edits are absorbed by refitting the affected
+// leaves bottom-up; new slots wait in a short pending list. The tree is
+// rebuilt (in parallel for large sets) once pending/dead items pile up or
+// the refitted boxes have grown the total cost past twice the build cost.
+// Every node also carries the live segment count and total length below
+// it, so aggregate queries can take whole subtrees at once.
+struct SegmentBVH
+{
+    struct Node {
+        Box box;
+        int left, right;   // children, -1 for a leaf
+        int start, count;  // leaf item range
+        int parent;
+        int live;          // live segments below
+        double length;     // their total length
+    };
+
+    enum { LEAF_SIZE = 4, NOT_INDEXED = -1, PENDING = -2 };
+
+    std::vector<Node>     nodes;
+    std::vector<uint32_t> items;    // slots, grouped by leaf
+    std::vector<int>      leafOf;   // slot -> leaf node, NOT_INDEXED or PENDING
+    std::vector<uint32_t> pending;  // live slots added since the last build
+    long long buildCost = 0, cost = 0;
+    size_t rebuilds = 0, refits = 0;
+    uint32_t epoch = 0;
+
+    void reset()
+    {
+        nodes.clear(); items.clear(); leafOf.clear(); pending.clear();
+        buildCost = cost = 0;
+    }
+
+    // Apply the store's edits since the last sync (see syncScene)
+    void sync(const SegmentStore& st)
+    {
+        if (epoch != st.epoch) { reset(); epoch = st.epoch; }
+        if (leafOf.size() < st.seg.size()) leafOf.resize(st.seg.size(), NOT_INDEXED);
+
+        std::vector<int> dirtyLeaves;
+        for (uint32_t i : st.touched) {
+            int l = leafOf[i];
+            if (l >= 0) dirtyLeaves.push_back(l);
+            else if (l == NOT_INDEXED && st.alive[i]) { leafOf[i] = PENDING; pending.push_back(i); }
+        }
+
+        size_t indexed = items.size();
+        size_t deadIndexed = indexed + pending.size() - st.live; // upper bound incl. dead pending
+        if (nodes.empty() ? !pending.empty()
+                          : (pending.size() > std::max<size_t>(64, indexed / 8) ||
+                             deadIndexed > indexed / 4)) {
+            build(st);
+            return;
+        }
+
+        std::sort(dirtyLeaves.begin(), dirtyLeaves.end());
+        dirtyLeaves.erase(std::unique(dirtyLeaves.begin(), dirtyLeaves.end()), dirtyLeaves.end());
+        for (int l : dirtyLeaves) refitLeaf(st, l);
+        refits += dirtyLeaves.size();
+
+        if (cost > 2 * std::max(buildCost, 1LL)) build(st);
+    }
+
+    void refitLeaf(const SegmentStore& st, int l)
+    {
+        fitLeaf(st, l);
+        // aggregates change with any edit, so always walk to the root
+        for (int p = nodes[l].parent; p >= 0; p = nodes[p].parent) {
+            Node& n = nodes[p];
+            const Node& a = nodes[n.left];
+            const Node& b = nodes[n.right];
+            Box u = boxUnion(a.box, b.box);
+            if (!boxEqual(u, n.box)) setBox(p, u);
+            n.live = a.live + b.live;
+            n.length = a.length + b.length;
+        }
+    }
+
+    void fitLeaf(const SegmentStore& st, int l)
+    {
+        Box b = EMPTY_BOX;
+        Node& n = nodes[l];
+        n.live = 0; n.length = 0;
+        for (int k = n.start; k < n.start + n.count; ++k) {
+            uint32_t i = items[k];
+            if (!st.alive[i]) continue;
+            b = boxUnion(b, segBox(st.seg[i]));
+            n.live++;
+            n.length += segLength(st.seg[i]);
+        }
+        setBox(l, b);
+    }
+
+    void setBox(int n, const Box& b)
+    {
+        cost += boxCost(b) - boxCost(nodes[n].box);
+        nodes[n].box = b;
+    }
+
+    void build(const SegmentStore& st)
+    {
+        items.clear();
+        st.forEach([&](uint32_t i, const Seg&) { items.push_back(i); });
+        pending.clear();
+        leafOf.assign(st.seg.size(), NOT_INDEXED);
+        nodes.clear();
+        if (!items.empty()) {
+            int depth = 0;
+            unsigned hw = std::thread::hardware_concurrency();
+            if (items.size() >= 50000)
+                while ((1u << depth) < hw && depth < 4) ++depth;
+            nodes = buildRange(st, 0, (int)items.size(), depth);
+            nodes[0].parent = -1;
+        }
+        cost = 0;
+        for (int n = 0; n < (int)nodes.size(); ++n) {
+            cost += boxCost(nodes[n].box);
+            if (nodes[n].left < 0)
+                for (int k = nodes[n].start; k < nodes[n].start + nodes[n].count; ++k)
+                    leafOf[items[k]] = n;
+        }
+        buildCost = cost;
+        ++rebuilds;
+    }
+
+    // Builds items[begin,end) into a self-contained node array (root at 0).
+    // The top 'depth' levels build their left halves on another thread.
+    std::vector<Node> buildRange(const SegmentStore& st, int begin, int end, int depth)
+    {
+        std::vector<Node> out;
+        if (depth <= 0 || end - begin <= 4096) {
+            buildSeq(st, begin, end, -1, out);
+            metricAdd(M_BVH_NODES_BUILT, out.size());
+            return out;
+        }
+        int mid = partition(st, begin, end);
+        std::vector<Node> leftNodes;
+        std::thread worker([&] { leftNodes = buildRange(st, begin, mid, depth - 1); });
+        std::vector<Node> rightNodes = buildRange(st, mid, end, depth - 1);
+        worker.join();
+
+        out.resize(1 + leftNodes.size() + rightNodes.size());
+        auto splice = [&](std::vector<Node>& sub, int offset) {
+            for (size_t k = 0; k < sub.size(); ++k) {
+                Node n = sub[k];
+                if (n.left >= 0) { n.left += offset; n.right += offset; }
+                n.parent = (k == 0) ? 0 : n.parent + offset;
+                out[offset + k] = n;
+            }
+        };
+        splice(leftNodes, 1);
+        splice(rightNodes, 1 + (int)leftNodes.size());
+        const Node& l = out[1];
+        const Node& r = out[1 + leftNodes.size()];
+        out[0] = { boxUnion(l.box, r.box), 1, 1 + (int)leftNodes.size(), begin, end - begin, -1,
+                   l.live + r.live, l.length + r.length };
+        metricAdd(M_BVH_NODES_BUILT);
+        return out;
+    }
+
+    int buildSeq(const SegmentStore& st, int begin, int end, int parent, std::vector<Node>& out)
+    {
+        int n = (int)out.size();
+        out.push_back({ EMPTY_BOX, -1, -1, begin, end - begin, parent, end - begin, 0.0 });
+        if (end - begin <= LEAF_SIZE) {
+            Box b = EMPTY_BOX;
+            for (int k = begin; k < end; ++k) {
+                b = boxUnion(b, segBox(st.seg[items[k]]));
+                out[n].length += segLength(st.seg[items[k]]);
+            }
+            out[n].box = b;
+            return n;
+        }
+        int mid = partition(st, begin, end);
+        int l = buildSeq(st, begin, mid, n, out);
+        int r = buildSeq(st, mid, end, n, out);
+        out[n].left = l; out[n].right = r;
+        out[n].box = boxUnion(out[l].box, out[r].box);
+        out[n].length = out[l].length + out[r].length;
+        return n;
+    }
+
+    // Median split of items[begin,end) along the longer centroid axis
+    int partition(const SegmentStore& st, int begin, int end)
+    {
+        Box c = EMPTY_BOX;
+        for (int k = begin; k < end; ++k) {
+            const Seg& s = st.seg[items[k]];
+            int mx = s.a.x + s.b.x, my = s.a.y + s.b.y; // 2x centroid
+            c = boxUnion(c, { mx, my, mx, my });
+        }
+        bool alongX = (c.x1 - c.x0) >= (c.y1 - c.y0);
+        int mid = begin + (end - begin) / 2;
+        std::nth_element(items.begin() + begin, items.begin() + mid, items.begin() + end,
+            [&](uint32_t i, uint32_t j) {
+                const Seg& a = st.seg[i];
+                const Seg& b = st.seg[j];
+                return alongX ? (a.a.x + a.b.x) < (b.a.x + b.b.x)
+                              : (a.a.y + a.b.y) < (b.a.y + b.b.y);
+            });
+        return mid;
+    }
+
+    // Visit live segments overlapping r: inside(slot) for ones whose box is
+    // fully in r (no clipping needed), partial(slot) for the rest
+    template<typename InsideF, typename PartialF>
+    void query(const SegmentStore& st, const Box& r, InsideF inside, PartialF partial) const
+    {
+        auto visitItem = [&](uint32_t i) {
+            if (!st.alive[i]) return;
+            Box b = segBox(st.seg[i]);
+            if (boxDisjoint(b, r)) return;
+            if (boxInside(b, r)) inside(i); else partial(i);
+        };
+        for (uint32_t i : pending) visitItem(i);
+        if (nodes.empty()) return;
+
+        int stack[64], sp = 0;
+        stack[sp++] = 0;
+        while (sp > 0) {
+            const Node& n = nodes[stack[--sp]];
+            if (boxDisjoint(n.box, r)) continue;
+            if (boxInside(n.box, r)) {
+                forEachItem(st, n, inside);
+                continue;
+            }
+            if (n.left < 0) {
+                for (int k = n.start; k < n.start + n.count; ++k) visitItem(items[k]);
+            } else {
+                stack[sp++] = n.left;
+                stack[sp++] = n.right;
+            }
+        }
+    }
+
+    // Visible count/length against clip in O(log n + boundary): subtrees
+    // inside the window contribute their stored sums, disjoint ones nothing,
+    // and only segments in boundary leaves are clipped individually
+    ClipStats aggregate(const SegmentStore& st, const Box& clip) const
+    {
+        ClipStats cs;
+        auto visitItem = [&](uint32_t i) {
+            if (!st.alive[i]) return;
+            const Seg& s = st.seg[i];
+            Box b = segBox(s);
+            if (boxDisjoint(b, clip)) return;
+            if (boxInside(b, clip)) { cs.visible++; cs.inside++; cs.length += segLength(s); return; }
+            cs.clipped++;
+            float cx0, cy0, cx1, cy1;
+            if (liangBarskyClip(clip.x0, clip.y0, clip.x1, clip.y1,
+                                (float)s.a.x, (float)s.a.y, (float)s.b.x, (float)s.b.y,
+                                cx0, cy0, cx1, cy1)) {
+                cs.visible++;
+                cs.length += std::sqrt((double)(cx1 - cx0) * (cx1 - cx0) + (double)(cy1 - cy0) * (cy1 - cy0));
+            }
+        };
+        for (uint32_t i : pending) visitItem(i);
+        if (nodes.empty()) return cs;
+
+        int stack[64], sp = 0;
+        stack[sp++] = 0;
+        while (sp > 0) {
+            const Node& n = nodes[stack[--sp]];
+            if (boxDisjoint(n.box, clip)) continue;
+            if (boxInside(n.box, clip)) {
+                cs.visible += n.live; cs.inside += n.live; cs.length += n.length;
+                continue;
+            }
+            if (n.left < 0) {
+                for (int k = n.start; k < n.start + n.count; ++k) visitItem(items[k]);
+            } else {
+                stack[sp++] = n.left;
+                stack[sp++] = n.right;
+            }
+        }
+        return cs;
+    }
+
+    template<typename F>
+    void forEachItem(const SegmentStore& st, const Node& n, F f) const
+    {
+        for (int k = n.start; k < n.start + n.count; ++k)
+            if (st.alive[items[k]]) f(items[k]);
+    }
+
+    // Nearest live segment to (px,py) within maxDist, or NO_SEGMENT
+    SegHandle pick(const SegmentStore& st, float px, float py, float maxDist) const
+    {
+        float best = maxDist * maxDist;
+        uint32_t bestSlot = UINT32_MAX;
+        auto visitItem = [&](uint32_t i) {
+            if (!st.alive[i]) return;
+            float d = pointSegDist2(px, py, st.seg[i]);
+            if (d <= best) { best = d; bestSlot = i; }
+        };
+        for (uint32_t i : pending) visitItem(i);
+
+        if (!nodes.empty()) {
+            int stack[64], sp = 0;
+            stack[sp++] = 0;
+            while (sp > 0) {
+                const Node& n = nodes[stack[--sp]];
+                if (pointBoxDist2(px, py, n.box) > best) continue;
+                if (n.left < 0) {
+                    for (int k = n.start; k < n.start + n.count; ++k) visitItem(items[k]);
+                } else {
+                    stack[sp++] = n.left;
+                    stack[sp++] = n.right;
+                }
+            }
+        }
+        return bestSlot == UINT32_MAX ? NO_SEGMENT : st.handleOf(bestSlot);
+    }
+
+    static float pointBoxDist2(float px, float py, const Box& b)
+    {
+        if (b.x0 > b.x1) return 1e30f;
+        float dx = std::max(std::max(b.x0 - px, px - b.x1), 0.0f);
+        float dy = std::max(std::max(b.y0 - py, py - b.y1), 0.0f);
+        return dx * dx + dy * dy;
+    }
+
+    static float pointSegDist2(float px, float py, const Seg& s)
+    {
+        float vx = (float)(s.b.x - s.a.x), vy = (float)(s.b.y - s.a.y);
+        float wx = px - s.a.x, wy = py - s.a.y;
+        float len2 = vx * vx + vy * vy;
+        float t = len2 > 0 ? std::max(0.0f, std::min(1.0f, (wx * vx + wy * vy) / len2)) : 0.0f;
+        float dx = wx - t * vx, dy = wy - t * vy;
+        return dx * dx + dy * dy;
+    }
+};
+
+// --------------- Concurrent ingestion ---------------
+// Producer threads append to a SegmentLog: one fetch_add hands out the
+// position, segments live in fixed-size chunks allocated on demand (the
+// first writer to need a chunk installs it with a CAS), and every entry has
+// a ready flag. The published prefix only advances over ready entries, so a
+// reader taking a snapshot sees complete segments and never waits for a
+// writer, and writers never wait for anyone. Chunks below the consumed
+// position are retired and freed once no reader is pinned to an older epoch.
+struct SegmentLog
+{
+    enum { CHUNK_BITS = 14, CHUNK = 1 << CHUNK_BITS, MAX_CHUNKS = 1 << 16, MAX_READERS = 4 };
+
+    struct Chunk {
+        Seg seg[CHUNK];
+        std::atomic<uint8_t> ready[CHUNK];
+        Chunk() { for (auto& r : ready) r.store(0, std::memory_order_relaxed); }
+    };
+
+    // Entries [begin, end) are complete and readable while the snapshot is held
+    struct Snapshot { uint64_t begin, end; int reader; };
+
+    std::atomic<Chunk*>   chunks[MAX_CHUNKS];
+    std::atomic<uint64_t> reserved, published, retiredBelow, epoch;
+    std::atomic<uint64_t> readerEpoch[MAX_READERS];     // 0: not reading
+    std::vector<std::pair<uint64_t, Chunk*> > retired;  // (epoch, chunk); consumer only
+    size_t freedChunks = 0;
+
+    SegmentLog() : reserved(0), published(0), retiredBelow(0), epoch(1)
+    {
+        for (auto& c : chunks) c.store(nullptr, std::memory_order_relaxed);
+        for (auto& r : readerEpoch) r.store(0, std::memory_order_relaxed);
+    }
+
+    // Any thread; false once the log is full
+    bool append(const Seg& s)
+    {
+        uint64_t i = reserved.fetch_add(1, std::memory_order_relaxed);
+        uint64_t c = i >> CHUNK_BITS;
+        if (c >= MAX_CHUNKS) return false;
+        Chunk* ch = chunks[c].load(std::memory_order_acquire);
+        if (!ch) {
+            Chunk* fresh = new Chunk();
+            if (chunks[c].compare_exchange_strong(ch, fresh, std::memory_order_acq_rel)) ch = fresh;
+            else delete fresh;   // another writer won; ch now holds its chunk
+        }
+        ch->seg[i & (CHUNK - 1)] = s;
+        ch->ready[i & (CHUNK - 1)].store(1, std::memory_order_release);
+        return true;
+    }
+
+    // Advance the published prefix over entries that are ready
+    uint64_t publish()
+    {
+        uint64_t p = published.load(std::memory_order_acquire);
+        uint64_t limit = std::min<uint64_t>(reserved.load(std::memory_order_acquire), (uint64_t)MAX_CHUNKS << CHUNK_BITS);
+        uint64_t q = p;
+        while (q < limit) {
+            Chunk* ch = chunks[q >> CHUNK_BITS].load(std::memory_order_acquire);
+            if (!ch || !ch->ready[q & (CHUNK - 1)].load(std::memory_order_acquire)) break;
+            ++q;
+        }
+        while (q > p && !published.compare_exchange_weak(p, q, std::memory_order_acq_rel)) {}
+        return std::max(p, q);
+    }
+
+    // The pin and the retirement below are both seq_cst store-then-load, so
+    // either the consumer sees this pin or the reader sees the new boundary
+    Snapshot pin(int reader)
+    {
+        readerEpoch[reader].store(epoch.load(std::memory_order_acquire), std::memory_order_seq_cst);
+        return { retiredBelow.load(std::memory_order_seq_cst), publish(), reader };
+    }
+
+    void unpin(const Snapshot& s) { readerEpoch[s.reader].store(0, std::memory_order_release); }
+
+    const Seg& at(uint64_t i) const
+    {
+        return chunks[i >> CHUNK_BITS].load(std::memory_order_acquire)->seg[i & (CHUNK - 1)];
+    }
+
+    // Consumer: every entry below 'consumed' has been taken over, so whole
+    // chunks below it go; they are freed when all readers have moved on
+    void retire(uint64_t consumed)
+    {
+        uint64_t from = retiredBelow.load(std::memory_order_relaxed) >> CHUNK_BITS;
+        uint64_t to = consumed >> CHUNK_BITS;
+        if (to > from) {
+            retiredBelow.store(to << CHUNK_BITS, std::memory_order_seq_cst);
+            uint64_t e = epoch.fetch_add(1, std::memory_order_acq_rel);
+            for (uint64_t c = from; c < to; ++c)
+                retired.push_back({ e, chunks[c].exchange(nullptr, std::memory_order_acq_rel) });
+        }
+        uint64_t oldest = UINT64_MAX;
+        for (auto& r : readerEpoch) {
+            uint64_t v = r.load(std::memory_order_seq_cst);
+            if (v) oldest = std::min(oldest, v);
+        }
+        size_t keep = 0;
+        for (auto& rc : retired) {
+            if (rc.first < oldest) { delete rc.second; ++freedChunks; }
+            else retired[keep++] = rc;
+        }
+        retired.resize(keep);
+    }
+
+    size_t liveChunks() const
+    {
+        size_t n = 0;
+        for (uint64_t c = retiredBelow.load() >> CHUNK_BITS; c < MAX_CHUNKS; ++c) {
+            if (!chunks[c].load(std::memory_order_relaxed)) break;
+            ++n;
+        }
+        return n;
+    }
+};
+
+static SegmentStore segments;
+static SegmentBVH   segIndex;
+
+// The GUI thread is the log's consumer (reader 0): syncScene() moves the
+// published prefix into 'segments', so rendering only ever sees whole
+// prefixes and never touches memory producers are writing
+static SegmentLog ingestLog;
+static uint64_t   ingestConsumed = 0;
+static const int  INGEST_READER  = 0;
+
+void ingestFromLog()
+{
+    if (ingestLog.reserved.load(std::memory_order_relaxed) == ingestConsumed) return;
+    SegmentLog::Snapshot snap = ingestLog.pin(INGEST_READER);
+    for (uint64_t i = std::max(ingestConsumed, snap.begin); i < snap.end; ++i) segments.add(ingestLog.at(i));
+    ingestConsumed = std::max(ingestConsumed, snap.end);
+    ingestLog.unpin(snap);
+    ingestLog.retire(ingestConsumed);
+}
+
+// Demo producers: P starts/stops a few threads streaming short segments
+static std::vector<std::thread> producers;
+static std::atomic<bool> producing(false);
+
+void producerLoop(int id, int w, int h)
+{
+    unsigned rng = 0x9E3779B9u * (id + 1);
+    auto rnd = [&rng]() { rng = rng * 1664525u + 1013904223u; return rng >> 8; };
+    while (producing.load(std::memory_order_relaxed)) {
+        const int BATCH = 200;
+        int k = 0;
+        for (; k < BATCH; ++k) {
+            Seg s;
+            s.a.x = (int)(rnd() % (unsigned)w); s.a.y = (int)(rnd() % (unsigned)h);
+            s.b.x = clampi(s.a.x + (int)(rnd() % 61) - 30, 0, w - 1);
+            s.b.y = clampi(s.a.y + (int)(rnd() % 61) - 30, 0, h - 1);
+            if (!ingestLog.append(s)) { producing = false; break; }
+        }
+        metricAdd(M_SEGMENTS_INGESTED, (uint64_t)k);
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+}
+
+void startProducers(int n, int w, int h)
+{
+    producing = true;
+    for (int i = 0; i < n; ++i) producers.emplace_back(producerLoop, i, w, h);
+}
+
+void stopProducers()
+{
+    producing = false;
+    for (auto& t : producers) t.join();
+    producers.clear();
+}
+
+// --------------- Software canvas + mip pyramid ---------------
+// The scene (gray segments, cyan clipped parts) is also rasterized into a
+// large RGBA canvas in world coordinates. Edits only dirty the 64x64 tiles
+// under the old and new segment boxes; dirty tiles are re-rasterized from
+// the BVH and pushed down a pyramid of 2x2 box-filtered levels, so zooming
+// out just displays a coarser level without touching the primitives.
+static const uint32_t CANVAS_BG   = 0xFF1C1412u; // glClearColor(0.07, 0.08, 0.11)
+static const uint32_t CANVAS_GRAY = 0xFF968C8Cu; // (140,140,150)
+static const uint32_t CANVAS_CYAN = 0xFFFFF05Au; // (90,240,255)
+
+// Plot the pixels of the integer Bresenham line s that fall inside r;
+// returns how many were written.
+// The walk starts directly at the first major-axis step that reaches r,
+// with the error term that the full walk would have had there.
+long long rasterSegmentInRect(const Seg& s, const Box& r, uint32_t color, uint32_t* px, int stride)
+{
+    int dx = std::abs(s.b.x - s.a.x), dy = std::abs(s.b.y - s.a.y);
+    int sx = (s.a.x < s.b.x) ? 1 : -1, sy = (s.a.y < s.b.y) ? 1 : -1;
+    bool yMajor = dy > dx;
+    int m0 = yMajor ? s.a.y : s.a.x, n0 = yMajor ? s.a.x : s.a.y;
+    int sm = yMajor ? sy : sx,       sn = yMajor ? sx : sy;
+    long long dm = yMajor ? dy : dx, dn = yMajor ? dx : dy;
+    int lo = yMajor ? r.y0 : r.x0,   hi = yMajor ? r.y1 : r.x1;
+
+    long long kA = (sm > 0) ? (long long)lo - m0 : (long long)m0 - hi;
+    long long kB = (sm > 0) ? (long long)hi - m0 : (long long)m0 - lo;
+    kA = std::max(kA, 0LL); kB = std::min(kB, dm);
+    if (kA > kB) return 0;
+
+    // minor steps taken before step k: floor((2k*dn + dm) / (2dm))
+    long long steps = dm ? (2 * kA * dn + dm) / (2 * dm) : 0;
+    long long err = 2 * dn - dm + 2 * kA * dn - 2 * dm * steps;
+    int m = m0 + sm * (int)kA, n = n0 + sn * (int)steps;
+    long long plotted = 0;
+    for (long long k = kA; k <= kB; ++k) {
+        int x = yMajor ? n : m, y = yMajor ? m : n;
+        if (x >= r.x0 && x <= r.x1 && y >= r.y0 && y <= r.y1) { px[(size_t)y * stride + x] = color; ++plotted; }
+        if (err >= 0) { n += sn; err -= 2 * dm; }
+        m += sm;
+        err += 2 * dn;
+    }
+    return plotted;
+}
+
+// dst[i] = rounded mean of the 2x2 block at src0[2i], src0[2i+1], src1[2i], src1[2i+1]
+void reduceRow2x2(const uint32_t* src0, const uint32_t* src1, uint32_t* dst, int n)
+{
+    int i = 0;
+#ifdef HAVE_SSE2
+    const __m128i zero = _mm_setzero_si128(), two = _mm_set1_epi16(2);
+    for (; i + 2 <= n; i += 2) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(src0 + 2 * i)); // 4 px
+        __m128i b = _mm_loadu_si128((const __m128i*)(src1 + 2 * i));
+        __m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero)); // px 0,1
+        __m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero)); // px 2,3
+        __m128i sum = _mm_add_epi16(_mm_unpacklo_epi64(lo, hi), _mm_unpackhi_epi64(lo, hi));
+        sum = _mm_srli_epi16(_mm_add_epi16(sum, two), 2);
+        _mm_storel_epi64((__m128i*)(dst + i), _mm_packus_epi16(sum, zero));
+    }
+#endif
+    for (; i < n; ++i) {
+        uint32_t p[4] = { src0[2 * i], src0[2 * i + 1], src1[2 * i], src1[2 * i + 1] };
+        uint32_t out = 0;
+        for (int c = 0; c < 32; c += 8) {
+            uint32_t v = ((p[0] >> c) & 255) + ((p[1] >> c) & 255) + ((p[2] >> c) & 255) + ((p[3] >> c) & 255);
+            out |= ((v + 2) >> 2) << c;
+        }
+        dst[i] = out;
+    }
+}
+
+// --------------- Line / clip kernels + autotuner ---------------
+// Interchangeable kernels for whole segments known to lie inside the target
+// (pixel-identical to the Bresenham walk) and for batch clipping. Which one
+// is fastest depends on the workload, so the autotuner samples each batch
+// (length, orientation, trivial accept/reject ratio), micro-benchmarks the
+// candidates on that sample the first time a workload class shows up and
+// again every RETUNE_EVERY batches, and routes batches of the class to the
+// winner. Benchmark draws go to the real target: drawing the same pixels
+// again is harmless.
+enum LineKernel { LK_BRESENHAM, LK_TABLE, LK_RUNSLICE, LK_SIMD4, LK_COUNT };
+enum ClipKernel { CK_PLAIN, CK_OUTCODE, CK_COUNT };
+static const char* LINE_KERNEL_NAMES[LK_COUNT] = { "bresenham", "table", "run-slice", "simd4" };
+static const char* CLIP_KERNEL_NAMES[CK_COUNT] = { "liang-barsky", "outcode+lb" };
+
+void lineBresenham(const Seg& s, uint32_t color, uint32_t* px, int stride)
+{
+    int dx = std::abs(s.b.x - s.a.x), dy = std::abs(s.b.y - s.a.y);
+    int sx = (s.a.x < s.b.x) ? 1 : -1, sy = (s.a.y < s.b.y) ? 1 : -1;
+    bool yMajor = dy > dx;
+    long long dm = yMajor ? dy : dx, dn = yMajor ? dx : dy;
+    long long incM = yMajor ? (long long)sy * stride : sx, incN = yMajor ? sx : (long long)sy * stride;
+    long long pos = (long long)s.a.y * stride + s.a.x;
+    long long err = 2 * dn - dm;
+    for (long long k = 0; k <= dm; ++k) {
+        px[pos] = color;
+        if (err >= 0) { pos += incN; err -= 2 * dm; }
+        pos += incM;
+        err += 2 * dn;
+    }
+}
+
+// Bresenham step patterns for short lines: bit k of lineSteps[dm][dn] says
+// whether the minor coordinate advances after pixel k
+static const int LINE_TABLE_MAX = 15;
+static uint16_t lineSteps[LINE_TABLE_MAX + 1][LINE_TABLE_MAX + 1];
+
+void initLineTable()
+{
+    for (int dm = 0; dm <= LINE_TABLE_MAX; ++dm)
+        for (int dn = 0; dn <= dm; ++dn) {
+            uint16_t bits = 0;
+            int err = 2 * dn - dm;
+            for (int k = 0; k < dm; ++k) {
+                if (err >= 0) { bits |= (uint16_t)(1u << k); err -= 2 * dm; }
+                err += 2 * dn;
+            }
+            lineSteps[dm][dn] = bits;
+        }
+}
+
+void lineTable(const Seg& s, uint32_t color, uint32_t* px, int stride)
+{
+    int dx = std::abs(s.b.x - s.a.x), dy = std::abs(s.b.y - s.a.y);
+    bool yMajor = dy > dx;
+    int dm = yMajor ? dy : dx, dn = yMajor ? dx : dy;
+    if (dm > LINE_TABLE_MAX) { lineBresenham(s, color, px, stride); return; }
+    int sx = (s.a.x < s.b.x) ? 1 : -1, sy = (s.a.y < s.b.y) ? 1 : -1;
+    long long incM = yMajor ? (long long)sy * stride : sx, incN = yMajor ? sx : (long long)sy * stride;
+    long long pos = (long long)s.a.y * stride + s.a.x;
+    unsigned bits = lineSteps[dm][dn];
+    for (int k = 0; k <= dm; ++k, bits >>= 1) {
+        px[pos] = color;
+        pos += incM + ((bits & 1) ? incN : 0);
+    }
+}
+
+// Run-slice: an x-major line is a sequence of horizontal runs, one per row;
+// run j starts at step ceil((2j-1)*dx / (2dy)) and is written with one fill
+void lineRunSlice(const Seg& s, uint32_t color, uint32_t* px, int stride)
+{
+    long long dx = std::abs(s.b.x - s.a.x), dy = std::abs(s.b.y - s.a.y);
+    if (dy > dx) { lineBresenham(s, color, px, stride); return; }
+    int sx = (s.a.x < s.b.x) ? 1 : -1, sy = (s.a.y < s.b.y) ? 1 : -1;
+    long long kStart = 0;
+    for (long long j = 0; j <= dy; ++j) {
+        long long kEnd = (j == dy) ? dx : ((2 * j + 1) * dx + 2 * dy - 1) / (2 * dy) - 1;
+        int y = s.a.y + sy * (int)j;
+        int xa = s.a.x + sx * (int)kStart, xb = s.a.x + sx * (int)kEnd;
+        uint32_t* row = px + (long long)y * stride;
+        std::fill(row + std::min(xa, xb), row + std::max(xa, xb) + 1, color);
+        kStart = kEnd + 1;
+    }
+}
+
+// Four lines at once: one lane per line holding (pixel offset, error,
+// steps left); the step update runs in SSE2, finished lanes are refilled
+void linesSimd4(const Seg* segs, size_t n, uint32_t color, uint32_t* px, int stride)
+{
+    alignas(16) int32_t pos[4], err[4], left[4], incM[4], incN[4], dErrM[4], dErrN[4];
+    size_t next = 0;
+    int active = 0;
+    auto load = [&](int l) {
+        while (next < n) {
+            const Seg& s = segs[next++];
+            int dx = std::abs(s.b.x - s.a.x), dy = std::abs(s.b.y - s.a.y);
+            int sx = (s.a.x < s.b.x) ? 1 : -1, sy = (s.a.y < s.b.y) ? 1 : -1;
+            bool yMajor = dy > dx;
+            int dm = yMajor ? dy : dx, dn = yMajor ? dx : dy;
+            pos[l] = s.a.y * stride + s.a.x;
+            incM[l] = yMajor ? sy * stride : sx;
+            incN[l] = yMajor ? sx : sy * stride;
+            err[l] = 2 * dn - dm;
+            dErrM[l] = 2 * dn;          // added every step
+            dErrN[l] = 2 * dm;          // removed on a minor step
+            left[l] = dm;
+            return true;
+        }
+        left[l] = -1;
+        return false;
+    };
+    for (int l = 0; l < 4; ++l) active += load(l) ? 1 : 0;
+
+    while (active > 0) {
+        for (int l = 0; l < 4; ++l)
+            if (left[l] >= 0) px[pos[l]] = color;
+#ifdef HAVE_SSE2
+        __m128i e  = _mm_load_si128((const __m128i*)err);
+        __m128i p  = _mm_load_si128((const __m128i*)pos);
+        __m128i lf = _mm_load_si128((const __m128i*)left);
+        __m128i step = _mm_cmpgt_epi32(e, _mm_set1_epi32(-1));      // err >= 0
+        p = _mm_add_epi32(p, _mm_add_epi32(_mm_load_si128((const __m128i*)incM),
+                                           _mm_and_si128(step, _mm_load_si128((const __m128i*)incN))));
+        e = _mm_add_epi32(e, _mm_sub_epi32(_mm_load_si128((const __m128i*)dErrM),
+                                           _mm_and_si128(step, _mm_load_si128((const __m128i*)dErrN))));
+        lf = _mm_sub_epi32(lf, _mm_set1_epi32(1));
+        _mm_store_si128((__m128i*)err, e);
+        _mm_store_si128((__m128i*)pos, p);
+        _mm_store_si128((__m128i*)left, lf);
+#else
+        for (int l = 0; l < 4; ++l) {
+            bool step = err[l] >= 0;
+            pos[l] += incM[l] + (step ? incN[l] : 0);
+            err[l] += dErrM[l] - (step ? dErrN[l] : 0);
+            left[l] -= 1;
+        }
+#endif
+        for (int l = 0; l < 4; ++l)
+            if (left[l] == -1) active -= load(l) ? 0 : 1;
+            else if (left[l] < -1) left[l] = -2; // idle lane stays idle
+    }
+}
+
+void rasterBatchWith(LineKernel k, const Seg* segs, size_t n, uint32_t color, uint32_t* px, int stride)
+{
+    switch (k) {
+        case LK_BRESENHAM: for (size_t i = 0; i < n; ++i) lineBresenham(segs[i], color, px, stride); break;
+        case LK_TABLE:     for (size_t i = 0; i < n; ++i) lineTable(segs[i], color, px, stride); break;
+        case LK_RUNSLICE:  for (size_t i = 0; i < n; ++i) lineRunSlice(segs[i], color, px, stride); break;
+        default:           linesSimd4(segs, n, color, px, stride); break;
+    }
+}
+
+// Cohen-Sutherland region code of (x,y) against the window
+inline int outcode(int x, int y, const Box& w)
+{
+    return (x < w.x0 ? 1 : 0) | (x > w.x1 ? 2 : 0) | (y < w.y0 ? 4 : 0) | (y > w.y1 ? 8 : 0);
+}
+
+// Clip a batch; visible parts are appended to out as x0,y0,x1,y1
+void clipBatchWith(ClipKernel k, const Seg* segs, size_t n, const Box& w, std::vector<float>& out)
+{
+    for (size_t i = 0; i < n; ++i) {
+        const Seg& s = segs[i];
+        if (k == CK_OUTCODE) {
+            int c0 = outcode(s.a.x, s.a.y, w), c1 = outcode(s.b.x, s.b.y, w);
+            if (c0 & c1) continue;
+            if ((c0 | c1) == 0) {
+                out.push_back((float)s.a.x); out.push_back((float)s.a.y);
+                out.push_back((float)s.b.x); out.push_back((float)s.b.y);
+                continue;
+            }
+        }
         float cx0, cy0, cx1, cy1;
-        if (liangBarskyClip(xminC, yminC, xmaxC, ymaxC,
-                            (float)s.a.x, (float)s.a.y,
-                            (float)s.b.x, (float)s.b.y,
-                            cx0, cy0, cx1, cy1)) {
-            glVertex2f(cx0, cy0);
-            glVertex2f(cx1, cy1);
+        if (liangBarskyClip(w.x0, w.y0, w.x1, w.y1, (float)s.a.x, (float)s.a.y,
+                            (float)s.b.x, (float)s.b.y, cx0, cy0, cx1, cy1)) {
+            out.push_back(cx0); out.push_back(cy0); out.push_back(cx1); out.push_back(cy1);
         }
     }
-    glEnd();
-    glLineWidth(1.0f);
+}
+
+struct Autotuner
+{
+    enum { LEN_BUCKETS = 4, LINE_CLASSES = LEN_BUCKETS * 2, CLIP_CLASSES = 3,
+           SAMPLE = 256, MIN_BATCH = 64, RETUNE_EVERY = 512 };
+
+    int    lineChoice[LINE_CLASSES];
+    double lineNs[LINE_CLASSES][LK_COUNT];   // ns per segment at the last tune
+    size_t lineBatches[LINE_CLASSES];
+    int    clipChoice[CLIP_CLASSES];
+    double clipNs[CLIP_CLASSES][CK_COUNT];
+    size_t clipBatches[CLIP_CLASSES];
+    size_t tunes = 0;
+    int    lastLineClass = -1, lastClipClass = -1;
+    double lastShallow = 0, lastTrivial = 0;
+    std::vector<Seg> sample;
+    std::vector<float> scratch;
+
+    Autotuner()
+    {
+        initLineTable();
+        for (int c = 0; c < LINE_CLASSES; ++c) { lineChoice[c] = -1; lineBatches[c] = 0; }
+        for (int c = 0; c < CLIP_CLASSES; ++c) { clipChoice[c] = -1; clipBatches[c] = 0; }
+    }
+
+    static const char* lengthName(int bucket)
+    {
+        static const char* names[LEN_BUCKETS] = { "<16", "16-64", "64-256", ">=256" };
+        return names[bucket];
+    }
+
+    // Strided sample of up to SAMPLE segments
+    void takeSample(const Seg* segs, size_t n)
+    {
+        sample.clear();
+        size_t stepN = std::max<size_t>(1, n / SAMPLE);
+        for (size_t i = 0; i < n && sample.size() < SAMPLE; i += stepN) sample.push_back(segs[i]);
+    }
+
+    // Workload class: mean major-axis length bucket x mostly-shallow
+    int lineClass()
+    {
+        double len = 0; size_t shallow = 0;
+        for (const Seg& s : sample) {
+            int dx = std::abs(s.b.x - s.a.x), dy = std::abs(s.b.y - s.a.y);
+            len += std::max(dx, dy);
+            shallow += dx >= dy ? 1 : 0;
+        }
+        len /= std::max<size_t>(1, sample.size());
+        lastShallow = (double)shallow / std::max<size_t>(1, sample.size());
+        int bucket = len < 16 ? 0 : len < 64 ? 1 : len < 256 ? 2 : 3;
+        return bucket * 2 + (lastShallow > 0.5 ? 1 : 0);
+    }
+
+    template<typename F>
+    static double timeNs(F f)
+    {
+        double best = 1e30;
+        for (int rep = 0; rep < 3; ++rep) {
+            auto t0 = std::chrono::steady_clock::now();
+            f();
+            best = std::min(best, std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count());
+        }
+        return best;
+    }
+
+    void rasterBatch(const Seg* segs, size_t n, uint32_t color, uint32_t* px, int stride)
+    {
+        if (n < MIN_BATCH) {
+            int c = lastLineClass >= 0 ? lineChoice[lastLineClass] : -1;
+            rasterBatchWith(c >= 0 ? (LineKernel)c : LK_BRESENHAM, segs, n, color, px, stride);
+            return;
+        }
+        takeSample(segs, n);
+        int c = lineClass();
+        lastLineClass = c;
+        if (lineChoice[c] < 0 || ++lineBatches[c] % RETUNE_EVERY == 0) {
+            int best = 0;
+            for (int k = 0; k < LK_COUNT; ++k) {
+                lineNs[c][k] = timeNs([&] { rasterBatchWith((LineKernel)k, sample.data(), sample.size(), color, px, stride); })
+                               / sample.size();
+                if (lineNs[c][k] < lineNs[c][best]) best = k;
+            }
+            lineChoice[c] = best;
+            ++tunes;
+        }
+        rasterBatchWith((LineKernel)lineChoice[c], segs, n, color, px, stride);
+    }
+
+    void clipBatch(const Seg* segs, size_t n, const Box& w, std::vector<float>& out)
+    {
+        if (n < MIN_BATCH) {
+            int c = lastClipClass >= 0 ? clipChoice[lastClipClass] : -1;
+            clipBatchWith(c >= 0 ? (ClipKernel)c : CK_PLAIN, segs, n, w, out);
+            return;
+        }
+        takeSample(segs, n);
+        size_t trivial = 0;
+        for (const Seg& s : sample) {
+            int c0 = outcode(s.a.x, s.a.y, w), c1 = outcode(s.b.x, s.b.y, w);
+            trivial += ((c0 & c1) || (c0 | c1) == 0) ? 1 : 0;
+        }
+        lastTrivial = (double)trivial / sample.size();
+        int c = lastTrivial < 0.5 ? 0 : lastTrivial < 0.9 ? 1 : 2;
+        lastClipClass = c;
+        if (clipChoice[c] < 0 || ++clipBatches[c] % RETUNE_EVERY == 0) {
+            int best = 0;
+            for (int k = 0; k < CK_COUNT; ++k) {
+                clipNs[c][k] = timeNs([&] { scratch.clear(); clipBatchWith((ClipKernel)k, sample.data(), sample.size(), w, scratch); })
+                               / sample.size();
+                if (clipNs[c][k] < clipNs[c][best]) best = k;
+            }
+            clipChoice[c] = best;
+            ++tunes;
+        }
+        clipBatchWith((ClipKernel)clipChoice[c], segs, n, w, out);
+    }
+
+    // One-line summary of the latest decisions for the HUD / stats
+    std::string describe() const
+    {
+        char buf[256];
+        int n = std::snprintf(buf, sizeof(buf), "Kernels (%zu tunes):", tunes);
+        if (lastLineClass >= 0 && lineChoice[lastLineClass] >= 0)
+            n += std::snprintf(buf + n, sizeof(buf) - n, " line=%s [len %s, %.0f%% shallow]",
+                               LINE_KERNEL_NAMES[lineChoice[lastLineClass]], lengthName(lastLineClass / 2),
+                               lastShallow * 100.0);
+        if (lastClipClass >= 0 && clipChoice[lastClipClass] >= 0)
+            std::snprintf(buf + n, sizeof(buf) - n, " clip=%s [%.0f%% trivial]",
+                          CLIP_KERNEL_NAMES[clipChoice[lastClipClass]], lastTrivial * 100.0);
+        return buf;
+    }
+};
+
+static Autotuner tuner;
+
+// --------------- Packed segment blocks ---------------
+// Compressed storage for large segment sets, in memory and on disk. Input
+// is Morton-sorted (by midpoint) and cut into blocks of PACK_BLOCK, so each
+// block is spatially compact. A block stores its bounding box and base
+// point, then four bit-packed streams: a.x and a.y relative to the base and
+// zigzag deltas b - a (wrapping 32-bit arithmetic, so any input round-trips).
+// Streams use one width per block and are laid out 4-way interleaved (value
+// i in 32-bit lane i % 4), so SSE2 unpacks four values per shift. Readers
+// can cull whole blocks on the box before decoding anything, and
+// decodeClip() clips a block straight from the unpacked lanes.
+// File: "SEGP", version, segment count, block count, payload size, payload
+// (little endian).
+static const int PACK_BLOCK = 128;
+static const char* const PACKED_PATH = "segments.segp";
+
+struct PackedBlockHeader {
+    Box      box;
+    int32_t  baseX, baseY;
+    uint16_t count;
+    uint8_t  width[4];        // ax, ay, dx, dy
+    uint16_t words;           // payload uint32 words after the header
+};
+
+inline uint32_t zigzag(int32_t d)   { return ((uint32_t)d << 1) ^ (uint32_t)(d >> 31); }
+inline int32_t  unzigzag(uint32_t z) { return (int32_t)((z >> 1) ^ (0u - (z & 1))); }
+
+inline int bitWidth(uint32_t v) { int w = 0; while (w < 32 && (v >> w)) ++w; return w; }
+
+// Lane words of one stream of n values at width w
+inline size_t streamWords(int n, int w) { return 4 * (((size_t)(n + 3) / 4 * w + 31) / 32); }
+
+inline uint64_t mortonKey(uint32_t x, uint32_t y)
+{
+    auto spread = [](uint64_t v) {
+        v &= 0xFFFFFFFFu;
+        v = (v | (v << 16)) & 0x0000FFFF0000FFFFull;
+        v = (v | (v << 8))  & 0x00FF00FF00FF00FFull;
+        v = (v | (v << 4))  & 0x0F0F0F0F0F0F0F0Full;
+        v = (v | (v << 2))  & 0x3333333333333333ull;
+        v = (v | (v << 1))  & 0x5555555555555555ull;
+        return v;
+    };
+    return spread(x) | (spread(y) << 1);
+}
+
+static_assert(sizeof(PackedBlockHeader) == 32, "block header is 8 words");
+
+struct PackedSegments
+{
+    std::vector<uint32_t> data;       // headers + payloads, plus 4 words of read padding
+    std::vector<size_t>   blockAt;    // word offset of each block header
+    uint64_t count = 0;
+
+    static const size_t HEADER_WORDS = 8;
+    static const size_t PAD_WORDS = 4;
+
+    void clear() { data.clear(); blockAt.clear(); count = 0; }
+    size_t blocks() const { return blockAt.size(); }
+    size_t bytes() const { return data.size() * 4 + blockAt.size() * sizeof(size_t); }
+    const PackedBlockHeader& header(size_t k) const { return *(const PackedBlockHeader*)&data[blockAt[k]]; }
+
+    // Sort a batch spatially and append it as blocks (the batch is reordered)
+    void append(std::vector<Seg>& batch)
+    {
+        if (batch.empty()) return;
+        if (!data.empty()) data.resize(data.size() - PAD_WORDS);
+        int64_t mx0 = INT64_MAX, my0 = INT64_MAX, mx1 = INT64_MIN, my1 = INT64_MIN;
+        for (const Seg& sg : batch) {
+            int64_t mx = (int64_t)sg.a.x + sg.b.x, my = (int64_t)sg.a.y + sg.b.y;
+            mx0 = std::min(mx0, mx); mx1 = std::max(mx1, mx);
+            my0 = std::min(my0, my); my1 = std::max(my1, my);
+        }
+        int shift = 0;
+        while (((std::max(mx1 - mx0, my1 - my0)) >> shift) > 0xFFFF) ++shift;
+        std::vector<std::pair<uint64_t, uint32_t> > order(batch.size());
+        for (size_t i = 0; i < batch.size(); ++i) {
+            const Seg& sg = batch[i];
+            order[i] = { mortonKey((uint32_t)((((int64_t)sg.a.x + sg.b.x) - mx0) >> shift),
+                                   (uint32_t)((((int64_t)sg.a.y + sg.b.y) - my0) >> shift)), (uint32_t)i };
+        }
+        std::sort(order.begin(), order.end());
+        std::vector<Seg> sorted(batch.size());
+        for (size_t i = 0; i < batch.size(); ++i) sorted[i] = batch[order[i].second];
+        batch.swap(sorted);
+
+        for (size_t b = 0; b < batch.size(); b += PACK_BLOCK)
+            appendBlock(&batch[b], (int)std::min<size_t>(PACK_BLOCK, batch.size() - b));
+        data.resize(data.size() + PAD_WORDS, 0);
+    }
+
+    void appendBlock(const Seg* sg, int n)
+    {
+        PackedBlockHeader h;
+        h.box = EMPTY_BOX;
+        h.baseX = INT32_MAX; h.baseY = INT32_MAX;
+        for (int i = 0; i < n; ++i) {
+            h.box = boxUnion(h.box, segBox(sg[i]));
+            h.baseX = std::min(h.baseX, sg[i].a.x);
+            h.baseY = std::min(h.baseY, sg[i].a.y);
+        }
+        uint32_t v[4][PACK_BLOCK + 3] = {};
+        uint32_t any[4] = {};
+        for (int i = 0; i < n; ++i) {
+            v[0][i] = (uint32_t)sg[i].a.x - (uint32_t)h.baseX;
+            v[1][i] = (uint32_t)sg[i].a.y - (uint32_t)h.baseY;
+            v[2][i] = zigzag((int32_t)((uint32_t)sg[i].b.x - (uint32_t)sg[i].a.x));
+            v[3][i] = zigzag((int32_t)((uint32_t)sg[i].b.y - (uint32_t)sg[i].a.y));
+            for (int c = 0; c < 4; ++c) any[c] |= v[c][i];
+        }
+        h.count = (uint16_t)n;
+        size_t words = 0;
+        for (int c = 0; c < 4; ++c) { h.width[c] = (uint8_t)bitWidth(any[c]); words += streamWords(n, h.width[c]); }
+        h.words = (uint16_t)words;
+
+        size_t at = data.size();
+        blockAt.push_back(at);
+        data.resize(at + HEADER_WORDS + words, 0);
+        std::memcpy(&data[at], &h, sizeof(h));
+        uint32_t* out = &data[at + HEADER_WORDS];
+        for (int c = 0; c < 4; ++c) {
+            int w = h.width[c];
+            for (int i = 0; i < n; ++i) {
+                size_t bit = (size_t)(i / 4) * w;            // position inside lane i % 4
+                uint32_t* lane = out + (i % 4);
+                lane[(bit / 32) * 4] |= v[c][i] << (bit % 32);
+                if (bit % 32 + w > 32) lane[(bit / 32 + 1) * 4] |= v[c][i] >> (32 - bit % 32);
+            }
+            out += streamWords(n, w);
+        }
+        count += (uint64_t)n;
+    }
+
+    // Unpack one stream of n values (rounded up to a multiple of 4) into dst
+    static const uint32_t* unpack(const uint32_t* in, int n, int w, uint32_t* dst)
+    {
+        int groups = (n + 3) / 4;
+        if (w == 0) { std::fill(dst, dst + groups * 4, 0u); return in; }
+#ifdef HAVE_SSE2
+        const __m128i mask = _mm_set1_epi32(w == 32 ? -1 : (int)((1u << w) - 1));
+        const uint32_t* p = in;
+        __m128i cur = _mm_loadu_si128((const __m128i*)p);
+        int off = 0;
+        for (int g = 0; g < groups; ++g) {
+            __m128i val = _mm_srl_epi32(cur, _mm_cvtsi32_si128(off));
+            if (off + w >= 32) {
+                p += 4;
+                __m128i next = _mm_loadu_si128((const __m128i*)p);   // padding keeps this in bounds
+                if (off + w > 32) val = _mm_or_si128(val, _mm_sll_epi32(next, _mm_cvtsi32_si128(32 - off)));
+                cur = next;
+                off = off + w - 32;
+            } else {
+                off += w;
+            }
+            _mm_storeu_si128((__m128i*)(dst + 4 * g), _mm_and_si128(val, mask));
+        }
+#else
+        for (int i = 0; i < groups * 4; ++i) {
+            size_t bit = (size_t)(i / 4) * w;
+            const uint32_t* lane = in + (i % 4);
+            uint64_t word = lane[(bit / 32) * 4] | ((uint64_t)lane[(bit / 32 + 1) * 4] << 32);
+            dst[i] = (uint32_t)(word >> (bit % 32)) & (w == 32 ? 0xFFFFFFFFu : ((1u << w) - 1));
+        }
+#endif
+        return in + streamWords(n, w);
+    }
+
+    // Decode block k into out[0, count); returns count
+    int decode(size_t k, Seg* out) const
+    {
+        const PackedBlockHeader& h = header(k);
+        alignas(16) uint32_t v[4][PACK_BLOCK];
+        const uint32_t* in = &data[blockAt[k] + HEADER_WORDS];
+        for (int c = 0; c < 4; ++c) in = unpack(in, h.count, h.width[c], v[c]);
+        int i = 0;
+#ifdef HAVE_SSE2
+        const __m128i bx = _mm_set1_epi32(h.baseX), by = _mm_set1_epi32(h.baseY), one = _mm_set1_epi32(1);
+        for (; i + 4 <= h.count; i += 4) {
+            __m128i ax = _mm_add_epi32(_mm_load_si128((const __m128i*)&v[0][i]), bx);
+            __m128i ay = _mm_add_epi32(_mm_load_si128((const __m128i*)&v[1][i]), by);
+            __m128i zx = _mm_load_si128((const __m128i*)&v[2][i]), zy = _mm_load_si128((const __m128i*)&v[3][i]);
+            __m128i dx = _mm_xor_si128(_mm_srli_epi32(zx, 1), _mm_sub_epi32(_mm_setzero_si128(), _mm_and_si128(zx, one)));
+            __m128i dy = _mm_xor_si128(_mm_srli_epi32(zy, 1), _mm_sub_epi32(_mm_setzero_si128(), _mm_and_si128(zy, one)));
+            __m128i ex = _mm_add_epi32(ax, dx), ey = _mm_add_epi32(ay, dy);
+            // SoA -> Seg {a.x, a.y, b.x, b.y}: a 4x4 transpose
+            __m128i t0 = _mm_unpacklo_epi32(ax, ay), t1 = _mm_unpackhi_epi32(ax, ay);
+            __m128i t2 = _mm_unpacklo_epi32(ex, ey), t3 = _mm_unpackhi_epi32(ex, ey);
+            _mm_storeu_si128((__m128i*)&out[i],     _mm_unpacklo_epi64(t0, t2));
+            _mm_storeu_si128((__m128i*)&out[i + 1], _mm_unpackhi_epi64(t0, t2));
+            _mm_storeu_si128((__m128i*)&out[i + 2], _mm_unpacklo_epi64(t1, t3));
+            _mm_storeu_si128((__m128i*)&out[i + 3], _mm_unpackhi_epi64(t1, t3));
+        }
+#endif
+        for (; i < h.count; ++i) {
+            out[i].a.x = (int32_t)(v[0][i] + (uint32_t)h.baseX);
+            out[i].a.y = (int32_t)(v[1][i] + (uint32_t)h.baseY);
+            out[i].b.x = (int32_t)((uint32_t)out[i].a.x + (uint32_t)unzigzag(v[2][i]));
+            out[i].b.y = (int32_t)((uint32_t)out[i].a.y + (uint32_t)unzigzag(v[3][i]));
+        }
+        return h.count;
+    }
+
+    // Decode block k and clip it against w straight from the unpacked
+    // lanes: the outcode tests run four segments per SSE2 register and fully
+    // visible groups are stored as floats with one transpose, so nothing
+    // goes through a Seg. Appends exactly what clipBatchWith(CK_OUTCODE)
+    // would for the decoded block.
+    void decodeClip(size_t k, const Box& w, std::vector<float>& out) const
+    {
+#ifdef HAVE_SSE2
+        const PackedBlockHeader& h = header(k);
+        alignas(16) uint32_t v[4][PACK_BLOCK];
+        const uint32_t* in = &data[blockAt[k] + HEADER_WORDS];
+        for (int c = 0; c < 4; ++c) in = unpack(in, h.count, h.width[c], v[c]);
+        const __m128i bx = _mm_set1_epi32(h.baseX), by = _mm_set1_epi32(h.baseY), one = _mm_set1_epi32(1);
+        const __m128i X0 = _mm_set1_epi32(w.x0), Y0 = _mm_set1_epi32(w.y0), X1 = _mm_set1_epi32(w.x1), Y1 = _mm_set1_epi32(w.y1);
+        for (int i = 0; i < h.count; i += 4) {
+            __m128i ax = _mm_add_epi32(_mm_load_si128((const __m128i*)&v[0][i]), bx);
+            __m128i ay = _mm_add_epi32(_mm_load_si128((const __m128i*)&v[1][i]), by);
+            __m128i zx = _mm_load_si128((const __m128i*)&v[2][i]), zy = _mm_load_si128((const __m128i*)&v[3][i]);
+            __m128i ex = _mm_add_epi32(ax, _mm_xor_si128(_mm_srli_epi32(zx, 1), _mm_sub_epi32(_mm_setzero_si128(), _mm_and_si128(zx, one))));
+            __m128i ey = _mm_add_epi32(ay, _mm_xor_si128(_mm_srli_epi32(zy, 1), _mm_sub_epi32(_mm_setzero_si128(), _mm_and_si128(zy, one))));
+            __m128i lx0 = _mm_cmplt_epi32(ax, X0), lx1 = _mm_cmplt_epi32(ex, X0);
+            __m128i gx0 = _mm_cmpgt_epi32(ax, X1), gx1 = _mm_cmpgt_epi32(ex, X1);
+            __m128i ly0 = _mm_cmplt_epi32(ay, Y0), ly1 = _mm_cmplt_epi32(ey, Y0);
+            __m128i gy0 = _mm_cmpgt_epi32(ay, Y1), gy1 = _mm_cmpgt_epi32(ey, Y1);
+            __m128i rej = _mm_or_si128(_mm_or_si128(_mm_and_si128(lx0, lx1), _mm_and_si128(gx0, gx1)),
+                                       _mm_or_si128(_mm_and_si128(ly0, ly1), _mm_and_si128(gy0, gy1)));
+            __m128i outside = _mm_or_si128(_mm_or_si128(_mm_or_si128(lx0, lx1), _mm_or_si128(gx0, gx1)),
+                                           _mm_or_si128(_mm_or_si128(ly0, ly1), _mm_or_si128(gy0, gy1)));
+            int live = h.count - i >= 4 ? 15 : (1 << (h.count - i)) - 1;
+            int keep = ~_mm_movemask_ps(_mm_castsi128_ps(rej)) & live;
+            if (!keep) continue;
+            int inside = ~_mm_movemask_ps(_mm_castsi128_ps(outside)) & live;
+            __m128 fax = _mm_cvtepi32_ps(ax), fay = _mm_cvtepi32_ps(ay), fex = _mm_cvtepi32_ps(ex), fey = _mm_cvtepi32_ps(ey);
+            if (inside == 15) {
+                // SoA -> x0,y0,x1,y1 per segment: a 4x4 transpose
+                _MM_TRANSPOSE4_PS(fax, fay, fex, fey);
+                size_t at = out.size();
+                out.resize(at + 16);
+                _mm_storeu_ps(&out[at], fax);
+                _mm_storeu_ps(&out[at + 4], fay);
+                _mm_storeu_ps(&out[at + 8], fex);
+                _mm_storeu_ps(&out[at + 12], fey);
+                continue;
+            }
+            alignas(16) float f[4][4];
+            _mm_store_ps(f[0], fax); _mm_store_ps(f[1], fay); _mm_store_ps(f[2], fex); _mm_store_ps(f[3], fey);
+            for (int l = 0; l < 4; ++l) {
+                if (!((keep >> l) & 1)) continue;
+                if ((inside >> l) & 1) {
+                    out.push_back(f[0][l]); out.push_back(f[1][l]); out.push_back(f[2][l]); out.push_back(f[3][l]);
+                    continue;
+                }
+                float cx0, cy0, cx1, cy1;
+                if (liangBarskyClip(w.x0, w.y0, w.x1, w.y1, f[0][l], f[1][l], f[2][l], f[3][l], cx0, cy0, cx1, cy1)) {
+                    out.push_back(cx0); out.push_back(cy0); out.push_back(cx1); out.push_back(cy1);
+                }
+            }
+        }
+#else
+        Seg buf[PACK_BLOCK];
+        clipBatchWith(CK_OUTCODE, buf, (size_t)decode(k, buf), w, out);
+#endif
+    }
+
+    // Rebuild blockAt from data (after loading)
+    bool index()
+    {
+        blockAt.clear();
+        uint64_t n = 0;
+        size_t at = 0, end = data.size() - PAD_WORDS;
+        while (at < end) {
+            if (at + HEADER_WORDS > end) return false;
+            const PackedBlockHeader& h = *(const PackedBlockHeader*)&data[at];
+            // decode() unpacks into fixed PACK_BLOCK arrays and masks with
+            // 1u << width, so a block must fit both before it is trusted
+            if (h.count < 1 || h.count > PACK_BLOCK) return false;
+            size_t words = 0;
+            for (int c = 0; c < 4; ++c) {
+                if (h.width[c] > 32) return false;
+                words += streamWords(h.count, h.width[c]);
+            }
+            if (h.words != words || at + HEADER_WORDS + words > end) return false;
+            blockAt.push_back(at);
+            n += h.count;
+            at += HEADER_WORDS + words;
+        }
+        return at == end && n == count;
+    }
+
+    bool save(const char* path) const
+    {
+        FILE* f = std::fopen(path, "wb");
+        if (!f) return false;
+        uint64_t payload = data.empty() ? 0 : (data.size() - PAD_WORDS) * 4;
+        uint64_t head[4] = { 0x0000000150474553ull /* "SEGP", version 1 */, count, (uint64_t)blocks(), payload };
+        bool ok = std::fwrite(head, sizeof(head), 1, f) == 1 &&
+                  (payload == 0 || std::fwrite(data.data(), 1, (size_t)payload, f) == payload);
+        return std::fclose(f) == 0 && ok;
+    }
+
+    bool load(const char* path)
+    {
+        clear();
+        FILE* f = std::fopen(path, "rb");
+        if (!f) return false;
+        uint64_t head[4];
+        bool ok = std::fread(head, sizeof(head), 1, f) == 1 && head[0] == 0x0000000150474553ull && head[3] % 4 == 0;
+        if (ok) {
+            // The payload size must match what is actually on disk before
+            // it is used to size the buffer
+            long at = std::ftell(f);
+            ok = at >= 0 && std::fseek(f, 0, SEEK_END) == 0;
+            long size = ok ? std::ftell(f) : -1;
+            ok = ok && size >= at && (uint64_t)(size - at) == head[3] && std::fseek(f, at, SEEK_SET) == 0;
+        }
+        if (ok) {
+            count = head[1];
+            data.assign((size_t)(head[3] / 4) + PAD_WORDS, 0);
+            ok = head[3] == 0 || std::fread(data.data(), 1, (size_t)head[3], f) == head[3];
+        }
+        std::fclose(f);
+        if (!ok || !index() || blocks() != head[2]) { clear(); return false; }
+        return true;
+    }
+};
+
+// --------------- Affine transform stage ---------------
+// A 2x3 matrix applied to the whole segment set on the way to the clipper.
+// Coordinates are mirrored by slot into SoA float arrays (dead slots hold
+// a far-off point that always clips away); the fused kernel transforms four
+// segments per SSE register and clips them with a vectorized Liang-Barsky
+// without writing transformed coordinates back, so only visible parts leave
+// the registers. Baking a transform into the store rounds it to pixels.
+struct Affine
+{
+    float a = 1, b = 0, tx = 0;   // x' = a*x + b*y + tx
+    float c = 0, d = 1, ty = 0;   // y' = c*x + d*y + ty
+
+    // Rotate by angle (radians) and scale about (cx, cy)
+    static Affine about(float cx, float cy, float angle, float scale)
+    {
+        Affine m;
+        float cs = std::cos(angle) * scale, sn = std::sin(angle) * scale;
+        m.a = cs; m.b = -sn; m.tx = cx - cs * cx + sn * cy;
+        m.c = sn; m.d = cs;  m.ty = cy - sn * cx - cs * cy;
+        return m;
+    }
+    float applyX(float x, float y) const { return a * x + b * y + tx; }
+    float applyY(float x, float y) const { return c * x + d * y + ty; }
+};
+
+static const float SOA_DEAD = -1e30f;   // coordinate of freed slots
+
+struct SegmentSoA
+{
+    std::vector<float> x0, y0, x1, y1;   // by slot
+    uint32_t epoch = ~0u;
+
+    void set(uint32_t i, const SegmentStore& st)
+    {
+        if (st.alive[i]) {
+            const Seg& s = st.seg[i];
+            x0[i] = (float)s.a.x; y0[i] = (float)s.a.y;
+            x1[i] = (float)s.b.x; y1[i] = (float)s.b.y;
+        } else {
+            x0[i] = y0[i] = x1[i] = y1[i] = SOA_DEAD;
+        }
+    }
+
+    // Same change list as the BVH: call before the store's touched is reset
+    void sync(const SegmentStore& st)
+    {
+        size_t n = st.seg.size();
+        if (epoch != st.epoch) {
+            epoch = st.epoch;
+            x0.clear(); y0.clear(); x1.clear(); y1.clear();
+        }
+        size_t old = x0.size();
+        x0.resize(n, SOA_DEAD); y0.resize(n, SOA_DEAD); x1.resize(n, SOA_DEAD); y1.resize(n, SOA_DEAD);
+        for (size_t i = old; i < n; ++i) set((uint32_t)i, st);
+        for (uint32_t i : st.touched) if (i < n) set(i, st);
+    }
+
+    size_t size() const { return x0.size(); }
+};
+
+// Transform + clip segments [begin, end); visible parts are appended to out
+// as x0,y0,x1,y1. Per lane this is exactly liangBarskyClip() on the
+// transformed floats.
+void transformClipRange(const SegmentSoA& soa, size_t begin, size_t end, const Affine& m,
+                        const Box& w, std::vector<float>& out)
+{
+    size_t i = begin;
+#ifdef HAVE_SSE2
+    const __m128 ma = _mm_set1_ps(m.a), mb = _mm_set1_ps(m.b), mtx = _mm_set1_ps(m.tx);
+    const __m128 mc = _mm_set1_ps(m.c), md = _mm_set1_ps(m.d), mty = _mm_set1_ps(m.ty);
+    const __m128 xmin = _mm_set1_ps((float)w.x0), xmax = _mm_set1_ps((float)w.x1);
+    const __m128 ymin = _mm_set1_ps((float)w.y0), ymax = _mm_set1_ps((float)w.y1);
+    const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f), eps = _mm_set1_ps(1e-9f);
+    const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+    alignas(16) float r[4][4];
+    for (; i + 4 <= end; i += 4) {
+        __m128 ax = _mm_loadu_ps(&soa.x0[i]), ay = _mm_loadu_ps(&soa.y0[i]);
+        __m128 bx = _mm_loadu_ps(&soa.x1[i]), by = _mm_loadu_ps(&soa.y1[i]);
+        __m128 X0 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ma, ax), _mm_mul_ps(mb, ay)), mtx);
+        __m128 Y0 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(mc, ax), _mm_mul_ps(md, ay)), mty);
+        __m128 X1 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ma, bx), _mm_mul_ps(mb, by)), mtx);
+        __m128 Y1 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(mc, bx), _mm_mul_ps(md, by)), mty);
+        __m128 dx = _mm_sub_ps(X1, X0), dy = _mm_sub_ps(Y1, Y0);
+        __m128 p[4] = { _mm_sub_ps(zero, dx), dx, _mm_sub_ps(zero, dy), dy };
+        __m128 q[4] = { _mm_sub_ps(X0, xmin), _mm_sub_ps(xmax, X0), _mm_sub_ps(Y0, ymin), _mm_sub_ps(ymax, Y0) };
+        __m128 u1 = zero, u2 = one, ok = _mm_cmpeq_ps(zero, zero);
+        for (int e = 0; e < 4; ++e) {
+            __m128 par = _mm_cmplt_ps(_mm_and_ps(p[e], absMask), eps);
+            ok = _mm_andnot_ps(_mm_and_ps(par, _mm_cmplt_ps(q[e], zero)), ok);
+            __m128 t = _mm_div_ps(q[e], p[e]);
+            __m128 enter = _mm_andnot_ps(par, _mm_cmplt_ps(p[e], zero));
+            __m128 leave = _mm_andnot_ps(par, _mm_cmpgt_ps(p[e], zero));
+            u1 = _mm_or_ps(_mm_and_ps(enter, _mm_max_ps(u1, t)), _mm_andnot_ps(enter, u1));
+            u2 = _mm_or_ps(_mm_and_ps(leave, _mm_min_ps(u2, t)), _mm_andnot_ps(leave, u2));
+        }
+        int mask = _mm_movemask_ps(_mm_and_ps(ok, _mm_cmple_ps(u1, u2)));
+        if (!mask) continue;
+        _mm_store_ps(r[0], _mm_add_ps(X0, _mm_mul_ps(u1, dx)));
+        _mm_store_ps(r[1], _mm_add_ps(Y0, _mm_mul_ps(u1, dy)));
+        _mm_store_ps(r[2], _mm_add_ps(X0, _mm_mul_ps(u2, dx)));
+        _mm_store_ps(r[3], _mm_add_ps(Y0, _mm_mul_ps(u2, dy)));
+        for (int l = 0; l < 4; ++l)
+            if (mask & (1 << l)) {
+                out.push_back(r[0][l]); out.push_back(r[1][l]);
+                out.push_back(r[2][l]); out.push_back(r[3][l]);
+            }
+    }
+#endif
+    for (; i < end; ++i) {
+        float cx0, cy0, cx1, cy1;
+        if (liangBarskyClip(w.x0, w.y0, w.x1, w.y1,
+                            m.applyX(soa.x0[i], soa.y0[i]), m.applyY(soa.x0[i], soa.y0[i]),
+                            m.applyX(soa.x1[i], soa.y1[i]), m.applyY(soa.x1[i], soa.y1[i]),
+                            cx0, cy0, cx1, cy1)) {
+            out.push_back(cx0); out.push_back(cy0); out.push_back(cx1); out.push_back(cy1);
+        }
+    }
+}
+
+// Whole set, split over threads for large scenes; out[t] holds thread t's part
+int transformClip(const SegmentSoA& soa, const Affine& m, const Box& w, std::vector<std::vector<float> >& out)
+{
+    const size_t PER_THREAD = 1 << 16;
+    size_t n = soa.size();
+    int threads = (int)std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()),
+                                        std::max<size_t>(1, n / PER_THREAD));
+    out.resize(threads);
+    size_t chunk = (n / threads + 3) & ~(size_t)3;
+    std::vector<std::thread> pool;
+    for (int t = 0; t < threads; ++t) {
+        size_t b = std::min(n, t * chunk), e = (t == threads - 1) ? n : std::min(n, b + chunk);
+        out[t].clear();
+        if (t == threads - 1) transformClipRange(soa, b, e, m, w, out[t]);
+        else pool.emplace_back([&soa, &m, &w, &out, t, b, e] { transformClipRange(soa, b, e, m, w, out[t]); });
+    }
+    for (auto& th : pool) th.join();
+    return threads;
+}
+
+// Apply m to the stored segments (rounded to the nearest pixel) as one batch
+void bakeTransform(SegmentStore& st, const SegmentSoA& soa, const Affine& m)
+{
+    std::vector<std::pair<SegHandle, Seg> > edits;
+    edits.reserve(st.size());
+    st.forEach([&](uint32_t i, const Seg&) {
+        Seg s;
+        s.a.x = (int)std::lround(m.applyX(soa.x0[i], soa.y0[i]));
+        s.a.y = (int)std::lround(m.applyY(soa.x0[i], soa.y0[i]));
+        s.b.x = (int)std::lround(m.applyX(soa.x1[i], soa.y1[i]));
+        s.b.y = (int)std::lround(m.applyY(soa.x1[i], soa.y1[i]));
+        edits.push_back({ st.handleOf(i), s });
+    });
+    st.updateBatch(edits);
+}
+
+// --------------- Kinetic clip-window scrubbing ---------------
+// For a window sliding along one axis by an integer offset t, each
+// segment's status (out / straddling / inside) is piecewise constant in t
+// with at most four breakpoints. They are found exactly from the part of
+// the segment inside the window's fixed slab (the perpendicular extent).
+// All breakpoints form one sorted event list; moving the window replays only
+// the events between the old and the new offset, keeping the visible set
+// (a dense list with swap-removal) up to date.
+inline int64_t floorDiv64(int64_t a, int64_t b) { int64_t q = a / b; return (q * b > a) ? q - 1 : q; }
+inline int64_t ceilDiv64(int64_t a, int64_t b)  { return -floorDiv64(-a, b); }
+
+struct KineticClip
+{
+    enum { OUT = 0, PARTIAL = 1, INSIDE = 2 };
+    struct Event { int t; uint32_t slot; uint8_t before, after; };
+
+    bool alongX = true;
+    Box  base = EMPTY_BOX;             // window at offset 0
+    int  offset = 0;
+    bool stale = true;                 // store edited since the build
+    std::vector<Event>    events;      // sorted by t; [0, cursor) are applied
+    size_t                cursor = 0;
+    std::vector<uint8_t>  status;      // by slot
+    std::vector<uint32_t> visible;     // slots not OUT
+    std::vector<uint32_t> visPos;      // slot -> index in visible
+    size_t inside = 0, crossed = 0, rebuilds = 0;
+
+    void setStatus(uint32_t i, uint8_t s)
+    {
+        uint8_t old = status[i];
+        if (old == s) return;
+        inside += (s == INSIDE) - (old == INSIDE);
+        if (old == OUT) { visPos[i] = (uint32_t)visible.size(); visible.push_back(i); }
+        else if (s == OUT) {
+            uint32_t last = visible.back();
+            visible[visPos[i]] = last; visPos[last] = visPos[i];
+            visible.pop_back();
+        }
+        status[i] = s;
+    }
+
+    void build(const SegmentStore& st, const Box& w, bool x)
+    {
+        alongX = x; base = w; offset = 0; stale = false;
+        events.clear(); visible.clear(); inside = 0;
+        status.assign(st.seg.size(), OUT);
+        visPos.assign(st.seg.size(), 0);
+        // axis-local window: u slides, v is fixed
+        const int64_t u0 = x ? w.x0 : w.y0, u1 = x ? w.x1 : w.y1;
+        const int64_t v0 = x ? w.y0 : w.x0, v1 = x ? w.y1 : w.x1;
+        st.forEach([&](uint32_t i, const Seg& s) {
+            int64_t au = x ? s.a.x : s.a.y, av = x ? s.a.y : s.a.x;
+            int64_t bu = x ? s.b.x : s.b.y, bv = x ? s.b.y : s.b.x;
+            if (std::max(av, bv) < v0 || std::min(av, bv) > v1) return; // never visible
+            // u-extent of the part inside the slab, rounded inward to integers
+            int64_t uLo, uHi;
+            if (av == bv) { uLo = std::min(au, bu); uHi = std::max(au, bu); }
+            else {
+                if (av > bv) { std::swap(au, bu); std::swap(av, bv); }
+                int64_t dv = bv - av, du = bu - au;
+                int64_t va = std::max(av, v0), vb = std::min(bv, v1);
+                // u(v) = au + (v - av) * du / dv
+                int64_t na = au * dv + (va - av) * du, nb = au * dv + (vb - av) * du;
+                uLo = ceilDiv64(std::min(na, nb), dv);
+                uHi = floorDiv64(std::max(na, nb), dv);
+            }
+            int64_t A = uLo - u1, B = uHi - u0;                 // visible for A <= t <= B
+            if (A > B) return;
+            int64_t bmin = std::min(au, bu), bmax = std::max(au, bu);
+            bool fitsV = std::min(av, bv) >= v0 && std::max(av, bv) <= v1;
+            int64_t I0 = bmax - u1, I1 = bmin - u0;              // inside for I0 <= t <= I1
+            if (!fitsV) { I0 = 1; I1 = 0; }
+            auto at = [&](int64_t t) -> uint8_t {
+                if (t < A || t > B) return OUT;
+                return (t >= I0 && t <= I1) ? INSIDE : PARTIAL;
+            };
+            int64_t cand[4] = { A, I0, I1 + 1, B + 1 };
+            for (int k = 0; k < 4; ++k) {
+                if (k > 0 && k < 3 && I0 > I1) continue;
+                uint8_t before = at(cand[k] - 1), after = at(cand[k]);
+                if (before != after) events.push_back({ (int)cand[k], i, before, after });
+            }
+            setStatus(i, at(0));
+        });
+        std::sort(events.begin(), events.end(), [](const Event& a, const Event& b) { return a.t < b.t; });
+        cursor = std::upper_bound(events.begin(), events.end(), 0,
+                                  [](int t, const Event& e) { return t < e.t; }) - events.begin();
+        ++rebuilds;
+    }
+
+    void moveTo(int t)
+    {
+        crossed = 0;
+        while (t > offset && cursor < events.size() && events[cursor].t <= t) {
+            setStatus(events[cursor].slot, events[cursor].after);
+            ++cursor; ++crossed;
+        }
+        while (t < offset && cursor > 0 && events[cursor - 1].t > t) {
+            --cursor; ++crossed;
+            setStatus(events[cursor].slot, events[cursor].before);
+        }
+        offset = t;
+    }
+
+    // Follow window w: a pure slide along the axis replays events, anything
+    // else (resize, other axis, edited segments) rebuilds
+    void update(const SegmentStore& st, const Box& w, bool x)
+    {
+        int t = x ? w.x0 - base.x0 : w.y0 - base.y0;
+        Box moved = base;
+        if (x) { moved.x0 += t; moved.x1 += t; } else { moved.y0 += t; moved.y1 += t; }
+        if (stale || x != alongX || !boxEqual(moved, w)) { build(st, w, x); crossed = 0; return; }
+        moveTo(t);
+    }
+};
+
+// Rasterize the scene inside world rect r (already cleared) into px, where
+// world (x,y) lands at px[(y - oy) * stride + (x - ox)]
+void rasterSceneRect(const SegmentStore& st, const SegmentBVH& index, const Box& clip,
+                     const Box& r, int ox, int oy, uint32_t* px, int stride,
+                     std::vector<uint32_t>& hits)
+{
+    hits.clear();
+    auto collect = [&](uint32_t i) { hits.push_back(i); };
+    index.query(st, r, collect, collect);
+
+    Box vis = { std::max(r.x0, clip.x0), std::max(r.y0, clip.y0),
+                std::min(r.x1, clip.x1), std::min(r.y1, clip.y1) };
+    Box rl  = { r.x0 - ox, r.y0 - oy, r.x1 - ox, r.y1 - oy };
+    Box vl  = { vis.x0 - ox, vis.y0 - oy, vis.x1 - ox, vis.y1 - oy };
+
+    // Segments entirely inside the pass rect go to the tuned whole-line
+    // kernels as one batch; the rest are walked only where they cross it
+    static std::vector<Seg> whole;
+    long long plotted = 0;
+    for (int pass = 0; pass < 2; ++pass) {
+        if (pass == 1 && (vis.x0 > vis.x1 || vis.y0 > vis.y1)) break;
+        const Box& lr = pass ? vl : rl;
+        uint32_t color = pass ? CANVAS_CYAN : CANVAS_GRAY;
+        whole.clear();
+        for (uint32_t i : hits) {
+            Seg s = st.seg[i];
+            s.a.x -= ox; s.b.x -= ox; s.a.y -= oy; s.b.y -= oy;
+            Box b = segBox(s);
+            if (boxInside(b, lr)) { whole.push_back(s); plotted += std::max(b.x1 - b.x0, b.y1 - b.y0) + 1; }
+            else plotted += rasterSegmentInRect(s, lr, color, px, stride);
+        }
+        tuner.rasterBatch(whole.data(), whole.size(), color, px, stride);
+    }
+    metricAdd(M_PIXELS_PLOTTED, (uint64_t)plotted);
+}
+
+struct Canvas
+{
+    enum { TILE = 64 };
+
+    int w = 0, h = 0, tilesX = 0, tilesY = 0;
+    std::vector<std::vector<uint32_t> > level;   // level[0] = full resolution
+    std::vector<int> levelW, levelH;
+    std::vector<uint8_t> dirty;                  // per level-0 tile
+    size_t dirtyCount = 0;
+    size_t tilesRedrawn = 0;                     // by the last redraw()
+
+    // w and h are rounded up to whole tiles
+    void resize(int cw, int chh)
+    {
+        tilesX = (cw + TILE - 1) / TILE; tilesY = (chh + TILE - 1) / TILE;
+        w = tilesX * TILE; h = tilesY * TILE;
+        level.clear(); levelW.clear(); levelH.clear();
+        int lw = w, lh = h;
+        for (;;) {
+            level.push_back(std::vector<uint32_t>((size_t)lw * lh, CANVAS_BG));
+            levelW.push_back(lw); levelH.push_back(lh);
+            if (lw == 1 && lh == 1) break;
+            lw = std::max(1, (lw + 1) / 2); lh = std::max(1, (lh + 1) / 2);
+        }
+        dirty.assign((size_t)tilesX * tilesY, 0);
+        dirtyCount = 0;
+        markDirty({ 0, 0, w - 1, h - 1 });
+    }
+
+    void markDirty(const Box& b)
+    {
+        if (b.x0 > b.x1 || w == 0) return;
+        int tx0 = clampi(b.x0 / TILE, 0, tilesX - 1), tx1 = clampi(b.x1 / TILE, 0, tilesX - 1);
+        int ty0 = clampi(b.y0 / TILE, 0, tilesY - 1), ty1 = clampi(b.y1 / TILE, 0, tilesY - 1);
+        if (b.x1 < 0 || b.y1 < 0 || b.x0 >= w || b.y0 >= h) return;
+        for (int ty = ty0; ty <= ty1; ++ty)
+            for (int tx = tx0; tx <= tx1; ++tx) {
+                uint8_t& d = dirty[(size_t)ty * tilesX + tx];
+                if (!d) { d = 1; ++dirtyCount; }
+            }
+    }
+
+    // Re-rasterize dirty tiles, then refresh the pyramid above them
+    void redraw(const SegmentStore& st, const SegmentBVH& index, const Box& clip)
+    {
+        tilesRedrawn = 0;
+        if (dirtyCount == 0) { metricAdd(M_TILE_HITS, (uint64_t)tilesX * tilesY); return; }
+        std::vector<uint32_t> hits;
+        uint32_t* px = level[0].data();
+        for (int ty = 0; ty < tilesY; ++ty)
+            for (int tx = 0; tx < tilesX; ++tx) {
+                if (!dirty[(size_t)ty * tilesX + tx]) continue;
+                Box tile = { tx * TILE, ty * TILE, tx * TILE + TILE - 1, ty * TILE + TILE - 1 };
+                for (int y = tile.y0; y <= tile.y1; ++y)
+                    std::fill(px + (size_t)y * w + tile.x0, px + (size_t)y * w + tile.x1 + 1, CANVAS_BG);
+
+                rasterSceneRect(st, index, clip, tile, 0, 0, px, w, hits);
+
+                reduceTile(tx, ty);
+                ++tilesRedrawn;
+            }
+        metricAdd(M_TILE_MISSES, (uint64_t)tilesRedrawn);
+        metricAdd(M_TILE_HITS, (uint64_t)tilesX * tilesY - tilesRedrawn);
+        std::fill(dirty.begin(), dirty.end(), 0);
+        dirtyCount = 0;
+    }
+
+    // Propagate one level-0 tile up the pyramid
+    void reduceTile(int tx, int ty)
+    {
+        int x0 = tx * TILE, y0 = ty * TILE, x1 = x0 + TILE, y1 = y0 + TILE; // half-open
+        for (size_t k = 1; k < level.size(); ++k) {
+            x0 >>= 1; y0 >>= 1; x1 = (x1 + 1) >> 1; y1 = (y1 + 1) >> 1;
+            int sw = levelW[k - 1], shh = levelH[k - 1], dw = levelW[k];
+            x1 = std::min(x1, dw); y1 = std::min(y1, levelH[k]);
+            const uint32_t* src = level[k - 1].data();
+            uint32_t* dst = level[k].data();
+            for (int y = y0; y < y1; ++y) {
+                const uint32_t* r0 = src + (size_t)std::min(2 * y, shh - 1) * sw;
+                const uint32_t* r1 = src + (size_t)std::min(2 * y + 1, shh - 1) * sw;
+                // odd widths: the last column has no right neighbour, reduce it by hand
+                int n = std::min(x1, sw / 2) - x0;
+                if (n > 0) reduceRow2x2(r0 + 2 * x0, r1 + 2 * x0, dst + (size_t)y * dw + x0, n);
+                for (int x = std::max(x0, sw / 2); x < x1; ++x) {
+                    uint32_t e[2] = { r0[sw - 1], r0[sw - 1] }, f[2] = { r1[sw - 1], r1[sw - 1] };
+                    reduceRow2x2(e, f, dst + (size_t)y * dw + x, 1);
+                }
+            }
+        }
+    }
+};
+
+// --------------- Shared-memory frame export ---------------
+// --export-shm NAME puts the pan view's pixels in a POSIX shared memory
+// object, so local consumers map it and read frames in place. Layout: a
+// one-page SharedFrameHeader, then width x height RGBA pixels (bottom row
+// first). The header's seq is a seqlock: the writer makes it odd before the
+// first change to a frame and even again when the frame is published, so a
+// reader that sees the same even seq before and after reading has a
+// consistent frame. dirty[] marks the tiles the last published frame changed.
+// The object only grows; a reader remaps when mapBytes exceeds its mapping.
+// --shm-view NAME is a consumer (see shmViewMain).
+static const uint32_t SHM_MAGIC       = 0x4246424Cu;   // "LBFB"
+static const uint32_t SHM_FORMAT_RGBA = 0x41424752u;   // "RGBA"
+static const uint32_t SHM_BOTTOM_UP   = 1;
+static const int      SHM_HEADER_BYTES = 4096;
+static const int      SHM_TILE = 64;
+
+struct SharedFrameHeader {
+    uint32_t magic, version, headerBytes, format;
+    uint32_t width, height, stride, flags;      // stride in pixels
+    uint32_t tile, tilesX, tilesY, reserved;
+    uint64_t mapBytes;                          // current size of the object
+    std::atomic<uint64_t> seq;                  // odd while a frame is being changed
+    uint64_t frame;                             // published frame counter
+    uint64_t publishNs;                         // steady clock at publication
+    uint8_t  dirty[1];                          // tilesX * tilesY bits, row-major
+
+    static size_t dirtyCapacity() { return (SHM_HEADER_BYTES - offsetof(SharedFrameHeader, dirty)) * 8; }
+};
+
+inline uint64_t steadyNs()
+{
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct SharedFrame
+{
+    std::string name;
+    int fd = -1;
+    void* base = nullptr;
+    size_t mapped = 0;
+    SharedFrameHeader* hdr = nullptr;
+    std::vector<uint8_t> pending;   // tiles changed since the last publish
+    bool writing = false;
+
+    bool active() const { return hdr != nullptr; }
+    uint32_t* pixels() const { return (uint32_t*)((char*)base + SHM_HEADER_BYTES); }
+
+    bool open(const char* shmName)
+    {
+#ifndef _WIN32
+        name = shmName[0] == '/' ? shmName : std::string("/") + shmName;
+        fd = shm_open(name.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0600);
+        if (fd < 0) { std::perror(name.c_str()); return false; }
+        if (!map(SHM_HEADER_BYTES)) return false;
+        hdr->magic = SHM_MAGIC; hdr->version = 1;
+        hdr->headerBytes = SHM_HEADER_BYTES; hdr->format = SHM_FORMAT_RGBA;
+        hdr->flags = SHM_BOTTOM_UP; hdr->tile = SHM_TILE;
+        hdr->seq.store(0, std::memory_order_release);
+        return true;
+#else
+        (void)shmName;
+        std::fprintf(stderr, "--export-shm needs POSIX shared memory\n");
+        return false;
+#endif
+    }
+
+    // Grow the object to at least bytes and (re)map all of it
+    bool map(size_t bytes)
+    {
+#ifndef _WIN32
+        if (bytes <= mapped) return true;
+        if (ftruncate(fd, (off_t)bytes) != 0) { std::perror("ftruncate"); return false; }
+        if (base) munmap(base, mapped);
+        base = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (base == MAP_FAILED) { base = nullptr; hdr = nullptr; mapped = 0; std::perror("mmap"); return false; }
+        mapped = bytes;
+        hdr = (SharedFrameHeader*)base;
+        hdr->mapBytes = bytes;
+        return true;
+#else
+        (void)bytes;
+        return false;
+#endif
+    }
+
+    // Size the frame; returns the pixel buffer (null if the export failed)
+    uint32_t* resize(int w, int h)
+    {
+        int tx = (w + SHM_TILE - 1) / SHM_TILE, ty = (h + SHM_TILE - 1) / SHM_TILE;
+        if ((size_t)tx * ty > SharedFrameHeader::dirtyCapacity()) {
+            std::fprintf(stderr, "shared frame %dx%d has too many tiles\n", w, h);
+            return nullptr;
+        }
+        begin();
+        if (!map(SHM_HEADER_BYTES + (size_t)w * h * 4)) return nullptr;
+        hdr->width = (uint32_t)w; hdr->height = (uint32_t)h; hdr->stride = (uint32_t)w;
+        hdr->tilesX = (uint32_t)tx; hdr->tilesY = (uint32_t)ty;
+        pending.assign(((size_t)tx * ty + 7) / 8, 0xFF);
+        return pixels();
+    }
+
+    // Enter the write side of the seqlock (idempotent until publish)
+    void begin()
+    {
+        if (!hdr || writing) return;
+        hdr->seq.store(hdr->seq.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        writing = true;
+    }
+
+    // Frame-pixel rect about to change
+    void touch(int x0, int y0, int x1, int y1)
+    {
+        if (!hdr) return;
+        begin();
+        int tx0 = clampi(x0 / SHM_TILE, 0, (int)hdr->tilesX - 1), tx1 = clampi(x1 / SHM_TILE, 0, (int)hdr->tilesX - 1);
+        int ty0 = clampi(y0 / SHM_TILE, 0, (int)hdr->tilesY - 1), ty1 = clampi(y1 / SHM_TILE, 0, (int)hdr->tilesY - 1);
+        for (int ty = ty0; ty <= ty1; ++ty)
+            for (int tx = tx0; tx <= tx1; ++tx) {
+                size_t bit = (size_t)ty * hdr->tilesX + tx;
+                pending[bit / 8] |= (uint8_t)(1u << (bit % 8));
+            }
+    }
+
+    void touchAll() { if (hdr) { begin(); std::fill(pending.begin(), pending.end(), 0xFF); } }
+
+    // Publish the frame if anything changed since the last publish
+    void publish()
+    {
+        if (!hdr || !writing) return;
+        std::memcpy(hdr->dirty, pending.data(), pending.size());
+        std::fill(pending.begin(), pending.end(), 0);
+        hdr->frame++;
+        hdr->publishNs = steadyNs();
+        hdr->seq.store(hdr->seq.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        writing = false;
+    }
+
+    void close()
+    {
+#ifndef _WIN32
+        if (base) munmap(base, mapped);
+        if (fd >= 0) { ::close(fd); shm_unlink(name.c_str()); }
+#endif
+        base = nullptr; hdr = nullptr; mapped = 0; fd = -1;
+    }
+};
+
+static SharedFrame frameExport;
+
+// --------------- Dirty-tile frame streaming ---------------
+// --stream-sock PATH serves the pan view over a Unix domain socket. Each
+// tile carries the number of the frame that last changed it; a client is
+// sent the tiles newer than the frame it acknowledged. A client has at most
+// one delta in flight: frames published meanwhile are not queued, they fold
+// into the next delta (coalescing), so a slow client costs one frame of
+// buffering. The server side is non-blocking and runs on the render thread.
+// publish() copies the tiles it stamps into a snapshot and deltas are only
+// ever encoded from that, so pixels always match their frame number even
+// when a delta starts between frames, while the pan view is half redrawn.
+//
+// Server -> client: StreamFrameHeader, then per tile StreamTileHeader and
+// its encoded pixels (tile rows bottom-up, edge tiles clipped to the frame).
+// Client -> server: the uint64_t frame number it has applied.
+// Tile codec, byte tokens: top two bits pick LIT (n pixels follow), RUN (one
+// pixel, repeated) or UP (copy from the row below in the tile); low six bits
+// hold n - 1.
+static const uint32_t STREAM_MAGIC = 0x5354424Cu;   // "LBTS"
+static const int STREAM_TILE = 64;
+enum { TOKEN_LIT = 0, TOKEN_RUN = 1, TOKEN_UP = 2, TOKEN_MAX = 64 };
+
+struct StreamFrameHeader {
+    uint32_t magic, width, height, tile;
+    uint64_t frame, publishNs;
+    uint32_t tiles, payloadBytes;      // payload follows this header
+};
+struct StreamTileHeader { uint16_t tx, ty; uint32_t bytes; };
+
+// Encode a w x h tile (rows stride pixels apart); appends to out
+void encodeTile(const uint32_t* px, int stride, int w, int h, std::vector<uint8_t>& out)
+{
+    std::vector<uint32_t> lit;
+    auto flushLit = [&]() {
+        for (size_t k = 0; k < lit.size(); k += TOKEN_MAX) {
+            size_t n = std::min<size_t>(TOKEN_MAX, lit.size() - k);
+            out.push_back((uint8_t)((TOKEN_LIT << 6) | (n - 1)));
+            const uint8_t* b = (const uint8_t*)&lit[k];
+            out.insert(out.end(), b, b + n * 4);
+        }
+        lit.clear();
+    };
+    for (int y = 0; y < h; ++y) {
+        const uint32_t* row = px + (size_t)y * stride;
+        const uint32_t* below = y ? row - stride : nullptr;
+        for (int x = 0; x < w; ) {
+            int up = 0, run = 1;
+            if (below) while (x + up < w && up < TOKEN_MAX && row[x + up] == below[x + up]) ++up;
+            while (x + run < w && run < TOKEN_MAX && row[x + run] == row[x]) ++run;
+            if (up >= 2 && up >= run) {
+                flushLit();
+                out.push_back((uint8_t)((TOKEN_UP << 6) | (up - 1)));
+                x += up;
+            } else if (run >= 2) {
+                flushLit();
+                out.push_back((uint8_t)((TOKEN_RUN << 6) | (run - 1)));
+                const uint8_t* b = (const uint8_t*)&row[x];
+                out.insert(out.end(), b, b + 4);
+                x += run;
+            } else {
+                lit.push_back(row[x++]);
+            }
+        }
+        flushLit();     // tokens never span rows
+    }
+}
+
+// Decode into a w x h tile; false on malformed input
+bool decodeTile(const uint8_t* in, size_t bytes, uint32_t* px, int stride, int w, int h)
+{
+    const uint8_t* end = in + bytes;
+    for (int y = 0; y < h; ++y) {
+        uint32_t* row = px + (size_t)y * stride;
+        for (int x = 0; x < w; ) {
+            if (in >= end) return false;
+            int type = *in >> 6, n = (*in & 63) + 1;
+            ++in;
+            if (x + n > w) return false;
+            if (type == TOKEN_LIT) {
+                if (end - in < 4 * n) return false;
+                std::memcpy(row + x, in, (size_t)n * 4);
+                in += 4 * n;
+            } else if (type == TOKEN_RUN) {
+                if (end - in < 4) return false;
+                uint32_t c;
+                std::memcpy(&c, in, 4);
+                in += 4;
+                std::fill(row + x, row + x + n, c);
+            } else if (type == TOKEN_UP && y > 0) {
+                std::memcpy(row + x, row + x - stride, (size_t)n * 4);
+            } else {
+                return false;
+            }
+            x += n;
+        }
+    }
+    return in == end;
+}
+
+struct FrameStream
+{
+    struct Client {
+        int fd;
+        uint64_t acked = 0, inFlight = 0, lastSent = 0;
+        std::vector<uint8_t> out;
+        size_t sent = 0;
+        uint8_t ack[8] = {};
+        size_t ackHave = 0;
+    };
+
+    std::string path;
+    int listenFd = -1;
+    int w = 0, h = 0, tilesX = 0, tilesY = 0;
+    uint64_t frame = 0, publishNs = 0;
+    std::vector<uint64_t> version;      // per tile: frame that last changed it
+    std::vector<uint8_t>  pending;      // per tile: changed since the last publish
+    std::vector<uint32_t> snapshot;     // w x h: every tile as of its version
+    bool changed = false;
+    std::vector<Client> clients;
+
+    bool active() const { return listenFd >= 0; }
+
+    bool open(const char* sockPath)
+    {
+#ifndef _WIN32
+        sockaddr_un addr;
+        std::memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        if (std::strlen(sockPath) >= sizeof(addr.sun_path)) { std::fprintf(stderr, "socket path too long\n"); return false; }
+        std::strcpy(addr.sun_path, sockPath);
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0) { std::perror("socket"); return false; }
+        ::unlink(sockPath);
+        if (bind(fd, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, 8) != 0) {
+            std::perror(sockPath); ::close(fd); return false;
+        }
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        path = sockPath;
+        listenFd = fd;
+        return true;
+#else
+        (void)sockPath;
+        std::fprintf(stderr, "--stream-sock needs Unix domain sockets\n");
+        return false;
+#endif
+    }
+
+    void resize(int fw, int fh)
+    {
+        if (!active()) return;
+        w = fw; h = fh;
+        tilesX = (w + STREAM_TILE - 1) / STREAM_TILE; tilesY = (h + STREAM_TILE - 1) / STREAM_TILE;
+        version.assign((size_t)tilesX * tilesY, 0);
+        pending.assign(version.size(), 1);
+        snapshot.assign((size_t)w * h, 0);
+        changed = true;
+        for (Client& c : clients) c.acked = 0;     // everything is new to everyone
+    }
+
+    void touch(int x0, int y0, int x1, int y1)
+    {
+        if (!active() || version.empty()) return;
+        int tx0 = clampi(x0 / STREAM_TILE, 0, tilesX - 1), tx1 = clampi(x1 / STREAM_TILE, 0, tilesX - 1);
+        int ty0 = clampi(y0 / STREAM_TILE, 0, tilesY - 1), ty1 = clampi(y1 / STREAM_TILE, 0, tilesY - 1);
+        for (int ty = ty0; ty <= ty1; ++ty)
+            std::fill(&pending[(size_t)ty * tilesX + tx0], &pending[(size_t)ty * tilesX + tx1] + 1, 1);
+        changed = true;
+    }
+
+    void touchAll() { if (active()) { std::fill(pending.begin(), pending.end(), 1); changed = true; } }
+
+    // Stamp this frame's changes and snapshot those tiles, then serve clients
+    void publish(const uint32_t* px)
+    {
+        if (!active()) return;
+        if (changed) {
+            ++frame;
+            publishNs = steadyNs();
+            for (size_t t = 0; t < version.size(); ++t) {
+                if (!pending[t]) continue;
+                version[t] = frame;
+                pending[t] = 0;
+                int x0 = (int)(t % tilesX) * STREAM_TILE, y0 = (int)(t / tilesX) * STREAM_TILE;
+                int tw = std::min(STREAM_TILE, w - x0), th = std::min(STREAM_TILE, h - y0);
+                for (int y = y0; y < y0 + th; ++y)
+                    std::memcpy(&snapshot[(size_t)y * w + x0], px + (size_t)y * w + x0, (size_t)tw * 4);
+            }
+            changed = false;
+        }
+        pump();
+    }
+
+    // Accept, read acks, write pending bytes, start deltas for idle clients
+    // (from the snapshot, so this is safe between frames)
+    void pump()
+    {
+#ifndef _WIN32
+        if (!active()) return;
+        for (int fd; (fd = accept(listenFd, nullptr, nullptr)) >= 0; ) {
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+            Client c;
+            c.fd = fd;
+            clients.push_back(c);
+        }
+        for (size_t i = 0; i < clients.size(); ) {
+            Client& c = clients[i];
+            bool alive = true;
+            for (;;) {
+                ssize_t r = recv(c.fd, c.ack + c.ackHave, sizeof(c.ack) - c.ackHave, 0);
+                if (r == 0 || (r < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) { alive = false; break; }
+                if (r < 0) break;
+                c.ackHave += (size_t)r;
+                if (c.ackHave == sizeof(c.ack)) {
+                    uint64_t f;
+                    std::memcpy(&f, c.ack, 8);
+                    c.acked = std::max(c.acked, f);
+                    if (c.acked >= c.inFlight) c.inFlight = 0;
+                    c.ackHave = 0;
+                }
+            }
+            if (alive && c.sent == c.out.size() && !c.inFlight && c.acked < frame) {
+                c.out.clear(); c.sent = 0;
+                encodeDelta(c.acked, c.out);
+                if (c.lastSent) metricAdd(M_STREAM_FRAMES_COALESCED, frame - c.lastSent - 1);
+                c.inFlight = c.lastSent = frame;
+            }
+            while (alive && c.sent < c.out.size()) {
+                ssize_t r = send(c.fd, c.out.data() + c.sent, c.out.size() - c.sent, MSG_NOSIGNAL);
+                if (r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+                if (r < 0 && errno == EINTR) continue;
+                if (r <= 0) { alive = false; break; }
+                c.sent += (size_t)r;
+                metricAdd(M_STREAM_BYTES_SENT, (uint64_t)r);
+            }
+            if (!alive) { ::close(c.fd); clients.erase(clients.begin() + i); continue; }
+            ++i;
+        }
+#endif
+    }
+
+    // All tiles changed after frame since, as one message
+    void encodeDelta(uint64_t since, std::vector<uint8_t>& out)
+    {
+        const uint32_t* px = snapshot.data();
+        StreamFrameHeader fh = { STREAM_MAGIC, (uint32_t)w, (uint32_t)h, (uint32_t)STREAM_TILE, frame, publishNs, 0, 0 };
+        out.resize(sizeof(fh));
+        uint64_t raw = 0;
+        for (int ty = 0; ty < tilesY; ++ty)
+            for (int tx = 0; tx < tilesX; ++tx) {
+                if (version[(size_t)ty * tilesX + tx] <= since) continue;
+                int x0 = tx * STREAM_TILE, y0 = ty * STREAM_TILE;
+                int tw = std::min(STREAM_TILE, w - x0), th = std::min(STREAM_TILE, h - y0);
+                size_t at = out.size();
+                out.resize(at + sizeof(StreamTileHeader));
+                encodeTile(px + (size_t)y0 * w + x0, w, tw, th, out);
+                StreamTileHeader tile = { (uint16_t)tx, (uint16_t)ty, (uint32_t)(out.size() - at - sizeof(StreamTileHeader)) };
+                std::memcpy(&out[at], &tile, sizeof(tile));
+                ++fh.tiles;
+                raw += (uint64_t)tw * th * 4;
+            }
+        fh.payloadBytes = (uint32_t)(out.size() - sizeof(fh));
+        std::memcpy(out.data(), &fh, sizeof(fh));
+        metricAdd(M_STREAM_FRAMES_SENT);
+        metricAdd(M_STREAM_TILES_SENT, fh.tiles);
+        metricAdd(M_STREAM_RAW_BYTES, raw);
+    }
+
+    void close()
+    {
+#ifndef _WIN32
+        for (Client& c : clients) ::close(c.fd);
+        clients.clear();
+        if (listenFd >= 0) { ::close(listenFd); ::unlink(path.c_str()); }
+#endif
+        listenFd = -1;
+    }
+};
+
+static FrameStream frameStream;
+
+// --------------- Frame recorder ---------------
+// --record PATH writes every frame as video: Y4M, or raw I420 when PATH ends
+// in .yuv; "-" is stdout and "|cmd" pipes into cmd. The render thread only
+// copies the frame into a free slot of a fixed pool and queues it; a writer
+// thread converts RGBA to YUV 4:2:0 (SSE2) and does the I/O. With no free
+// slot the frame is dropped and counted, so rendering never waits on disk.
+// The size is fixed by the first frame (cropped to even); later frames are
+// cropped or padded to it.
+static const int RECORD_FPS = 60;
+
+// Full-range BT.601 (Y4M C420jpeg); chroma from the 2x2 average.
+// Top-down RGBA, w and h even.
+void rgbaToI420(const uint32_t* px, int w, int h, uint8_t* Y, uint8_t* U, uint8_t* V)
+{
+    for (int y = 0; y < h; y += 2) {
+        const uint32_t* r0 = px + (size_t)y * w;
+        const uint32_t* r1 = r0 + w;
+        uint8_t* y0 = Y + (size_t)y * w;
+        uint8_t* y1 = y0 + w;
+        uint8_t* u = U + (size_t)(y / 2) * (w / 2);
+        uint8_t* v = V + (size_t)(y / 2) * (w / 2);
+        int x = 0;
+#ifdef HAVE_SSE2
+        const __m128i m8 = _mm_set1_epi32(0xFF), ones = _mm_set1_epi16(1);
+        const __m128i kR = _mm_set1_epi16(77), kG = _mm_set1_epi16(150), kB = _mm_set1_epi16(29), half = _mm_set1_epi16(128);
+        const __m128i kU = _mm_setr_epi16(-43, -85, -43, -85, -43, -85, -43, -85);
+        const __m128i kV = _mm_setr_epi16(-107, -21, -107, -21, -107, -21, -107, -21);
+        const __m128i c128 = _mm_set1_epi32(128), two = _mm_set1_epi32(2);
+        auto chan = [&](__m128i a, __m128i b, int shift) {   // 8 pixels -> 8 x 16-bit channel values
+            return _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(a, shift), m8), _mm_and_si128(_mm_srli_epi32(b, shift), m8));
+        };
+        auto luma = [&](__m128i r, __m128i g, __m128i b) {   // sums stay below 2^16: unsigned 16-bit is exact
+            __m128i s = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(r, kR), _mm_mullo_epi16(g, kG)),
+                                      _mm_add_epi16(_mm_mullo_epi16(b, kB), half));
+            return _mm_srli_epi16(s, 8);
+        };
+        auto pack4 = [](__m128i v32, uint8_t* dst) {
+            __m128i p = _mm_packs_epi32(v32, v32);
+            int bytes = _mm_cvtsi128_si32(_mm_packus_epi16(p, p));
+            std::memcpy(dst, &bytes, 4);
+        };
+        for (; x + 8 <= w; x += 8) {
+            __m128i a0 = _mm_loadu_si128((const __m128i*)(r0 + x)), a1 = _mm_loadu_si128((const __m128i*)(r0 + x + 4));
+            __m128i b0 = _mm_loadu_si128((const __m128i*)(r1 + x)), b1 = _mm_loadu_si128((const __m128i*)(r1 + x + 4));
+            __m128i ra = chan(a0, a1, 0), ga = chan(a0, a1, 8), ba = chan(a0, a1, 16);
+            __m128i rb = chan(b0, b1, 0), gb = chan(b0, b1, 8), bb = chan(b0, b1, 16);
+            _mm_storel_epi64((__m128i*)(y0 + x), _mm_packus_epi16(luma(ra, ga, ba), _mm_setzero_si128()));
+            _mm_storel_epi64((__m128i*)(y1 + x), _mm_packus_epi16(luma(rb, gb, bb), _mm_setzero_si128()));
+
+            // 2x2 sums via madd with ones, then the average in 32-bit lanes
+            __m128i R = _mm_srli_epi32(_mm_add_epi32(_mm_add_epi32(_mm_madd_epi16(ra, ones), _mm_madd_epi16(rb, ones)), two), 2);
+            __m128i G = _mm_srli_epi32(_mm_add_epi32(_mm_add_epi32(_mm_madd_epi16(ga, ones), _mm_madd_epi16(gb, ones)), two), 2);
+            __m128i B = _mm_srli_epi32(_mm_add_epi32(_mm_add_epi32(_mm_madd_epi16(ba, ones), _mm_madd_epi16(bb, ones)), two), 2);
+            __m128i cu = _mm_add_epi32(_mm_add_epi32(_mm_madd_epi16(_mm_or_si128(R, _mm_slli_epi32(G, 16)), kU), _mm_slli_epi32(B, 7)), c128);
+            __m128i cv = _mm_add_epi32(_mm_add_epi32(_mm_madd_epi16(_mm_or_si128(G, _mm_slli_epi32(B, 16)), kV), _mm_slli_epi32(R, 7)), c128);
+            pack4(_mm_add_epi32(_mm_srai_epi32(cu, 8), c128), u + x / 2);
+            pack4(_mm_add_epi32(_mm_srai_epi32(cv, 8), c128), v + x / 2);
+        }
+#endif
+        auto lumaOf = [](uint32_t c) {
+            return (uint8_t)((77 * (c & 255) + 150 * ((c >> 8) & 255) + 29 * ((c >> 16) & 255) + 128) >> 8);
+        };
+        for (; x < w; x += 2) {
+            y0[x] = lumaOf(r0[x]); y0[x + 1] = lumaOf(r0[x + 1]);
+            y1[x] = lumaOf(r1[x]); y1[x + 1] = lumaOf(r1[x + 1]);
+            int R = 2, G = 2, B = 2;
+            for (uint32_t c : { r0[x], r0[x + 1], r1[x], r1[x + 1] }) {
+                R += c & 255; G += (c >> 8) & 255; B += (c >> 16) & 255;
+            }
+            R >>= 2; G >>= 2; B >>= 2;
+            u[x / 2] = (uint8_t)clampi(((-43 * R - 85 * G + 128 * B + 128) >> 8) + 128, 0, 255);
+            v[x / 2] = (uint8_t)clampi(((128 * R - 107 * G - 21 * B + 128) >> 8) + 128, 0, 255);
+        }
+    }
+}
+
+struct FrameRecorder
+{
+    enum { SLOTS = 8 };
+
+    std::string path;
+    FILE* out = nullptr;
+    bool isPipe = false, y4m = true;
+    int w = 0, h = 0;
+    std::vector<std::vector<uint32_t> > slots;
+    std::vector<int> freeSlots;
+    std::deque<int> ready;
+    std::mutex lock;
+    std::condition_variable wake;
+    std::thread writer;
+    bool stopping = false, failed = false;
+    uint64_t written = 0, dropped = 0;
+    size_t maxQueued = 0;
+
+    bool active() const { return !path.empty(); }
+
+    void start(const char* target)
+    {
+        path = target;
+        size_t n = path.size();
+        y4m = !(n > 4 && path.compare(n - 4, 4, ".yuv") == 0);
+    }
+
+    // First frame: open the output and start the writer
+    bool openOutput(int fw, int fh)
+    {
+        w = fw & ~1; h = fh & ~1;
+        if (w == 0 || h == 0) return false;
+#ifdef SIGPIPE
+        // A reader that quits early must fail the write, not kill the process
+        if (path == "-" || path[0] == '|') std::signal(SIGPIPE, SIG_IGN);
+#endif
+        if (path == "-") out = stdout;
+        else if (path[0] == '|') {
+#ifdef _WIN32
+            out = _popen(path.c_str() + 1, "wb");
+#else
+            out = popen(path.c_str() + 1, "w");
+#endif
+            isPipe = true;
+        } else out = std::fopen(path.c_str(), "wb");
+        if (!out) { std::perror(path.c_str()); path.clear(); return false; }
+        if (y4m) std::fprintf(out, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", w, h, RECORD_FPS);
+        slots.assign(SLOTS, std::vector<uint32_t>((size_t)w * h));
+        for (int i = SLOTS - 1; i >= 0; --i) freeSlots.push_back(i);
+        writer = std::thread([this] { writerLoop(); });
+        return true;
+    }
+
+    // Queue a frame (rows stride pixels apart); never waits for the writer
+    void push(const uint32_t* px, int fw, int fh, int stride, bool bottomUp)
+    {
+        if (!active() || (!out && !openOutput(fw, fh))) return;
+        int slot;
+        {
+            std::lock_guard<std::mutex> g(lock);
+            if (freeSlots.empty()) { ++dropped; return; }
+            slot = freeSlots.back();
+            freeSlots.pop_back();
+        }
+        uint32_t* dst = slots[slot].data();
+        int cw = std::min(w, fw);
+        for (int y = 0; y < h; ++y) {
+            int sy = bottomUp ? fh - 1 - y : y;
+            uint32_t* row = dst + (size_t)y * w;
+            if (sy < 0 || sy >= fh) { std::fill(row, row + w, 0xFF000000u); continue; }
+            std::memcpy(row, px + (size_t)sy * stride, (size_t)cw * 4);
+            std::fill(row + cw, row + w, 0xFF000000u);
+        }
+        {
+            std::lock_guard<std::mutex> g(lock);
+            ready.push_back(slot);
+            maxQueued = std::max(maxQueued, ready.size());
+        }
+        wake.notify_one();
+    }
+
+    void writerLoop()
+    {
+        std::vector<uint8_t> yuv((size_t)w * h * 3 / 2);
+        for (;;) {
+            int slot;
+            {
+                std::unique_lock<std::mutex> g(lock);
+                wake.wait(g, [this] { return stopping || !ready.empty(); });
+                if (ready.empty()) return;
+                slot = ready.front();
+                ready.pop_front();
+            }
+            rgbaToI420(slots[slot].data(), w, h, yuv.data(), yuv.data() + (size_t)w * h, yuv.data() + (size_t)w * h * 5 / 4);
+            bool ok = !failed && (!y4m || std::fputs("FRAME\n", out) >= 0) && std::fwrite(yuv.data(), 1, yuv.size(), out) == yuv.size();
+            std::lock_guard<std::mutex> g(lock);
+            freeSlots.push_back(slot);
+            if (ok) ++written;
+            else { failed = true; ++dropped; }
+        }
+    }
+
+    std::string describe()
+    {
+        std::lock_guard<std::mutex> g(lock);
+        char buf[256];
+        std::snprintf(buf, sizeof(buf), "Recording %s: written %llu, queued %zu (max %zu of %d), dropped %llu",
+                      path.c_str(), (unsigned long long)written, ready.size(), maxQueued, (int)SLOTS,
+                      (unsigned long long)dropped);
+        return buf;
+    }
+
+    // Drain the queue, close the output and report
+    void stop()
+    {
+        if (!active()) return;
+        if (writer.joinable()) {
+            { std::lock_guard<std::mutex> g(lock); stopping = true; }
+            wake.notify_one();
+            writer.join();
+        }
+        if (out && out != stdout) {
+#ifdef _WIN32
+            if (isPipe) _pclose(out); else std::fclose(out);
+#else
+            if (isPipe) pclose(out); else std::fclose(out);
+#endif
+        } else if (out) std::fflush(out);
+        std::fprintf(stderr, "recorded %llu frames (%dx%d %s) to %s, dropped %llu, max queued %zu of %d%s\n",
+                     (unsigned long long)written, w, h, y4m ? "y4m" : "raw i420", path.c_str(),
+                     (unsigned long long)dropped, maxQueued, (int)SLOTS, failed ? ", write failed" : "");
+        out = nullptr;
+        path.clear();
+    }
+};
+
+static FrameRecorder recorder;
+
+// --------------- PNG writer ---------------
+// 8-bit RGB PNG from RGBA pixels, encoded in parallel: the image is cut into
+// row blocks and each block is filtered, deflated and wrapped in its own
+// IDAT chunk (CRC included) independently. Blocks end on a byte boundary
+// with an empty stored block (a zlib sync flush), so the IDATs concatenate
+// into one valid zlib stream; the Adler-32s are combined and written in a
+// last 4-byte IDAT. The first row of a block only uses filters that do not
+// look at the row above, so blocks never need their neighbours.
+// Filters are scored with SSE2 (minimum sum of |signed byte|). Levels:
+// 0 stored, 1 single-probe LZ77, 2 LZ77 with a short hash chain; both LZ
+// levels use the fixed Huffman code.
+enum { PNG_STORED = 0, PNG_FAST = 1, PNG_BETTER = 2 };
+static const char* const SNAPSHOT_PATH = "frame.png";
+
+struct PngBlock {
+    std::vector<uint8_t> chunk;   // complete IDAT chunk
+    uint32_t adler = 1;
+    size_t filtered = 0;          // bytes of filtered data (for the Adler combine)
+};
+
+static uint32_t crcTable[8][256];      // slicing-by-8
+
+void initCrcTable()
+{
+    for (uint32_t n = 0; n < 256; ++n) {
+        uint32_t c = n;
+        for (int k = 0; k < 8; ++k) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        crcTable[0][n] = c;
+    }
+    for (uint32_t n = 0; n < 256; ++n)
+        for (int t = 1; t < 8; ++t) crcTable[t][n] = crcTable[0][crcTable[t - 1][n] & 255] ^ (crcTable[t - 1][n] >> 8);
+}
+
+uint32_t crc32(const uint8_t* p, size_t n, uint32_t crc = 0)
+{
+    crc = ~crc;
+    for (; n >= 8; n -= 8, p += 8) {
+        uint32_t lo, hi;
+        std::memcpy(&lo, p, 4);
+        std::memcpy(&hi, p + 4, 4);
+        lo ^= crc;      // little endian
+        crc = crcTable[7][lo & 255] ^ crcTable[6][(lo >> 8) & 255] ^ crcTable[5][(lo >> 16) & 255] ^ crcTable[4][lo >> 24] ^
+              crcTable[3][hi & 255] ^ crcTable[2][(hi >> 8) & 255] ^ crcTable[1][(hi >> 16) & 255] ^ crcTable[0][hi >> 24];
+    }
+    while (n--) crc = crcTable[0][(crc ^ *p++) & 255] ^ (crc >> 8);
+    return ~crc;
+}
+
+uint32_t adler32(const uint8_t* p, size_t n, uint32_t adler = 1)
+{
+    uint32_t a = adler & 0xFFFF, b = adler >> 16;
+    while (n) {
+        size_t k = std::min<size_t>(n, 5552);   // largest run without overflow
+        n -= k;
+        while (k--) { a += *p++; b += a; }
+        a %= 65521; b %= 65521;
+    }
+    return a | (b << 16);
+}
+
+// Adler-32 of A followed by B, from adler(A), adler(B) and len(B) (as zlib)
+uint32_t adler32Combine(uint32_t a1, uint32_t a2, size_t len2)
+{
+    const uint32_t BASE = 65521;
+    uint32_t rem = (uint32_t)(len2 % BASE);
+    uint32_t sum1 = a1 & 0xFFFF;
+    uint32_t sum2 = (uint32_t)(((uint64_t)rem * sum1) % BASE);
+    sum1 += (a2 & 0xFFFF) + BASE - 1;
+    sum2 += (a1 >> 16) + (a2 >> 16) + BASE - rem;
+    if (sum1 >= BASE) sum1 -= BASE;
+    if (sum1 >= BASE) sum1 -= BASE;
+    if (sum2 >= 2 * BASE) sum2 -= 2 * BASE;
+    if (sum2 >= BASE) sum2 -= BASE;
+    return sum1 | (sum2 << 16);
+}
+
+void initDeflateTables();
+
+// CRC and deflate tables, built on first use (thread-safe static init)
+void pngTables()
+{
+    static const bool ready = (initDeflateTables(), true);
+    (void)ready;
+}
+
+void pngChunk(std::vector<uint8_t>& out, const char* type, const uint8_t* data, size_t n)
+{
+    pngTables();
+    uint8_t len[4] = { (uint8_t)(n >> 24), (uint8_t)(n >> 16), (uint8_t)(n >> 8), (uint8_t)n };
+    out.insert(out.end(), len, len + 4);
+    size_t at = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data, data + n);
+    uint32_t crc = crc32(&out[at], n + 4);
+    uint8_t c[4] = { (uint8_t)(crc >> 24), (uint8_t)(crc >> 16), (uint8_t)(crc >> 8), (uint8_t)crc };
+    out.insert(out.end(), c, c + 4);
+}
+
+// Filter one RGB row (cur and prev have 16 zero bytes in front of them);
+// writes the filter byte and n filtered bytes to dst. prev == null: the
+// first row of a block, only None and Sub are allowed. tmp == null: None.
+void pngFilterRow(const uint8_t* cur, const uint8_t* prev, size_t n, uint8_t* dst, uint8_t* tmp)
+{
+    if (!tmp) { dst[0] = 0; std::memcpy(dst + 1, cur, n); return; }   // stored: filters buy nothing
+    const int BPP = 3;
+    int types = prev ? 5 : 2;
+    uint64_t score[5] = { 0, 0, 0, 0, 0 };
+    uint8_t* cand[5] = { tmp, tmp + n, tmp + 2 * n, tmp + 3 * n, tmp + 4 * n };
+    auto paeth = [](int a, int b, int c) {
+        int pa = std::abs(b - c), pb = std::abs(a - c), pc = std::abs(a + b - 2 * c);
+        return pa <= pb && pa <= pc ? a : pb <= pc ? b : c;
+    };
+    size_t i = 0;
+#ifdef HAVE_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    __m128i acc[5] = { zero, zero, zero, zero, zero };
+    auto absSum = [&](__m128i v) { return _mm_sad_epu8(_mm_min_epu8(v, _mm_sub_epi8(zero, v)), zero); };
+    for (; i + 16 <= n; i += 16) {
+        __m128i x = _mm_loadu_si128((const __m128i*)(cur + i));
+        __m128i a = _mm_loadu_si128((const __m128i*)(cur + i - BPP));
+        __m128i f[5];
+        f[0] = x;
+        f[1] = _mm_sub_epi8(x, a);
+        if (prev) {
+            __m128i b = _mm_loadu_si128((const __m128i*)(prev + i));
+            __m128i c = _mm_loadu_si128((const __m128i*)(prev + i - BPP));
+            f[2] = _mm_sub_epi8(x, b);
+            // floor((a + b) / 2): avg_epu8 rounds up, take the odd bit back off
+            __m128i avg = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), _mm_set1_epi8(1)));
+            f[3] = _mm_sub_epi8(x, avg);
+            __m128i pred[2];
+            for (int half = 0; half < 2; ++half) {
+                __m128i a16 = half ? _mm_unpackhi_epi8(a, zero) : _mm_unpacklo_epi8(a, zero);
+                __m128i b16 = half ? _mm_unpackhi_epi8(b, zero) : _mm_unpacklo_epi8(b, zero);
+                __m128i c16 = half ? _mm_unpackhi_epi8(c, zero) : _mm_unpacklo_epi8(c, zero);
+                __m128i bc = _mm_sub_epi16(b16, c16), ac = _mm_sub_epi16(a16, c16);
+                __m128i pa = _mm_max_epi16(bc, _mm_sub_epi16(zero, bc));
+                __m128i pb = _mm_max_epi16(ac, _mm_sub_epi16(zero, ac));
+                __m128i s = _mm_add_epi16(bc, ac);
+                __m128i pc = _mm_max_epi16(s, _mm_sub_epi16(zero, s));
+                __m128i useA = _mm_andnot_si128(_mm_or_si128(_mm_cmpgt_epi16(pa, pb), _mm_cmpgt_epi16(pa, pc)), _mm_set1_epi16(-1));
+                __m128i useB = _mm_andnot_si128(_mm_cmpgt_epi16(pb, pc), _mm_set1_epi16(-1));
+                __m128i bOrC = _mm_or_si128(_mm_and_si128(useB, b16), _mm_andnot_si128(useB, c16));
+                pred[half] = _mm_or_si128(_mm_and_si128(useA, a16), _mm_andnot_si128(useA, bOrC));
+            }
+            f[4] = _mm_sub_epi8(x, _mm_packus_epi16(pred[0], pred[1]));
+        }
+        for (int t = 0; t < types; ++t) {
+            _mm_storeu_si128((__m128i*)(cand[t] + i), f[t]);
+            acc[t] = _mm_add_epi64(acc[t], absSum(f[t]));
+        }
+    }
+    for (int t = 0; t < types; ++t) {
+        uint64_t lanes[2];
+        _mm_storeu_si128((__m128i*)lanes, acc[t]);
+        score[t] = lanes[0] + lanes[1];
+    }
+#endif
+    for (; i < n; ++i) {
+        int x = cur[i], a = cur[i - BPP];
+        uint8_t f[5] = { (uint8_t)x, (uint8_t)(x - a), 0, 0, 0 };
+        if (prev) {
+            int b = prev[i], c = prev[i - BPP];
+            f[2] = (uint8_t)(x - b);
+            f[3] = (uint8_t)(x - ((a + b) >> 1));
+            f[4] = (uint8_t)(x - paeth(a, b, c));
+        }
+        for (int t = 0; t < types; ++t) {
+            cand[t][i] = f[t];
+            score[t] += (uint64_t)std::min<int>(f[t], 256 - f[t]);
+        }
+    }
+    int best = 0;
+    for (int t = 1; t < types; ++t) if (score[t] < score[best]) best = t;
+    dst[0] = (uint8_t)best;
+    std::memcpy(dst + 1, cand[best], n);
+}
+
+// LSB-first bit packer; flushes 32 bits at a time (puts are at most 16 bits)
+struct BitWriter {
+    std::vector<uint8_t>& out;
+    uint64_t bits = 0;
+    int count = 0;
+    explicit BitWriter(std::vector<uint8_t>& o) : out(o) {}
+    void put(uint32_t v, int n)
+    {
+        bits |= (uint64_t)v << count;
+        count += n;
+        if (count >= 32) {
+            uint8_t b[4] = { (uint8_t)bits, (uint8_t)(bits >> 8), (uint8_t)(bits >> 16), (uint8_t)(bits >> 24) };
+            out.insert(out.end(), b, b + 4);
+            bits >>= 32;
+            count -= 32;
+        }
+    }
+    // Pad to a byte boundary and flush everything
+    void align()
+    {
+        for (count = (count + 7) & ~7; count > 0; count -= 8) { out.push_back((uint8_t)bits); bits >>= 8; }
+        count = 0;
+    }
+};
+
+static uint16_t fixedCode[288];     // bit-reversed fixed Huffman codes
+static uint8_t  fixedLen[288];
+static const uint16_t LEN_BASE[29]  = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59,
+                                        67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const uint8_t  LEN_EXTRA[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const uint16_t DIST_BASE[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769,
+                                        1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static const uint8_t  DIST_EXTRA[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10,
+                                         11, 11, 12, 12, 13, 13 };
+static uint8_t lenCode[259];        // match length -> index into LEN_*
+static uint8_t distCodes[512];      // d-1 < 256: [d-1], else [256 + ((d-1) >> 7)] (as zlib)
+
+void initDeflateTables()
+{
+    auto reverse = [](uint32_t v, int n) { uint32_t r = 0; for (int i = 0; i < n; ++i) r |= ((v >> i) & 1) << (n - 1 - i); return r; };
+    for (int s = 0; s < 288; ++s) {
+        int len = s < 144 ? 8 : s < 256 ? 9 : s < 280 ? 7 : 8;
+        uint32_t code = s < 144 ? 0x30 + s : s < 256 ? 0x190 + (s - 144) : s < 280 ? s - 256 : 0xC0 + (s - 280);
+        fixedCode[s] = (uint16_t)reverse(code, len);
+        fixedLen[s] = (uint8_t)len;
+    }
+    for (int k = 0; k < 29; ++k)
+        for (int l = LEN_BASE[k]; l < (k == 28 ? 259 : LEN_BASE[k + 1]); ++l) lenCode[l] = (uint8_t)k;
+    for (int k = 0; k < 30; ++k)
+        for (int d = DIST_BASE[k]; d < (k == 29 ? 32769 : DIST_BASE[k + 1]); ++d)
+            distCodes[d <= 256 ? d - 1 : 256 + ((d - 1) >> 7)] = (uint8_t)k;
+    initCrcTable();
+}
+
+inline int distCode(int d) { return d <= 256 ? distCodes[d - 1] : distCodes[256 + ((d - 1) >> 7)]; }
+
+// Length of the common prefix of a and b, up to limit
+inline size_t matchLength(const uint8_t* a, const uint8_t* b, size_t limit)
+{
+    size_t l = 0;
+#if defined(__GNUC__)
+    for (; l + 8 <= limit; l += 8) {
+        uint64_t x, y;
+        std::memcpy(&x, a + l, 8);
+        std::memcpy(&y, b + l, 8);
+        if (x != y) return l + (size_t)(__builtin_ctzll(x ^ y) >> 3);   // little endian
+    }
+#endif
+    while (l < limit && a[l] == b[l]) ++l;
+    return l;
+}
+
+// Deflate data as one fixed-Huffman block (or stored blocks), ending with
+// BFINAL set when last and with a sync flush otherwise
+void deflateBlock(const uint8_t* data, size_t n, int level, bool last, std::vector<uint8_t>& out)
+{
+    BitWriter bw(out);
+    if (level == PNG_STORED) {
+        size_t at = 0;
+        do {
+            size_t k = std::min<size_t>(n - at, 65535);
+            bool final = last && at + k == n;
+            bw.put(final ? 1 : 0, 3);
+            bw.align();
+            uint8_t hdr[4] = { (uint8_t)k, (uint8_t)(k >> 8), (uint8_t)~k, (uint8_t)(~k >> 8) };
+            out.insert(out.end(), hdr, hdr + 4);
+            out.insert(out.end(), data + at, data + at + k);
+            at += k;
+        } while (at < n);
+        if (!last) { bw.put(0, 3); bw.align(); out.insert(out.end(), { 0, 0, 0xFF, 0xFF }); }
+        return;
+    }
+
+    static const int HASH_BITS = 15, WINDOW = 32768, MAX_MATCH = 258;
+    const int chainDepth = level == PNG_BETTER ? 8 : 1;
+    std::vector<int32_t> head((size_t)1 << HASH_BITS, -1);
+    std::vector<int32_t> prevPos(level == PNG_BETTER ? n : 0);
+    auto hashAt = [&](size_t i) {
+        uint32_t v;
+        std::memcpy(&v, data + i, 4);
+        return (v * 2654435761u) >> (32 - HASH_BITS);
+    };
+    auto insert = [&](size_t i) {
+        if (i + 4 > n) return;
+        uint32_t h = hashAt(i);
+        if (!prevPos.empty()) prevPos[i] = head[h];
+        head[h] = (int32_t)i;
+    };
+
+    bw.put(last ? 1 : 0, 1);
+    bw.put(1, 2);                           // fixed Huffman
+    size_t i = 0;
+    while (i < n) {
+        int bestLen = 0, bestDist = 0;
+        if (i + 4 <= n) {
+            int32_t cand = head[hashAt(i)];
+            size_t limit = std::min<size_t>(MAX_MATCH, n - i);
+            for (int depth = 0; depth < chainDepth && cand >= 0 && i - (size_t)cand <= (size_t)WINDOW; ++depth) {
+                size_t l = matchLength(data + cand, data + i, limit);
+                if ((int)l > bestLen) { bestLen = (int)l; bestDist = (int)(i - cand); }
+                if (l == limit || prevPos.empty()) break;
+                cand = prevPos[cand];
+            }
+        }
+        if (bestLen >= 4) {
+            int lc = lenCode[bestLen];
+            bw.put(fixedCode[257 + lc], fixedLen[257 + lc]);
+            if (LEN_EXTRA[lc]) bw.put((uint32_t)(bestLen - LEN_BASE[lc]), LEN_EXTRA[lc]);
+            int dc = distCode(bestDist);
+            uint32_t rev = 0;
+            for (int b = 0; b < 5; ++b) rev |= ((dc >> b) & 1) << (4 - b);
+            bw.put(rev, 5);
+            if (DIST_EXTRA[dc]) bw.put((uint32_t)(bestDist - DIST_BASE[dc]), DIST_EXTRA[dc]);
+            insert(i);
+            // single-probe mode skips the interior of the match (speed over ratio)
+            if (chainDepth > 1) for (int k = 1; k < bestLen; ++k) insert(i + k);
+            i += bestLen;
+        } else {
+            insert(i);
+            bw.put(fixedCode[data[i]], fixedLen[data[i]]);
+            ++i;
+        }
+    }
+    bw.put(fixedCode[256], fixedLen[256]);  // end of block
+    if (!last) { bw.put(0, 3); bw.align(); out.insert(out.end(), { 0, 0, 0xFF, 0xFF }); }
+    else bw.align();
+}
+
+// Encode image rows [y0, y1) (top-down; rowAt(y) returns the RGBA row) as one IDAT
+template<typename RowAt>
+void encodePngBlock(const RowAt& rowAt, int w, int y0, int y1, int level, bool first, bool last, PngBlock& blk)
+{
+    pngTables();
+    size_t n = (size_t)w * 3;
+    std::vector<uint8_t> rows[2];
+    for (auto& r : rows) r.assign(16 + n, 0);
+    std::vector<uint8_t> filtered((size_t)(y1 - y0) * (n + 1)), tmp(5 * n + 16);
+    for (int y = y0; y < y1; ++y) {
+        uint8_t* cur = rows[(y - y0) & 1].data() + 16;
+        const uint8_t* prev = y > y0 ? rows[(y - y0 + 1) & 1].data() + 16 : nullptr;
+        const uint32_t* src = rowAt(y);
+        for (int x = 0; x < w; ++x) {
+            cur[3 * x] = (uint8_t)src[x]; cur[3 * x + 1] = (uint8_t)(src[x] >> 8); cur[3 * x + 2] = (uint8_t)(src[x] >> 16);
+        }
+        pngFilterRow(cur, prev, n, &filtered[(size_t)(y - y0) * (n + 1)], level == PNG_STORED ? nullptr : tmp.data());
+    }
+    blk.filtered = filtered.size();
+    blk.adler = adler32(filtered.data(), filtered.size());
+
+    std::vector<uint8_t> z;
+    z.reserve(level == PNG_STORED ? filtered.size() + filtered.size() / 65535 * 5 + 16 : filtered.size() / 2);
+    if (first) { z.push_back(0x78); z.push_back(0x01); }
+    deflateBlock(filtered.data(), filtered.size(), level, last, z);
+    blk.chunk.clear();
+    pngChunk(blk.chunk, "IDAT", z.data(), z.size());
+}
+
+std::vector<uint8_t> pngHeader(int w, int h)
+{
+    static const uint8_t SIG[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    std::vector<uint8_t> out(SIG, SIG + 8);
+    uint8_t ihdr[13] = { (uint8_t)(w >> 24), (uint8_t)(w >> 16), (uint8_t)(w >> 8), (uint8_t)w,
+                         (uint8_t)(h >> 24), (uint8_t)(h >> 16), (uint8_t)(h >> 8), (uint8_t)h,
+                         8, 2, 0, 0, 0 };       // 8-bit RGB, deflate, adaptive filtering, no interlace
+    pngChunk(out, "IHDR", ihdr, sizeof(ihdr));
+    return out;
+}
+
+// Adler trailer (its own IDAT) and IEND
+std::vector<uint8_t> pngTrailer(uint32_t adler)
+{
+    std::vector<uint8_t> out;
+    uint8_t a[4] = { (uint8_t)(adler >> 24), (uint8_t)(adler >> 16), (uint8_t)(adler >> 8), (uint8_t)adler };
+    pngChunk(out, "IDAT", a, 4);
+    pngChunk(out, "IEND", nullptr, 0);
+    return out;
+}
+
+// Write w x h pixels (rows stride apart, bottom row first when bottomUp)
+bool savePng(const char* path, const uint32_t* px, int w, int h, int stride, bool bottomUp, int threads, int level)
+{
+    if (w <= 0 || h <= 0) return false;
+    auto rowAt = [&](int y) { return px + (size_t)(bottomUp ? h - 1 - y : y) * stride; };
+    int rowsPer = std::max(16, (h + threads * 4 - 1) / (threads * 4));
+    int blocks = (h + rowsPer - 1) / rowsPer;
+    std::vector<PngBlock> out((size_t)blocks);
+    std::atomic<int> next(0);
+    auto worker = [&]() {
+        for (int b; (b = next++) < blocks; )
+            encodePngBlock(rowAt, w, b * rowsPer, std::min(h, (b + 1) * rowsPer), level, b == 0, b == blocks - 1, out[b]);
+    };
+    std::vector<std::thread> pool;
+    for (int t = 1; t < std::min(threads, blocks); ++t) pool.emplace_back(worker);
+    worker();
+    for (auto& t : pool) t.join();
+
+    FILE* f = std::fopen(path, "wb");
+    if (!f) return false;
+    std::vector<uint8_t> head = pngHeader(w, h);
+    bool ok = std::fwrite(head.data(), 1, head.size(), f) == head.size();
+    uint32_t adler = 1;
+    for (const PngBlock& b : out) {
+        ok = ok && std::fwrite(b.chunk.data(), 1, b.chunk.size(), f) == b.chunk.size();
+        adler = adler32Combine(adler, b.adler, b.filtered);
+    }
+    std::vector<uint8_t> tail = pngTrailer(adler);
+    ok = ok && std::fwrite(tail.data(), 1, tail.size(), f) == tail.size();
+    return std::fclose(f) == 0 && ok;
+}
+
+// --------------- Glow post-process ---------------
+// Adds a blurred copy of the glow source (the cyan clipped segments) over
+// the pan view. The blur is separable running-sum box passes (one: box,
+// three: approximate Gaussian), so a pixel costs the same at any radius.
+// Only tiles whose input changed are redone, grown by the blur's reach; the
+// rest of out is kept from the previous frame. Horizontal passes split rows
+// and vertical passes split column bands across threads; both run on SSE2
+// (one pixel's four channels per register horizontally, four channels of a
+// row at a time vertically).
+enum GlowMode { GLOW_OFF, GLOW_BOX, GLOW_GAUSSIAN, GLOW_MODES };
+static const char* GLOW_NAMES[GLOW_MODES] = { "off", "box", "gaussian" };
+
+// Helper threads for parallelRanges, started on first use and parked on a
+// condition variable between calls, so a small dirty box costs a wake-up
+// rather than thread creation. Driven from one thread (the GLUT thread).
+struct RangeWorkers
+{
+    std::vector<std::thread> threads;
+    std::mutex lock;
+    std::condition_variable start, done;
+    void (*call)(const void*, size_t, size_t) = nullptr;
+    const void* job = nullptr;
+    size_t n = 0, parts = 0, remaining = 0;
+    uint64_t generation = 0;
+    bool quit = false;
+
+    ~RangeWorkers()
+    {
+        { std::lock_guard<std::mutex> g(lock); quit = true; }
+        start.notify_all();
+        for (auto& t : threads) t.join();
+    }
+
+    // Part 0 runs on the caller, parts 1 .. parts-1 on the helpers
+    void run(size_t count, size_t partCount, void (*fn)(const void*, size_t, size_t), const void* ctx)
+    {
+        while (threads.size() + 1 < partCount) threads.emplace_back(&RangeWorkers::loop, this, threads.size() + 1, generation);
+        {
+            std::lock_guard<std::mutex> g(lock);
+            call = fn; job = ctx; n = count; parts = partCount; remaining = partCount - 1;
+            ++generation;
+        }
+        start.notify_all();
+        fn(ctx, 0, count / partCount);
+        std::unique_lock<std::mutex> g(lock);
+        done.wait(g, [&] { return remaining == 0; });
+    }
+
+    void loop(size_t index, uint64_t seen)
+    {
+        std::unique_lock<std::mutex> g(lock);
+        for (;;) {
+            start.wait(g, [&] { return quit || generation != seen; });
+            if (quit) return;
+            seen = generation;
+            if (index >= parts) continue;
+            size_t b = n * index / parts, e = n * (index + 1) / parts;
+            g.unlock();
+            call(job, b, e);
+            g.lock();
+            if (--remaining == 0) done.notify_one();
+        }
+    }
+};
+
+static RangeWorkers rangeWorkers;
+
+// Run f(begin, end) over [0, n) on up to hardware_concurrency threads
+template<typename F>
+void parallelRanges(size_t n, size_t minChunk, const F& f)
+{
+    size_t threads = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), std::max<size_t>(1, n / minChunk));
+    if (threads <= 1) { f((size_t)0, n); return; }
+    rangeWorkers.run(n, threads, [](const void* ctx, size_t b, size_t e) { (*(const F*)ctx)(b, e); }, &f);
+}
+
+// One running-sum box pass over n 4-channel values, zero outside [0, n)
+inline void boxPass(const int32_t* src, int32_t* dst, int n, int stride, int r, float inv)
+{
+#ifdef HAVE_SSE2
+    const __m128 k = _mm_set1_ps(inv);
+    auto at = [&](int i) { return _mm_loadu_si128((const __m128i*)(src + (size_t)i * stride)); };
+    __m128i sum = _mm_setzero_si128();
+    for (int i = 0; i <= std::min(r, n - 1); ++i) sum = _mm_add_epi32(sum, at(i));
+    for (int i = 0; i < n; ++i) {
+        _mm_storeu_si128((__m128i*)(dst + (size_t)i * stride), _mm_cvtps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(sum), k)));
+        if (i + r + 1 < n) sum = _mm_add_epi32(sum, at(i + r + 1));
+        if (i - r >= 0)    sum = _mm_sub_epi32(sum, at(i - r));
+    }
+#else
+    for (int c = 0; c < 4; ++c) {
+        int32_t sum = 0;
+        for (int i = 0; i <= std::min(r, n - 1); ++i) sum += src[(size_t)i * stride + c];
+        for (int i = 0; i < n; ++i) {
+            dst[(size_t)i * stride + c] = (int32_t)std::lrint(sum * inv);
+            if (i + r + 1 < n) sum += src[(size_t)(i + r + 1) * stride + c];
+            if (i - r >= 0)    sum -= src[(size_t)(i - r) * stride + c];
+        }
+    }
+#endif
+}
+
+struct Glow
+{
+    enum { TILE = 64 };
+
+    GlowMode mode = GLOW_OFF;
+    int radius = 6;             // per box pass
+    int strength = 224;         // glow gain, of 256
+    int w = 0, h = 0, tilesX = 0, tilesY = 0;
+    std::vector<uint32_t> out;  // composited frame
+    std::vector<uint8_t> dirty; // per tile: input changed since the last apply
+    bool allDirty = true;
+    long long pxBlurred = 0;    // by the last apply
+    double ms = 0.0;
+    std::vector<int32_t> buf[2];
+
+    int passes() const { return mode == GLOW_GAUSSIAN ? 3 : 1; }
+    int reach() const { return passes() * radius; }
+
+    void resize(int gw, int gh)
+    {
+        w = gw; h = gh;
+        tilesX = (w + TILE - 1) / TILE; tilesY = (h + TILE - 1) / TILE;
+        out.assign((size_t)w * h, 0);
+        dirty.assign((size_t)tilesX * tilesY, 0);
+        allDirty = true;
+    }
+
+    void markDirty(int x0, int y0, int x1, int y1)
+    {
+        if (x1 < 0 || y1 < 0 || x0 >= w || y0 >= h) return;
+        int tx0 = clampi(x0 / TILE, 0, tilesX - 1), tx1 = clampi(x1 / TILE, 0, tilesX - 1);
+        int ty0 = clampi(y0 / TILE, 0, tilesY - 1), ty1 = clampi(y1 / TILE, 0, tilesY - 1);
+        for (int ty = ty0; ty <= ty1; ++ty)
+            std::fill(&dirty[(size_t)ty * tilesX + tx0], &dirty[(size_t)ty * tilesX + tx1] + 1, 1);
+    }
+
+    void markAll() { allDirty = true; }
+
+    // Dirty tiles -> pixel boxes: runs per tile row, merged down the rows
+    std::vector<Box> dirtyBoxes() const
+    {
+        std::vector<Box> boxes;
+        if (allDirty) { boxes.push_back({ 0, 0, w - 1, h - 1 }); return boxes; }
+        std::vector<size_t> open, next;        // boxes touching the previous tile row
+        for (int ty = 0; ty < tilesY; ++ty) {
+            next.clear();
+            for (int tx = 0; tx < tilesX; ) {
+                if (!dirty[(size_t)ty * tilesX + tx]) { ++tx; continue; }
+                int run0 = tx;
+                while (tx < tilesX && dirty[(size_t)ty * tilesX + tx]) ++tx;
+                Box b = { run0 * TILE, ty * TILE, std::min(w, tx * TILE) - 1, std::min(h, (ty + 1) * TILE) - 1 };
+                size_t k = 0;
+                while (k < open.size() && (boxes[open[k]].x1 < b.x0 || boxes[open[k]].x0 > b.x1)) ++k;
+                if (k < open.size()) {
+                    boxes[open[k]] = boxUnion(boxes[open[k]], b);
+                    if (std::find(next.begin(), next.end(), open[k]) == next.end()) next.push_back(open[k]);
+                } else {
+                    next.push_back(boxes.size());
+                    boxes.push_back(b);
+                }
+            }
+            open.swap(next);
+        }
+        return boxes;
+    }
+
+    // Recompute out where the input changed. isSource(pixel) says whether
+    // a base pixel glows.
+    template<typename IsSource>
+    void apply(const uint32_t* base, const IsSource& isSource)
+    {
+        auto t0 = std::chrono::steady_clock::now();
+        pxBlurred = 0;
+        const int M = reach();
+        for (const Box& d : dirtyBoxes()) {
+            Box o = { std::max(0, d.x0 - M), std::max(0, d.y0 - M), std::min(w - 1, d.x1 + M), std::min(h - 1, d.y1 + M) };
+            blurInto(base, o, isSource);
+            pxBlurred += (long long)(o.x1 - o.x0 + 1) * (o.y1 - o.y0 + 1);
+        }
+        std::fill(dirty.begin(), dirty.end(), 0);
+        allDirty = false;
+        ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    }
+
+    template<typename IsSource>
+    void blurInto(const uint32_t* base, const Box& o, const IsSource& isSource)
+    {
+        const int M = reach(), r = radius;
+        const int bx0 = o.x0 - M, by0 = o.y0 - M;
+        const int bw = o.x1 - o.x0 + 1 + 2 * M, bh = o.y1 - o.y0 + 1 + 2 * M;
+        const float inv = 1.0f / (2 * r + 1);
+        for (auto& b : buf) b.resize((size_t)bw * bh * 4);
+        int32_t* A = buf[0].data();
+        int32_t* B = buf[1].data();
+
+        // Horizontal passes, rows in parallel; the source mask is applied on load
+        parallelRanges((size_t)bh, 64, [&](size_t y0, size_t y1) {
+            std::vector<int32_t> ping((size_t)bw * 4), pong((size_t)bw * 4);
+            for (size_t yy = y0; yy < y1; ++yy) {
+                int y = by0 + (int)yy;
+                int32_t* row = A + yy * bw * 4;
+                for (int x = 0; x < bw; ++x) {
+                    int ix = bx0 + x;
+                    uint32_t c = (y >= 0 && y < h && ix >= 0 && ix < w) ? base[(size_t)y * w + ix] : 0;
+                    if (!isSource(c)) c = 0;
+                    ping[4 * x] = c & 255; ping[4 * x + 1] = (c >> 8) & 255; ping[4 * x + 2] = (c >> 16) & 255; ping[4 * x + 3] = 0;
+                }
+                const int32_t* src = ping.data();
+                for (int p = 0; p < passes(); ++p) {
+                    int32_t* dst = p + 1 == passes() ? row : (src == ping.data() ? pong.data() : ping.data());
+                    boxPass(src, dst, bw, 4, r, inv);
+                    src = dst;
+                }
+            }
+        });
+
+        // Vertical passes over the columns that matter, column bands in parallel
+        const int cx0 = M, cols = o.x1 - o.x0 + 1;
+        parallelRanges((size_t)cols, 64, [&](size_t c0, size_t c1) {
+            for (size_t c = c0; c < c1; ++c) {
+                const int32_t* src = A + (cx0 + c) * 4;
+                for (int p = 0; p < passes(); ++p) {
+                    int32_t* dst = (p & 1 ? A : B) + (cx0 + c) * 4;
+                    boxPass(src, dst, bh, bw * 4, r, inv);
+                    src = dst;
+                }
+            }
+        });
+        const int32_t* blurred = passes() & 1 ? B : A;
+
+        // out = base + strength * blur, saturated
+        for (int y = o.y0; y <= o.y1; ++y) {
+            const int32_t* g = blurred + ((size_t)(y - by0) * bw + M) * 4;
+            const uint32_t* src = base + (size_t)y * w;
+            uint32_t* dst = out.data() + (size_t)y * w;
+            int x = o.x0;
+#ifdef HAVE_SSE2
+            const __m128i k = _mm_set1_epi16((short)strength), alpha = _mm_set1_epi32((int)0xFF000000u);
+            for (; x + 4 <= o.x1 + 1; x += 4) {
+                const int32_t* gp = g + (size_t)(x - o.x0) * 4;
+                __m128i lo = _mm_packs_epi32(_mm_loadu_si128((const __m128i*)gp), _mm_loadu_si128((const __m128i*)(gp + 4)));
+                __m128i hi = _mm_packs_epi32(_mm_loadu_si128((const __m128i*)(gp + 8)), _mm_loadu_si128((const __m128i*)(gp + 12)));
+                lo = _mm_srli_epi16(_mm_mullo_epi16(lo, k), 8);
+                hi = _mm_srli_epi16(_mm_mullo_epi16(hi, k), 8);
+                __m128i px = _mm_adds_epu8(_mm_loadu_si128((const __m128i*)(src + x)), _mm_packus_epi16(lo, hi));
+                _mm_storeu_si128((__m128i*)(dst + x), _mm_or_si128(px, alpha));
+            }
+#endif
+            for (; x <= o.x1; ++x) {
+                const int32_t* gp = g + (size_t)(x - o.x0) * 4;
+                uint32_t c = 0xFF000000u;
+                for (int ch = 0; ch < 3; ++ch) {
+                    int v = (int)((src[x] >> (8 * ch)) & 255) + ((gp[ch] * strength) >> 8);
+                    c |= (uint32_t)std::min(255, v) << (8 * ch);
+                }
+                dst[x] = c;
+            }
+        }
+    }
+};
+
+static Glow glow;
+
+// Pan view pixels about to change: tell the export, the stream and the glow
+void frameTouched(int x0, int y0, int x1, int y1)
+{
+    frameExport.touch(x0, y0, x1, y1);
+    frameStream.touch(x0, y0, x1, y1);
+    glow.markDirty(x0, y0, x1, y1);
+}
+
+void frameTouchedAll()
+{
+    frameExport.touchAll();
+    frameStream.touchAll();
+    glow.markAll();
+}
+
+// --------------- Scroll-blit pan view ---------------
+// Window-sized framebuffer showing world [ox, ox+w) x [oy, oy+h) at 1:1,
+// rendered straight from the primitives (not limited to the canvas).
+// Panning memmoves the surviving pixels and only the newly exposed strips
+// (plus any damaged rects) are rasterized, via the BVH. With --export-shm
+// the pixels live in the shared frame instead of own.
+struct PanView
+{
+    int w = 0, h = 0, ox = 0, oy = 0;
+    std::vector<uint32_t> own;
+    uint32_t* px = nullptr;
+    std::vector<Box> dirty;         // world rects still to rasterize
+    std::vector<uint32_t> hits;
+    long long pxRendered = 0;       // by the last render()
+
+    void resize(int vw, int vh)
+    {
+        w = vw; h = vh;
+        px = frameExport.active() ? frameExport.resize(w, h) : nullptr;
+        if (!px) { own.assign((size_t)w * h, CANVAS_BG); px = own.data(); }
+        else std::fill(px, px + (size_t)w * h, CANVAS_BG);
+        frameStream.resize(w, h);
+        glow.resize(w, h);
+        dirty.clear();
+        markDirty(view());
+    }
+
+    Box view() const { return { ox, oy, ox + w - 1, oy + h - 1 }; }
+
+    void markDirty(const Box& b)
+    {
+        Box v = view();
+        Box c = { std::max(b.x0, v.x0), std::max(b.y0, v.y0), std::min(b.x1, v.x1), std::min(b.y1, v.y1) };
+        if (c.x0 > c.x1 || c.y0 > c.y1) return;
+        if (dirty.size() == 1 && boxInside(v, dirty[0])) return; // already redrawing everything
+        if (dirty.size() >= 256) { dirty.assign(1, v); return; }  // cheaper to redraw the view
+        dirty.push_back(c);
+    }
+
+    // Move the view origin by (dx,dy) world pixels
+    void pan(int dx, int dy)
+    {
+        ox += dx; oy += dy;
+        frameTouchedAll();
+        if (std::abs(dx) >= w || std::abs(dy) >= h) {
+            dirty.clear();
+            markDirty(view());
+            return;
+        }
+        // new pixel (x,y) = old pixel (x+dx, y+dy)
+        int xs = std::max(0, -dx), xe = w - std::max(0, dx); // destination columns kept
+        int ys = std::max(0, -dy), ye = h - std::max(0, dy);
+        size_t bytes = (size_t)(xe - xs) * sizeof(uint32_t);
+        if (dy > 0) {
+            for (int y = ys; y < ye; ++y)
+                std::memmove(&px[(size_t)y * w + xs], &px[(size_t)(y + dy) * w + xs + dx], bytes);
+        } else {
+            for (int y = ye - 1; y >= ys; --y)
+                std::memmove(&px[(size_t)y * w + xs], &px[(size_t)(y + dy) * w + xs + dx], bytes);
+        }
+        // exposed strips, in world coordinates
+        if (dx > 0) markDirty({ ox + w - dx, oy, ox + w - 1, oy + h - 1 });
+        if (dx < 0) markDirty({ ox, oy, ox - dx - 1, oy + h - 1 });
+        if (dy > 0) markDirty({ ox, oy + h - dy, ox + w - 1, oy + h - 1 });
+        if (dy < 0) markDirty({ ox, oy, ox + w - 1, oy - dy - 1 });
+    }
+
+    void render(const SegmentStore& st, const SegmentBVH& index, const Box& clip)
+    {
+        pxRendered = 0;
+        Box v = view();
+        for (const Box& d : dirty) {
+            // the view may have moved since this rect was queued
+            Box r = { std::max(d.x0, v.x0), std::max(d.y0, v.y0), std::min(d.x1, v.x1), std::min(d.y1, v.y1) };
+            if (r.x0 > r.x1 || r.y0 > r.y1) continue;
+            frameTouched(r.x0 - ox, r.y0 - oy, r.x1 - ox, r.y1 - oy);
+            for (int y = r.y0; y <= r.y1; ++y) {
+                uint32_t* row = &px[(size_t)(y - oy) * w];
+                std::fill(row + (r.x0 - ox), row + (r.x1 - ox) + 1, CANVAS_BG);
+            }
+            rasterSceneRect(st, index, clip, r, ox, oy, px, w, hits);
+            pxRendered += (long long)(r.x1 - r.x0 + 1) * (r.y1 - r.y0 + 1);
+        }
+        dirty.clear();
+        metricAdd(M_PAN_PIXELS_RENDERED, (uint64_t)pxRendered);
+        metricAdd(M_PAN_PIXELS_REUSED, (uint64_t)std::max(0LL, (long long)w * h - pxRendered));
+    }
+};
+
+static Canvas  canvas;
+static PanView panView;
+static bool    canvasView = false;  // show the software canvas/pan view instead of GL lines
+static int     zoomLevel  = 0;      // 0: pan view, else canvas pyramid level (1:2^zoomLevel)
+static const int CANVAS_SIZE = 2048;
+
+// World-space damage bookkeeping shared by the canvas and the pan view
+static std::vector<Box> drawnBox;   // per slot: box when last rasterized
+static Box      lastClip   = EMPTY_BOX;
+static uint32_t sceneEpoch = ~0u;
+
+// Animated view transform of the GL view (T toggles, K bakes it in)
+static SegmentSoA segSoA;
+static bool   animTransform = false;
+static float  animAngle     = 0.0f;
+static int    animGen       = 0;
+static double transformMs   = 0.0;
+static int    transformThreads = 1;
+
+// Kinetic scrubbing of the clip window (G toggles; A/D or W/S pick the axis)
+static KineticClip kinetic;
+static bool kineticMode = false;
+static bool scrubAlongX = true;
+
+Affine currentTransform()
+{
+    return Affine::about(winW * 0.5f, winH * 0.5f, animAngle, 1.0f + 0.25f * std::sin(animAngle * 1.7f));
+}
+
+void markDamage(const Box& b)
+{
+    canvas.markDirty(b);
+    panView.markDirty(b);
+}
+
+// Bring every consumer of the store's change list up to date, then reset
+// it: the BVH refits/rebuilds, rasterized views get the old and new boxes
+// of edited segments (and of the clip window, when it moved) as damage
+void syncScene()
+{
+    ingestFromLog();
+    segIndex.sync(segments);
+    segSoA.sync(segments);
+    if (!segments.touched.empty() || sceneEpoch != segments.epoch) kinetic.stale = true;
+
+    if (sceneEpoch != segments.epoch) {
+        sceneEpoch = segments.epoch;
+        drawnBox.clear();
+        markDamage({ INT_MIN / 2, INT_MIN / 2, INT_MAX / 2, INT_MAX / 2 });
+    }
+    if (drawnBox.size() < segments.seg.size()) drawnBox.resize(segments.seg.size(), EMPTY_BOX);
+    for (uint32_t i : segments.touched) {
+        markDamage(drawnBox[i]);
+        drawnBox[i] = segments.alive[i] ? segBox(segments.seg[i]) : EMPTY_BOX;
+        markDamage(drawnBox[i]);
+    }
+    Box clip = { xminC, yminC, xmaxC, ymaxC };
+    if (!boxEqual(clip, lastClip)) {
+        markDamage(lastClip);
+        markDamage(clip);
+        lastClip = clip;
+    }
+    segments.touched.clear();
+}
+
+// Screen pixel -> world coordinate in the current view
+inline int screenToWorldX(int v) { return canvasView ? (v << zoomLevel) + panView.ox : v; }
+inline int screenToWorldY(int v) { return canvasView ? (v << zoomLevel) + panView.oy : v; }
+
+// Headless frames have no context to upload to: the copy into a staging
+// buffer stands in for it so the per-frame pixel traffic is still paid
+static std::vector<uint32_t> uploadStaging;
+
+void stageUpload(const uint32_t* px, int w, int h, int rowLength)
+{
+    if (!headless) return;
+    uploadStaging.resize((size_t)w * h);
+    for (int y = 0; y < h; ++y)
+        std::memcpy(&uploadStaging[(size_t)y * w], px + (size_t)y * rowLength, (size_t)w * 4);
+}
+
+// Headless frames of the GL view: the lines the GL calls would draw are
+// rasterized (1 px Bresenham, cut to the window) into viewTarget instead,
+// so the frame pays for its pixels and not just for no-op GL calls.
+static std::vector<uint32_t> viewTarget;
+static const uint32_t VIEW_YELLOW = 0xFF3CD2FFu;   // (255,210,60)
+
+// One GL_LINES pair, or the same line in viewTarget when headless
+inline void viewLine(float x0, float y0, float x1, float y1, uint32_t color)
+{
+    if (!headless) { glVertex2f(x0, y0); glVertex2f(x1, y1); return; }
+    Seg s = { { (int)std::lround(x0), (int)std::lround(y0) }, { (int)std::lround(x1), (int)std::lround(y1) } };
+    rasterSegmentInRect(s, { 0, 0, winW - 1, winH - 1 }, color, viewTarget.data(), winW);
+}
+
+// Zoomed out: present the visible part of the pyramid level straight from
+// its buffer. 1:1: present the pan view.
+void drawCanvas()
+{
+    Box clip = { xminC, yminC, xmaxC, ymaxC };
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    if (zoomLevel == 0) {
+        panView.render(segments, segIndex, clip);
+        const uint32_t* shown = panView.px;
+        if (glow.mode != GLOW_OFF) {
+            glow.apply(panView.px, [](uint32_t c) { return c == CANVAS_CYAN; });
+            shown = glow.out.data();
+        }
+        glRasterPos2i(0, 0);
+        glDrawPixels(panView.w, panView.h, GL_RGBA, GL_UNSIGNED_BYTE, shown);
+        stageUpload(shown, panView.w, panView.h, panView.w);
+        metricAdd(M_BYTES_UPLOADED, (uint64_t)panView.w * panView.h * 4);
+        return;
+    }
+
+    canvas.redraw(segments, segIndex, clip);
+    int L = std::min(zoomLevel, (int)canvas.level.size() - 1);
+    int lw = canvas.levelW[L], lh = canvas.levelH[L];
+    int sx0 = panView.ox >> L, sy0 = panView.oy >> L;        // level pixel at screen (0,0)
+    int x0 = std::max(sx0, 0), y0 = std::max(sy0, 0);
+    int x1 = std::min(sx0 + winW, lw), y1 = std::min(sy0 + winH, lh);
+    if (x0 >= x1 || y0 >= y1) return;
+
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, lw);
+    glPixelStorei(GL_UNPACK_SKIP_PIXELS, x0);
+    glPixelStorei(GL_UNPACK_SKIP_ROWS, y0);
+    glRasterPos2i(x0 - sx0, y0 - sy0);
+    glDrawPixels(x1 - x0, y1 - y0, GL_RGBA, GL_UNSIGNED_BYTE, canvas.level[L].data());
+    stageUpload(&canvas.level[L][(size_t)y0 * lw + x0], x1 - x0, y1 - y0, lw);
+    metricAdd(M_BYTES_UPLOADED, (uint64_t)(x1 - x0) * (y1 - y0) * 4);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glPixelStorei(GL_UNPACK_SKIP_PIXELS, 0);
+    glPixelStorei(GL_UNPACK_SKIP_ROWS, 0);
+}
+
+// --------------- Drawing helpers ---------------
+void drawClippingRect()
+{
+    if (headless && !canvasView) {
+        viewLine((float)xminC, (float)yminC, (float)xmaxC, (float)yminC, VIEW_YELLOW);
+        viewLine((float)xmaxC, (float)yminC, (float)xmaxC, (float)ymaxC, VIEW_YELLOW);
+        viewLine((float)xmaxC, (float)ymaxC, (float)xminC, (float)ymaxC, VIEW_YELLOW);
+        viewLine((float)xminC, (float)ymaxC, (float)xminC, (float)yminC, VIEW_YELLOW);
+        return;
+    }
+    glColor3ub(255, 210, 60); // yellow
+    glLineWidth(2.0f);
+    glBegin(GL_LINE_LOOP);
+    glVertex2i(xminC, yminC);
+    glVertex2i(xmaxC, yminC);
+    glVertex2i(xmaxC, ymaxC);
+    glVertex2i(xminC, ymaxC);
+    glEnd();
+    glLineWidth(1.0f);
+}
+
+// Transformed view: gray parts on screen and cyan parts in the clip window
+// both come out of the fused transform+clip stage as vertex arrays
+void drawTransformedSegments()
+{
+    static std::vector<std::vector<float> > onScreen, inClip;
+    syncScene();
+    Affine m = currentTransform();
+    auto t0 = std::chrono::steady_clock::now();
+    transformThreads = transformClip(segSoA, m, { 0, 0, winW - 1, winH - 1 }, onScreen);
+    transformClip(segSoA, m, { xminC, yminC, xmaxC, ymaxC }, inClip);
+    transformMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    size_t visible = 0;
+    for (const auto& v : inClip) visible += v.size() / 4;
+    metricAdd(M_SEGMENTS_CLIPPED, visible);
+    metricAdd(M_SEGMENTS_REJECTED, segments.size() - std::min(segments.size(), visible));
+
+    if (headless) {
+        for (const auto& v : onScreen)
+            for (size_t k = 0; k + 3 < v.size(); k += 4) viewLine(v[k], v[k + 1], v[k + 2], v[k + 3], CANVAS_GRAY);
+        for (const auto& v : inClip)
+            for (size_t k = 0; k + 3 < v.size(); k += 4) viewLine(v[k], v[k + 1], v[k + 2], v[k + 3], CANVAS_CYAN);
+        return;
+    }
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glColor3ub(140, 140, 150);
+    for (const auto& v : onScreen) {
+        glVertexPointer(2, GL_FLOAT, 0, v.data());
+        glDrawArrays(GL_LINES, 0, (GLsizei)(v.size() / 2));
+    }
+    glColor3ub(90, 240, 255);
+    glLineWidth(2.0f);
+    for (const auto& v : inClip) {
+        glVertexPointer(2, GL_FLOAT, 0, v.data());
+        glDrawArrays(GL_LINES, 0, (GLsizei)(v.size() / 2));
+    }
+    glLineWidth(1.0f);
+    glDisableClientState(GL_VERTEX_ARRAY);
+}
+
+void drawSegments()
+{
+    if (animTransform) { drawTransformedSegments(); return; }
+
+    // Original segments (gray)
+    glColor3ub(140, 140, 150);
+    glBegin(GL_LINES);
+    segments.forEach([](uint32_t, const Seg& s) {
+        if (headless) rasterSegmentInRect(s, { 0, 0, winW - 1, winH - 1 }, CANVAS_GRAY, viewTarget.data(), winW);
+        else { glVertex2i(s.a.x, s.a.y); glVertex2i(s.b.x, s.b.y); }
+    });
+    glEnd();
+
+    // Clipped visible parts (cyan); the BVH hands out segments fully inside
+    // the window unclipped and only the boundary ones go through Liang-Barsky
+    // (boundary segments are batched through the autotuned clip kernel)
+    syncScene();
+    glColor3ub(90, 240, 255);
+    glLineWidth(2.0f);
+    glBegin(GL_LINES);
+    Box clip = { xminC, yminC, xmaxC, ymaxC };
+    static std::vector<Seg> boundary;
+    static std::vector<float> clipped;
+    boundary.clear();
+    clipped.clear();
+    size_t inside = 0;
+    auto accept = [&inside](uint32_t i) {
+        const Seg& s = segments.seg[i];
+        if (headless) rasterSegmentInRect(s, { 0, 0, winW - 1, winH - 1 }, CANVAS_CYAN, viewTarget.data(), winW);
+        else { glVertex2i(s.a.x, s.a.y); glVertex2i(s.b.x, s.b.y); }
+        ++inside;
+    };
+    if (kineticMode) {
+        kinetic.update(segments, clip, scrubAlongX);
+        for (uint32_t i : kinetic.visible)
+            if (kinetic.status[i] == KineticClip::INSIDE) accept(i);
+            else boundary.push_back(segments.seg[i]);
+    } else {
+        segIndex.query(segments, clip, accept, [](uint32_t i) { boundary.push_back(segments.seg[i]); });
+    }
+    tuner.clipBatch(boundary.data(), boundary.size(), clip, clipped);
+    metricAdd(M_SEGMENTS_ACCEPTED, inside);
+    metricAdd(M_SEGMENTS_CLIPPED, clipped.size() / 4);
+    metricAdd(M_SEGMENTS_REJECTED, boundary.size() - clipped.size() / 4);
+    for (size_t k = 0; k + 3 < clipped.size(); k += 4)
+        viewLine(clipped[k], clipped[k + 1], clipped[k + 2], clipped[k + 3], CANVAS_CYAN);
+    glEnd();
+    glLineWidth(1.0f);
+}
+
+// Batched churn: move a quarter of the segments a few pixels, delete a few
+// and add replacements (exercises handles, free list and BVH refits)
+void jitterSegments()
+{
+    std::vector<std::pair<SegHandle, Seg> > edits;
+    std::vector<SegHandle> dead;
+    segments.forEach([&](uint32_t i, const Seg& s) {
+        int r = rand() % 100;
+        if (r < 25) {
+            Seg m = s;
+            int dx = rand() % 7 - 3, dy = rand() % 7 - 3;
+            m.a.x += dx; m.b.x += dx; m.a.y += dy; m.b.y += dy;
+            edits.push_back({ segments.handleOf(i), m });
+        } else if (r < 28) {
+            dead.push_back(segments.handleOf(i));
+        }
+    });
+    segments.updateBatch(edits);
+    segments.removeBatch(dead);
+    for (size_t k = 0; k < dead.size(); ++k) {
+        Seg s;
+        s.a.x = rand() % winW; s.a.y = rand() % winH;
+        s.b.x = rand() % winW; s.b.y = rand() % winH;
+        segments.add(s);
+    }
+}
+
+void hudText(int x, int y, const char* s)
+{
+    glRasterPos2i(x, y);
+    if (headless) return;
+    for (const char* p = s; *p; ++p) glutBitmapCharacter(GLUT_BITMAP_8_BY_13, *p);
 }
 
 void drawHUD()
 {
     // Simple text instructions (optional)
     glColor3ub(220, 220, 220);
-    glRasterPos2i(10, winH - 20);
-    const char* s1 = "Left click: first point | Right click: second point (add segment)";
-    for (const char* p = s1; *p; ++p) glutBitmapCharacter(GLUT_BITMAP_8_BY_13, *p);
+    hudText(10, winH - 20, "Left click: first point | Right click: second point (add segment)");
+    hudText(10, winH - 38, "W/S/A/D: move clip window | Arrow keys: resize | R: randomize | C: clear | Q/Esc: quit");
+    hudText(10, winH - 56, "Middle click: delete nearest segment | J: jitter (batched edits) | V: canvas view | Z/X: zoom out/in | Shift+Arrows: pan | N: scatter 50k | T: animate transform | K: bake it | M: dump metrics | G: kinetic scrub | P: producers | L: glow, 9/0: radius");
+
+    // Clip window summary from the BVH aggregates
+    syncScene();
+    ClipStats cs = segIndex.aggregate(segments, { xminC, yminC, xmaxC, ymaxC });
+    char buf[256];
+    std::snprintf(buf, sizeof(buf), "Segments: %zu | visible: %zu (inside: %zu, clipped: %zu) | visible length: %.1f",
+                  segments.size(), cs.visible, cs.inside, cs.clipped, cs.length);
+    glColor3ub(255, 210, 60);
+    hudText(10, winH - 74, buf);
+    hudText(10, winH - 92, tuner.describe().c_str());
+
+    if (glow.mode != GLOW_OFF && canvasView && zoomLevel == 0) {
+        std::snprintf(buf, sizeof(buf), "Glow: %s, radius %d x %d passes | %.2f ms, %lld px reblurred",
+                      GLOW_NAMES[glow.mode], glow.radius, glow.passes(), glow.ms, glow.pxBlurred);
+        hudText(10, winH - 110, buf);
+    }
+    if (animTransform && !canvasView) {
+        std::snprintf(buf, sizeof(buf), "Transform+clip: %.2f ms over %zu slots (%d threads)",
+                      transformMs, segSoA.size(), transformThreads);
+        hudText(10, winH - 110, buf);
+    }
+    if (kineticMode && !canvasView) {
+        std::snprintf(buf, sizeof(buf), "Kinetic scrub along %s: %zu events, %zu crossed by the last move | visible %zu (inside %zu) | rebuilds %zu",
+                      kinetic.alongX ? "x" : "y", kinetic.events.size(), kinetic.crossed,
+                      kinetic.visible.size(), kinetic.inside, kinetic.rebuilds);
+        hudText(10, winH - 128, buf);
+    }
+    if (!producers.empty() || ingestConsumed) {
+        std::snprintf(buf, sizeof(buf), "Ingest: %zu producers | appended %llu, published %llu, consumed %llu | chunks live %zu, freed %zu",
+                      producers.size(), (unsigned long long)std::min<uint64_t>(ingestLog.reserved.load(), (uint64_t)SegmentLog::MAX_CHUNKS << SegmentLog::CHUNK_BITS),
+                      (unsigned long long)ingestLog.published.load(), (unsigned long long)ingestConsumed,
+                      ingestLog.liveChunks(), ingestLog.freedChunks);
+        hudText(10, winH - 146, buf);
+    }
+    if (recorder.active()) hudText(10, winH - 164, recorder.describe().c_str());
+}
+
+// Keeps frames coming while producers run
+void ingestTick(int)
+{
+    if (producers.empty()) return;
+    glutPostRedisplay();
+    glutTimerFunc(33, ingestTick, 0);
+}
 
-    glRasterPos2i(10, winH - 38);
-    const char* s2 = "W/S/A/D: move clip window | Arrow keys: resize | R: randomize | C: clear | Q/Esc: quit";
-    for (const char* p = s2; *p; ++p) glutBitmapCharacter(GLUT_BITMAP_8_BY_13, *p);
+void animTick(int gen)
+{
+    if (gen != animGen || !animTransform) return;
+    animAngle += 0.02f;
+    glutPostRedisplay();
+    glutTimerFunc(16, animTick, gen);
 }
 
 // --------------- GLUT callbacks ---------------
 void display()
 {
+    auto t0 = std::chrono::steady_clock::now();
     glClear(GL_COLOR_BUFFER_BIT);
 
-    drawClippingRect();
-    drawSegments();
+    if (canvasView) {
+        syncScene();
+        drawCanvas();
+        float sc = 1.0f / (float)(1 << zoomLevel);
+        glPushMatrix();
+        glScalef(sc, sc, 1.0f);
+        glTranslatef((float)-panView.ox, (float)-panView.oy, 0.0f);
+        drawClippingRect();
+        glPopMatrix();
+    } else {
+        if (headless) viewTarget.assign((size_t)winW * winH, CANVAS_BG);
+        drawClippingRect();
+        drawSegments();
+        stageUpload(viewTarget.data(), winW, winH, winW);
+    }
     drawHUD();
 
-    glutSwapBuffers();
+    // The export, the stream and the recorder always carry the 1:1 pan
+    // view, whatever is on screen
+    if (frameExport.active() || frameStream.active() || recorder.active()) {
+        if (!canvasView || zoomLevel != 0) {
+            syncScene();
+            panView.render(segments, segIndex, { xminC, yminC, xmaxC, ymaxC });
+        }
+        frameExport.publish();
+        frameStream.publish(panView.px);
+        recorder.push(panView.px, panView.w, panView.h, panView.w, true);
+    }
+
+    if (!headless) glutSwapBuffers();
+    metricAdd(M_FRAMES);
+    metricObserve(H_FRAME_MS, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count());
+}
+
+// SIGUSR1 only sets a flag; the dump happens here, on the GLUT thread
+void metricsPoll(int)
+{
+    if (metricsRequested) dumpMetrics();
+    glutTimerFunc(200, metricsPoll, 0);
+}
+
+// Acks arrive between frames; serve them without waiting for a redraw
+void streamPoll(int)
+{
+    frameStream.pump();
+    glutTimerFunc(4, streamPoll, 0);
 }
 
 void reshape(int w, int h)
@@ -141,6 +3860,8 @@ void reshape(int w, int h)
     glMatrixMode(GL_MODELVIEW);
     glLoadIdentity();
 
+    panView.resize(winW, winH);
+
     // Keep the clipping rect inside the window bounds
     xminC = clampi(xminC, 0, winW - 1);
     xmaxC = clampi(xmaxC, 0, winW - 1);
@@ -155,19 +3876,41 @@ void keyboard(unsigned char key, int, int)
 {
     const int stepMove = 10;
     switch (key) {
+        // Concurrent producers appending to the ingest log
+        case 'p': case 'P':
+            if (producers.empty()) { startProducers(4, winW, winH); glutTimerFunc(33, ingestTick, 0); }
+            else stopProducers();
+            break;
+
+        // Glow over the cyan segments in the pan view: off / box / gaussian, 9/0 radius
+        case 'l': case 'L':
+            glow.mode = (GlowMode)((glow.mode + 1) % GLOW_MODES);
+            glow.markAll();
+            break;
+        case '9': case '0':
+            glow.radius = clampi(glow.radius + (key == '0' ? 1 : -1), 1, 64);
+            glow.markAll();
+            break;
+
         case 27: case 'q': case 'Q':
             std::exit(0);
             break;
 
         // Move clipping window (WASD)
         case 'w': case 'W':
-            yminC += stepMove; ymaxC += stepMove; break;
+            yminC += stepMove; ymaxC += stepMove; scrubAlongX = false; break;
         case 's': case 'S':
-            yminC -= stepMove; ymaxC -= stepMove; break;
+            yminC -= stepMove; ymaxC -= stepMove; scrubAlongX = false; break;
         case 'a': case 'A':
-            xminC -= stepMove; xmaxC -= stepMove; break;
+            xminC -= stepMove; xmaxC -= stepMove; scrubAlongX = true; break;
         case 'd': case 'D':
-            xminC += stepMove; xmaxC += stepMove; break;
+            xminC += stepMove; xmaxC += stepMove; scrubAlongX = true; break;
+
+        // Kinetic scrubbing: clip status changes are precomputed per axis
+        case 'g': case 'G':
+            kineticMode = !kineticMode;
+            kinetic.stale = true;
+            break;
 
         // Random segments
         case 'r': case 'R':
@@ -177,11 +3920,56 @@ void keyboard(unsigned char key, int, int)
                 Seg s;
                 s.a.x = rand() % winW; s.a.y = rand() % winH;
                 s.b.x = rand() % winW; s.b.y = rand() % winH;
-                segments.push_back(s);
+                segments.add(s);
             }
             break;
         }
 
+        case 'j': case 'J':
+            jitterSegments();
+            break;
+
+        // Software canvas view + pyramid zoom
+        case 'v': case 'V':
+            canvasView = !canvasView;
+            if (!canvasView) zoomLevel = 0;
+            break;
+        case 'z': case 'Z':
+            if (canvasView) zoomLevel = std::min(zoomLevel + 1, (int)canvas.level.size() - 1);
+            break;
+        case 'x': case 'X':
+            zoomLevel = std::max(zoomLevel - 1, 0);
+            break;
+
+        // Scatter many short segments over the whole canvas
+        case 'n': case 'N':
+            for (int i = 0; i < 50000; ++i) {
+                Seg s;
+                s.a.x = rand() % canvas.w; s.a.y = rand() % canvas.h;
+                s.b.x = clampi(s.a.x + rand() % 81 - 40, 0, canvas.w - 1);
+                s.b.y = clampi(s.a.y + rand() % 81 - 40, 0, canvas.h - 1);
+                segments.add(s);
+            }
+            break;
+
+        // Animated affine transform of the whole set; K makes it permanent
+        case 't': case 'T':
+            animTransform = !animTransform;
+            if (animTransform) glutTimerFunc(16, animTick, ++animGen);
+            break;
+        case 'm': case 'M':
+            dumpMetrics();
+            break;
+
+        case 'k': case 'K':
+            if (animTransform) {
+                syncScene();
+                bakeTransform(segments, segSoA, currentTransform());
+                animTransform = false;
+                animAngle = 0.0f;
+            }
+            break;
+
         // Clear segments
         case 'c': case 'C':
             segments.clear();
@@ -202,6 +3990,54 @@ void keyboard(unsigned char key, int, int)
 
 void special(int key, int, int)
 {
+    // Shift+arrows pan the canvas view (scroll-blit)
+    if (canvasView && (glutGetModifiers() & GLUT_ACTIVE_SHIFT)) {
+        const int stepPan = 8 << zoomLevel;
+        switch (key) {
+            case GLUT_KEY_LEFT:  panView.pan(-stepPan, 0); break;
+            case GLUT_KEY_RIGHT: panView.pan( stepPan, 0); break;
+            case GLUT_KEY_DOWN:  panView.pan(0, -stepPan); break;
+            case GLUT_KEY_UP:    panView.pan(0,  stepPan); break;
+        }
+        glutPostRedisplay();
+        return;
+    }
+
+    // F4 saves the 1:1 pan view as a PNG
+    if (key == GLUT_KEY_F4) {
+        syncScene();
+        panView.render(segments, segIndex, { xminC, yminC, xmaxC, ymaxC });
+        bool ok = savePng(SNAPSHOT_PATH, panView.px, panView.w, panView.h, panView.w, true,
+                          (int)std::max(1u, std::thread::hardware_concurrency()), PNG_FAST);
+        std::printf("%s %s\n", ok ? "saved" : "could not save", SNAPSHOT_PATH);
+        return;
+    }
+
+    // F2 / F3 save / load the scene as packed blocks
+    if (key == GLUT_KEY_F2 || key == GLUT_KEY_F3) {
+        PackedSegments packed;
+        if (key == GLUT_KEY_F2) {
+            std::vector<Seg> all;
+            all.reserve(segments.size());
+            segments.forEach([&](uint32_t, const Seg& sg) { all.push_back(sg); });
+            packed.append(all);
+            bool ok = packed.save(PACKED_PATH);
+            std::printf("%s %s: %llu segments, %zu blocks, %.2f bytes/segment\n", ok ? "saved" : "could not save",
+                        PACKED_PATH, (unsigned long long)packed.count, packed.blocks(),
+                        packed.count ? packed.bytes() / (double)packed.count : 0.0);
+        } else if (packed.load(PACKED_PATH)) {
+            segments.clear();
+            std::vector<Seg> buf(PACK_BLOCK);
+            for (size_t k = 0; k < packed.blocks(); ++k)
+                for (int i = 0, n = packed.decode(k, buf.data()); i < n; ++i) segments.add(buf[i]);
+            std::printf("loaded %s: %llu segments\n", PACKED_PATH, (unsigned long long)packed.count);
+        } else {
+            std::printf("could not load %s\n", PACKED_PATH);
+        }
+        glutPostRedisplay();
+        return;
+    }
+
     // Resize clipping window with arrow keys
     const int stepResize = 8;
     switch (key) {
@@ -226,8 +4062,8 @@ void mouse(int button, int state, int x, int y)
 {
     if (state != GLUT_DOWN) return;
 
-    int gx = clampi(x, 0, winW - 1);
-    int gy = clampi(toGLY(y), 0, winH - 1);
+    int gx = screenToWorldX(clampi(x, 0, winW - 1));
+    int gy = screenToWorldY(clampi(toGLY(y), 0, winH - 1));
 
     if (button == GLUT_LEFT_BUTTON) {
         firstPt = {gx, gy};
@@ -235,9 +4071,12 @@ void mouse(int button, int state, int x, int y)
     } else if (button == GLUT_RIGHT_BUTTON) {
         if (haveFirst) {
             Seg s; s.a = firstPt; s.b = {gx, gy};
-            segments.push_back(s);
+            segments.add(s);
             haveFirst = false;
         }
+    } else if (button == GLUT_MIDDLE_BUTTON) {
+        syncScene();
+        segments.remove(segIndex.pick(segments, (float)gx, (float)gy, (float)(12 << (canvasView ? zoomLevel : 0))));
     }
 
     glutPostRedisplay();
@@ -250,19 +4089,1241 @@ void initGL()
     glDisable(GL_LINE_SMOOTH);
     glDisable(GL_POINT_SMOOTH);
     std::srand((unsigned)std::time(nullptr));
+    canvas.resize(CANVAS_SIZE, CANVAS_SIZE);
 
     // Seed with some example segments
     for (int i = 0; i < 10; ++i) {
         Seg s;
         s.a.x = 30 + i * 80; s.a.y = 20 + (i % 2 ? 480 : 80);
         s.b.x = 850 - i * 60; s.b.y = 550 - (i % 2 ? 450 : 120);
-        segments.push_back(s);
+        segments.add(s);
+    }
+}
+
+// --------------- Out-of-core poster export ---------------
+// Renders a random segment dataset into a W x H binary PPM far larger than
+// RAM: segments are binned by horizontal strip (CSR arrays), worker threads
+// rasterize one strip at a time into a small buffer and write it straight
+// to its offset in the file. Memory is segments + bins + one strip per thread.
+// With "packed" the dataset is held as packed blocks (generated and encoded a
+// batch at a time) and binned per block; with a .segp path it is loaded from
+// that file instead of generated. Workers decode the blocks of their strip.
+// Usage: --poster out.ppm width height segments [threads] [stripHeight] [packed|file.segp]
+
+inline bool seekFile(FILE* f, long long off)
+{
+#ifdef _WIN32
+    return _fseeki64(f, off, SEEK_SET) == 0;
+#else
+    return fseeko(f, (off_t)off, SEEK_SET) == 0;
+#endif
+}
+
+// Peak resident set size in MB (0 where unsupported)
+double peakRssMB()
+{
+#ifndef _WIN32
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    #ifdef __APPLE__
+        return ru.ru_maxrss / (1024.0 * 1024.0);
+    #else
+        return ru.ru_maxrss / 1024.0;
+    #endif
+#else
+    return 0.0;
+#endif
+}
+
+int posterMain(int argc, char** argv)
+{
+    if (argc < 6) {
+        std::fprintf(stderr, "usage: %s --poster out.ppm width height segments [threads] [stripHeight] [packed|file.segp]\n", argv[0]);
+        return 1;
+    }
+    const char* path = argv[2];
+    int W = std::atoi(argv[3]), H = std::atoi(argv[4]);
+    long long N = std::atoll(argv[5]);
+    unsigned hw = std::max(1u, std::thread::hardware_concurrency());
+    int threads = argc > 6 ? std::max(1, std::atoi(argv[6])) : (int)hw;
+    int stripH  = argc > 7 ? std::max(1, std::atoi(argv[7])) : 64;
+    const char* source = argc > 8 ? argv[8] : nullptr;
+    bool usePacked = source != nullptr;
+    if (W <= 0 || H <= 0 || N < 0) { std::fprintf(stderr, "bad poster size\n"); return 1; }
+
+    auto t0 = std::chrono::steady_clock::now();
+
+    // Dataset: short random segments over the whole poster (lengths ~1% of it)
+    std::vector<Seg> data;
+    PackedSegments packed;
+    if (usePacked && std::strcmp(source, "packed") != 0) {
+        if (!packed.load(source)) { std::fprintf(stderr, "could not load %s\n", source); return 1; }
+        N = (long long)packed.count;
+    } else {
+        unsigned rng = 20251024u;
+        auto rnd = [&rng]() { rng = rng * 1664525u + 1013904223u; return rng >> 8; };
+        int spanX = std::max(2, W / 100), spanY = std::max(2, H / 100);
+        const long long BATCH = usePacked ? 1 << 20 : N;
+        for (long long done = 0; done < N; done += BATCH) {
+            data.resize((size_t)std::min(BATCH, N - done));
+            for (Seg& s : data) {
+                s.a.x = (int)(rnd() % (unsigned)W); s.a.y = (int)(rnd() % (unsigned)H);
+                s.b.x = clampi(s.a.x + (int)(rnd() % (unsigned)spanX) - spanX / 2, 0, W - 1);
+                s.b.y = clampi(s.a.y + (int)(rnd() % (unsigned)spanY) - spanY / 2, 0, H - 1);
+            }
+            if (usePacked) packed.append(data);
+        }
+        if (usePacked) std::vector<Seg>().swap(data);
+    }
+    Box clip = { W / 4, H / 4, W - W / 4, H - H / 4 };
+
+    // Bin by strip: count, prefix sum, fill. Packed data is binned per block.
+    int strips = (H + stripH - 1) / stripH;
+    size_t items = usePacked ? packed.blocks() : data.size();
+    auto itemRows = [&](size_t i, int& lo, int& hi) {
+        if (usePacked) { const Box& b = packed.header(i).box; lo = b.y0; hi = b.y1; }
+        else { lo = std::min(data[i].a.y, data[i].b.y); hi = std::max(data[i].a.y, data[i].b.y); }
+        lo = clampi(lo, 0, H - 1) / stripH; hi = clampi(hi, 0, H - 1) / stripH;
+    };
+    std::vector<long long> binStart((size_t)strips + 1, 0);
+    for (size_t i = 0; i < items; ++i) {
+        int lo, hi;
+        itemRows(i, lo, hi);
+        for (int k = lo; k <= hi; ++k) binStart[k + 1]++;
+    }
+    for (int k = 0; k < strips; ++k) binStart[k + 1] += binStart[k];
+    std::vector<uint32_t> bins((size_t)binStart[strips]);
+    {
+        std::vector<long long> fill(binStart.begin(), binStart.end() - 1);
+        for (size_t i = 0; i < items; ++i) {
+            int lo, hi;
+            itemRows(i, lo, hi);
+            for (int k = lo; k <= hi; ++k) bins[(size_t)fill[k]++] = (uint32_t)i;
+        }
+    }
+    auto t1 = std::chrono::steady_clock::now();
+
+    // PPM: header, then size the file so workers can write strips in any
+    // order. PNG: strips are taken top-down and each becomes one IDAT block;
+    // finished blocks are written in order as soon as their predecessors are.
+    size_t pathLen = std::strlen(path);
+    bool png = pathLen > 4 && std::strcmp(path + pathLen - 4, ".png") == 0;
+    FILE* f = std::fopen(path, "wb");
+    if (!f) { std::perror(path); return 1; }
+    char header[64];
+    int headerLen = 0;
+    long long fileSize = 3LL * W * H;
+    std::vector<PngBlock> pngDone;
+    std::vector<uint8_t> pngReady;
+    int pngNext = 0;
+    uint32_t pngAdler = 1;
+    std::mutex pngLock;
+    if (png) {
+        std::vector<uint8_t> head = pngHeader(W, H);
+        std::fwrite(head.data(), 1, head.size(), f);
+        pngDone.resize((size_t)strips);
+        pngReady.assign((size_t)strips, 0);
+    } else {
+        headerLen = std::snprintf(header, sizeof(header), "P6\n%d %d\n255\n", W, H);
+        std::fwrite(header, 1, headerLen, f);
+        fileSize += headerLen;
+        if (!seekFile(f, fileSize - 1) || std::fputc(0, f) == EOF) { std::perror(path); std::fclose(f); return 1; }
+        std::fclose(f);
+    }
+
+    std::atomic<int> nextStrip(0);
+    std::atomic<bool> failed(false);
+    auto worker = [&]() {
+        FILE* out = png ? nullptr : std::fopen(path, "r+b");
+        if (!png && !out) { failed = true; return; }
+        std::vector<uint32_t> px((size_t)W * stripH);
+        std::vector<unsigned char> rgb((size_t)W * stripH * 3);
+        std::vector<Seg> decoded;
+        for (int j; (j = nextStrip++) < strips; ) {
+            int k = strips - 1 - j;     // top strip first
+            int y0 = k * stripH, y1 = std::min(H, y0 + stripH) - 1, rows = y1 - y0 + 1;
+            std::fill(px.begin(), px.begin() + (size_t)W * rows, CANVAS_BG);
+            Box strip = { 0, 0, W - 1, rows - 1 };
+            Box vis = { clip.x0, std::max(clip.y0, y0) - y0, clip.x1, std::min(clip.y1, y1) - y0 };
+            long long first = binStart[k], last = binStart[k + 1];
+            if (usePacked) {
+                decoded.resize((size_t)(last - first) * PACK_BLOCK);
+                size_t n = 0;
+                for (long long b = first; b < last; ++b) n += packed.decode(bins[(size_t)b], &decoded[n]);
+                decoded.resize(n);
+                first = 0; last = (long long)n;
+            }
+            long long plotted = 0;
+            for (int pass = 0; pass < 2; ++pass) {
+                if (pass == 1 && vis.y0 > vis.y1) break;
+                for (long long b = first; b < last; ++b) {
+                    Seg s = usePacked ? decoded[(size_t)b] : data[bins[(size_t)b]];
+                    s.a.y -= y0; s.b.y -= y0;
+                    plotted += rasterSegmentInRect(s, pass ? vis : strip, pass ? CANVAS_CYAN : CANVAS_GRAY, px.data(), W);
+                }
+            }
+            metricAdd(M_PIXELS_PLOTTED, (uint64_t)plotted);
+            metricAdd(M_POSTER_STRIPS);
+            if (png) {
+                PngBlock blk;
+                auto rowAt = [&](int r) { return &px[(size_t)(rows - 1 - r) * W]; };
+                encodePngBlock(rowAt, W, 0, rows, PNG_FAST, j == 0, j == strips - 1, blk);
+                blk.chunk.shrink_to_fit();
+                std::lock_guard<std::mutex> g(pngLock);
+                pngDone[j] = std::move(blk);
+                pngReady[j] = 1;
+                for (; pngNext < strips && pngReady[pngNext]; ++pngNext) {
+                    PngBlock& b = pngDone[pngNext];
+                    if (std::fwrite(b.chunk.data(), 1, b.chunk.size(), f) != b.chunk.size()) failed = true;
+                    pngAdler = adler32Combine(pngAdler, b.adler, b.filtered);
+                    std::vector<uint8_t>().swap(b.chunk);
+                }
+                continue;
+            }
+            // PPM rows run top-down: strip row r goes to file row H-1-(y0+r)
+            for (int r = 0; r < rows; ++r) {
+                const uint32_t* src = &px[(size_t)r * W];
+                unsigned char* dst = &rgb[(size_t)(rows - 1 - r) * W * 3];
+                for (int x = 0; x < W; ++x) {
+                    dst[3 * x]     = (unsigned char)(src[x]);
+                    dst[3 * x + 1] = (unsigned char)(src[x] >> 8);
+                    dst[3 * x + 2] = (unsigned char)(src[x] >> 16);
+                }
+            }
+            long long off = headerLen + 3LL * W * (H - 1 - y1);
+            if (!seekFile(out, off) || std::fwrite(rgb.data(), 1, (size_t)W * rows * 3, out) != (size_t)W * rows * 3)
+                failed = true;
+        }
+        if (out) std::fclose(out);
+    };
+    std::vector<std::thread> pool;
+    for (int t = 0; t < threads; ++t) pool.emplace_back(worker);
+    for (auto& t : pool) t.join();
+    long long pngSize = 0;
+    if (png) {
+        std::vector<uint8_t> tail = pngTrailer(pngAdler);
+        if (std::fwrite(tail.data(), 1, tail.size(), f) != tail.size()) failed = true;
+        pngSize = (long long)std::ftell(f);
+        if (std::fclose(f) != 0) failed = true;
+    }
+    auto t2 = std::chrono::steady_clock::now();
+
+    double binMs    = std::chrono::duration<double, std::milli>(t1 - t0).count();
+    double renderMs = std::chrono::duration<double, std::milli>(t2 - t1).count();
+    std::printf("poster %dx%d, %lld segments, %d strips of %d rows, %d threads\n", W, H, N, strips, stripH, threads);
+    std::printf("  generate+bin: %.1f ms (%lld bin entries)\n", binMs, binStart[strips]);
+    if (usePacked)
+        std::printf("  packed: %zu blocks, %.2f bytes/segment\n", packed.blocks(), N ? packed.bytes() / (double)N : 0.0);
+    std::printf("  render+write: %.1f ms (%.1f MB/s)\n", renderMs, fileSize / (1024.0 * 1024.0) / (renderMs / 1000.0));
+    std::printf("  peak RSS: %.1f MB (image: %.1f MB)\n", peakRssMB(), fileSize / (1024.0 * 1024.0));
+    if (png) std::printf("  png: %.2f MB (%.1f%% of raw RGB)\n", pngSize / (1024.0 * 1024.0), 100.0 * pngSize / (3.0 * W * H));
+    if (metricsPath || metricsRequested) dumpMetrics();
+    if (failed) { std::fprintf(stderr, "write to %s failed\n", path); return 1; }
+    return 0;
+}
+
+// --------------- Headless benchmark ---------------
+// Canonical scenes run through display() without a window; the GL view is
+// rasterized into viewTarget in software (see viewLine). Per frame the clip window drifts, and the
+// mixed scenes also pan, edit segments or animate the transform; reports the
+// frame time distribution and memory of each scene.
+// Usage: --bench [frames] [maxSegments]   (larger scenes are skipped)
+
+void reportFrames(const char* scene, std::vector<double>& ms)
+{
+    std::sort(ms.begin(), ms.end());
+    double sum = 0;
+    for (double v : ms) sum += v;
+    auto pct = [&](double p) { return ms[std::min(ms.size() - 1, (size_t)(p * ms.size()))]; };
+    std::printf("%-36s %5zu frames  mean %8.3f  p50 %8.3f  p90 %8.3f  p99 %8.3f  max %8.3f ms  peak RSS %8.1f MB\n",
+                scene, ms.size(), sum / ms.size(), pct(0.5), pct(0.9), pct(0.99), ms.back(), peakRssMB());
+}
+
+int benchMain(int argc, char** argv)
+{
+    int frames = argc > 2 ? std::max(1, std::atoi(argv[2])) : 60;
+    long long maxSegments = argc > 3 ? std::atoll(argv[3]) : 1000000;
+    headless = true;
+    canvas.resize(CANVAS_SIZE, CANVAS_SIZE);
+    reshape(winW, winH);
+
+    enum Extra { NONE, PAN, JITTER, TRANSFORM, ZOOM };
+    struct Scene { const char* name; long long segs; bool canvasView; Extra extra; };
+    const Scene scenes[] = {
+        { "1e3 segments",                      1000LL,      false, NONE      },
+        { "1e6 segments",                      1000000LL,   false, NONE      },
+        { "1e8 segments",                      100000000LL, false, NONE      },
+        { "mixed: 1e6 pan view + panning",     1000000LL,   true,  PAN       },
+        { "mixed: 1e5 canvas 1:4 + jitter",    100000LL,    true,  ZOOM      },
+        { "mixed: 1e5 GL + jitter",            100000LL,    false, JITTER    },
+        { "mixed: 1e6 animated transform",     1000000LL,   false, TRANSFORM },
+    };
+    std::printf("%dx%d, %d frames per scene (after 3 warm-up frames), up to %lld segments\n",
+                winW, winH, frames, maxSegments);
+    double bytesPerSegment = 0;
+    for (const Scene& sc : scenes) {
+        if (sc.segs > maxSegments) {
+            // The estimate comes from the 1M+ scenes already run; none yet, no estimate
+            char need[32] = "unknown memory";
+            if (bytesPerSegment > 0)
+                std::snprintf(need, sizeof(need), "~%.1f GB", bytesPerSegment * sc.segs / (1024.0 * 1024.0 * 1024.0));
+            std::printf("%-36s skipped: needs %s (pass maxSegments >= %lld)\n", sc.name, need, sc.segs);
+            continue;
+        }
+        double rssBefore = peakRssMB();
+        segments.clear();
+        std::srand(20251024u);
+        for (long long i = 0; i < sc.segs; ++i) {
+            Seg s;
+            s.a.x = rand() % canvas.w; s.a.y = rand() % canvas.h;
+            s.b.x = clampi(s.a.x + rand() % 81 - 40, 0, canvas.w - 1);
+            s.b.y = clampi(s.a.y + rand() % 81 - 40, 0, canvas.h - 1);
+            segments.add(s);
+        }
+        canvasView = sc.canvasView;
+        zoomLevel = sc.extra == ZOOM ? 2 : 0;
+        animTransform = sc.extra == TRANSFORM;
+        animAngle = 0.0f;
+        panView.ox = panView.oy = 0;
+        panView.markDirty({ INT_MIN / 2, INT_MIN / 2, INT_MAX / 2, INT_MAX / 2 });
+        xminC = 200; yminC = 150; xmaxC = 700; ymaxC = 450;
+
+        std::vector<double> ms;
+        int dx = 3, dy = 2;
+        for (int f = -3; f < frames; ++f) {
+            auto t0 = std::chrono::steady_clock::now();
+            if (sc.extra == JITTER || sc.extra == ZOOM) jitterSegments();
+            if (sc.extra == PAN) panView.pan(8, 3);
+            display();
+            double dt = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+            if (f >= 0) ms.push_back(dt);
+            if (metricsRequested) dumpMetrics();
+
+            if (xminC + dx < 0 || xmaxC + dx > winW - 1) dx = -dx;
+            if (yminC + dy < 0 || ymaxC + dy > winH - 1) dy = -dy;
+            xminC += dx; xmaxC += dx; yminC += dy; ymaxC += dy;
+            animAngle += 0.02f;
+        }
+        reportFrames(sc.name, ms);
+        if (sc.segs >= 1000000)
+            bytesPerSegment = std::max(bytesPerSegment, (peakRssMB() - rssBefore) * 1024.0 * 1024.0 / sc.segs);
+    }
+    if (metricsPath) dumpMetrics();
+    return 0;
+}
+
+// --------------- Packed block benchmark ---------------
+// Encodes N random short segments over a 64k x 64k world, checks the decode
+// and file round trip, then times clipping the same Morton-sorted segments
+// from memory against the packed blocks for a large and a small window:
+// decoding to Segs and clipping those, the fused decodeClip over every
+// block (the like-for-like comparison with the raw clip), and the fused
+// path with blocks culled by their box. All paths must produce the same
+// output.
+// Usage: --packbench [segments]
+
+int packBenchMain(int argc, char** argv)
+{
+    long long N = argc > 2 ? std::max(1LL, std::atoll(argv[2])) : 4000000;
+    const int WORLD = 1 << 16;
+    std::vector<Seg> raw((size_t)N);
+    unsigned rng = 20251024u;
+    auto rnd = [&rng]() { rng = rng * 1664525u + 1013904223u; return rng >> 8; };
+    for (Seg& sg : raw) {
+        sg.a.x = (int)(rnd() % WORLD); sg.a.y = (int)(rnd() % WORLD);
+        sg.b.x = clampi(sg.a.x + (int)(rnd() % 257) - 128, 0, WORLD - 1);
+        sg.b.y = clampi(sg.a.y + (int)(rnd() % 257) - 128, 0, WORLD - 1);
+    }
+    auto ms = [](std::chrono::steady_clock::time_point t0) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    };
+
+    auto t0 = std::chrono::steady_clock::now();
+    PackedSegments packed;
+    std::vector<Seg> sorted(raw);
+    packed.append(sorted);
+    double encodeMs = ms(t0);
+
+    // Round trip: decoded blocks reproduce the sorted input, and so does the file
+    std::vector<Seg> buf(PACK_BLOCK);
+    size_t mismatches = 0, at = 0;
+    for (size_t k = 0; k < packed.blocks(); ++k)
+        for (int i = 0, n = packed.decode(k, buf.data()); i < n; ++i, ++at)
+            mismatches += std::memcmp(&buf[i], &sorted[at], sizeof(Seg)) != 0;
+    PackedSegments reloaded;
+    bool fileOk = packed.save("packbench.segp") && reloaded.load("packbench.segp") && reloaded.data == packed.data;
+    std::remove("packbench.segp");
+
+    std::printf("%lld segments: raw %.1f MB, packed %.1f MB (%.2f bytes/segment, %zu blocks), encode %.1f ms\n",
+                N, N * sizeof(Seg) / (1024.0 * 1024.0), packed.bytes() / (1024.0 * 1024.0),
+                packed.bytes() / (double)N, packed.blocks(), encodeMs);
+    std::printf("  round trip: %zu mismatches, file %s\n", mismatches, fileOk ? "ok" : "FAILED");
+
+    std::vector<float> out;
+    out.reserve((size_t)N * 4);
+    const Box windows[] = { { WORLD / 8, WORLD / 8, WORLD - WORLD / 8, WORLD - WORLD / 8 },
+                            { WORLD / 2, WORLD / 2, WORLD / 2 + 1023, WORLD / 2 + 767 } };
+    std::vector<float> rawOut;
+    bool same = true;
+    for (const Box& w : windows) {
+        // 0 raw clip, 1 decode to Segs then clip, 2 fused decodeClip over
+        // every block, 3 fused with blocks culled by their box
+        size_t visible[4];
+        double best[4] = { 1e30, 1e30, 1e30, 1e30 };
+        for (int rep = 0; rep < 3; ++rep) {
+            for (int mode = 0; mode < 4; ++mode) {
+                out.clear();
+                t0 = std::chrono::steady_clock::now();
+                if (mode == 0) {
+                    clipBatchWith(CK_OUTCODE, sorted.data(), sorted.size(), w, out);
+                } else if (mode == 1) {
+                    for (size_t k = 0; k < packed.blocks(); ++k)
+                        clipBatchWith(CK_OUTCODE, buf.data(), (size_t)packed.decode(k, buf.data()), w, out);
+                } else {
+                    for (size_t k = 0; k < packed.blocks(); ++k) {
+                        if (mode == 3 && boxDisjoint(packed.header(k).box, w)) continue;
+                        packed.decodeClip(k, w, out);
+                    }
+                }
+                best[mode] = std::min(best[mode], ms(t0));
+                visible[mode] = out.size() / 4;
+                if (mode == 0) rawOut = out;
+                else same = same && out == rawOut;
+            }
+        }
+        std::printf("  window %dx%d: raw clip %.2f ms, decode then clip %.2f ms, fused decode+clip %.2f ms, "
+                    "culled fused %.2f ms (%zu visible)\n",
+                    w.x1 - w.x0 + 1, w.y1 - w.y0 + 1, best[0], best[1], best[2], best[3], visible[0]);
+        std::printf("    fused decode+clip of every block is %.2fx the raw clip's speed\n", best[0] / best[2]);
+    }
+    std::printf("  clip output %s\n", same ? "identical on every path" : "DIFFERS between paths");
+    return mismatches == 0 && fileOk && same ? 0 : 1;
+}
+
+// --------------- Shared frame consumer ---------------
+// Maps an exported frame read-only and follows it: each new frame is read in
+// place under the seqlock (checksum + dirty tiles), torn reads are retried.
+// The last frame can be written out as a PPM, which is the only copy made.
+// Usage: --shm-view NAME [frames] [out.ppm]
+
+int shmViewMain(int argc, char** argv)
+{
+#ifndef _WIN32
+    if (argc < 3) { std::fprintf(stderr, "usage: %s --shm-view NAME [frames] [out.ppm]\n", argv[0]); return 1; }
+    std::string name = argv[2][0] == '/' ? argv[2] : std::string("/") + argv[2];
+    int frames = argc > 3 ? std::max(1, std::atoi(argv[3])) : 100;
+    const char* ppm = argc > 4 ? argv[4] : nullptr;
+    int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0) { std::perror(name.c_str()); return 1; }
+
+    size_t mapped = 0;
+    const void* base = nullptr;
+    auto remap = [&](size_t bytes) {
+        if (base) munmap((void*)base, mapped);
+        base = mmap(nullptr, bytes, PROT_READ, MAP_SHARED, fd, 0);
+        if (base == MAP_FAILED) { base = nullptr; mapped = 0; return false; }
+        mapped = bytes;
+        return true;
+    };
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < (size_t)SHM_HEADER_BYTES || !remap((size_t)st.st_size)) {
+        std::fprintf(stderr, "%s is not a shared frame\n", name.c_str());
+        return 1;
+    }
+    if (((const SharedFrameHeader*)base)->magic != SHM_MAGIC) { std::fprintf(stderr, "%s: bad magic\n", name.c_str()); return 1; }
+
+    std::vector<unsigned char> rgb;
+    uint64_t lastFrame = 0;
+    long long torn = 0;
+    int seen = 0;
+    auto idleSince = std::chrono::steady_clock::now();
+    while (seen < frames) {
+        const SharedFrameHeader* h = (const SharedFrameHeader*)base;
+        uint64_t s1 = h->seq.load(std::memory_order_acquire);
+        if ((s1 & 1) || h->frame == lastFrame) {
+            if (std::chrono::steady_clock::now() - idleSince > std::chrono::seconds(5)) break;
+            std::this_thread::sleep_for(std::chrono::microseconds(500));
+            continue;
+        }
+        if (h->mapBytes > mapped) { if (!remap((size_t)h->mapBytes)) return 1; continue; }
+
+        uint32_t w = h->width, hh = h->height, stride = h->stride;
+        uint64_t frame = h->frame, published = h->publishNs;
+        size_t dirtyTiles = 0, tiles = (size_t)h->tilesX * h->tilesY;
+        for (size_t b = 0; b < tiles; ++b) dirtyTiles += (h->dirty[b / 8] >> (b % 8)) & 1;
+        const uint32_t* px = (const uint32_t*)((const char*)base + h->headerBytes);
+        bool fits = h->headerBytes + (size_t)stride * hh * 4 <= mapped;
+        uint64_t sum = 0;
+        for (uint32_t y = 0; fits && y < hh; ++y)
+            for (uint32_t x = 0; x < w; ++x) sum = sum * 31 + px[(size_t)y * stride + x];
+        bool last = seen + 1 == frames;
+        if (fits && last && ppm) {
+            rgb.resize((size_t)w * hh * 3);
+            for (uint32_t y = 0; y < hh; ++y)
+                for (uint32_t x = 0; x < w; ++x) {
+                    uint32_t c = px[(size_t)(hh - 1 - y) * stride + x];
+                    unsigned char* d = &rgb[((size_t)y * w + x) * 3];
+                    d[0] = (unsigned char)c; d[1] = (unsigned char)(c >> 8); d[2] = (unsigned char)(c >> 16);
+                }
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (h->seq.load(std::memory_order_relaxed) != s1 || !fits) { ++torn; continue; }
+
+        std::printf("frame %llu  %ux%u  dirty %zu/%zu tiles  checksum %016llx  latency %.3f ms\n",
+                    (unsigned long long)frame, w, hh, dirtyTiles, tiles, (unsigned long long)sum,
+                    (steadyNs() - published) / 1e6);
+        lastFrame = frame;
+        ++seen;
+        idleSince = std::chrono::steady_clock::now();
+        if (last && ppm) {
+            FILE* f = std::fopen(ppm, "wb");
+            if (!f) { std::perror(ppm); return 1; }
+            std::fprintf(f, "P6\n%u %u\n255\n", w, hh);
+            std::fwrite(rgb.data(), 1, rgb.size(), f);
+            std::fclose(f);
+        }
+    }
+    std::printf("%d frames read, %lld torn reads retried\n", seen, torn);
+    munmap((void*)base, mapped);
+    ::close(fd);
+    return 0;
+#else
+    (void)argc; (void)argv;
+    std::fprintf(stderr, "--shm-view needs POSIX shared memory\n");
+    return 1;
+#endif
+}
+
+// --------------- Stream test client ---------------
+// Connects to --stream-sock, applies each delta to its own copy of the
+// frame, acks it and reports bytes, tiles and latency (publish -> applied)
+// per frame, then totals. delayMs sleeps before every ack to play a slow
+// client; the server then coalesces frames and the numbers show the gaps.
+// The checksum matches --shm-view's for the same frame.
+// Usage: --stream-view PATH [frames] [delayMs]
+
+bool readFully(int fd, void* dst, size_t n)
+{
+#ifndef _WIN32
+    for (size_t got = 0; got < n; ) {
+        ssize_t r = recv(fd, (char*)dst + got, n - got, 0);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return false;
+        got += (size_t)r;
+    }
+    return true;
+#else
+    (void)fd; (void)dst; (void)n;
+    return false;
+#endif
+}
+
+int streamViewMain(int argc, char** argv)
+{
+#ifndef _WIN32
+    if (argc < 3) { std::fprintf(stderr, "usage: %s --stream-view PATH [frames] [delayMs]\n", argv[0]); return 1; }
+    int frames = argc > 3 ? std::max(1, std::atoi(argv[3])) : 100;
+    int delayMs = argc > 4 ? std::max(0, std::atoi(argv[4])) : 0;
+    sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    std::strncpy(addr.sun_path, argv[2], sizeof(addr.sun_path) - 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (sockaddr*)&addr, sizeof(addr)) != 0) { std::perror(argv[2]); return 1; }
+
+    std::vector<uint32_t> fb;
+    std::vector<uint8_t> payload;
+    std::vector<double> latency;
+    uint32_t fw = 0, fh = 0;
+    uint64_t last = 0, totalBytes = 0, totalTiles = 0, skipped = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int n = 0; n < frames; ++n) {
+        StreamFrameHeader hdr;
+        if (!readFully(fd, &hdr, sizeof(hdr))) break;
+        if (hdr.magic != STREAM_MAGIC) { std::fprintf(stderr, "bad frame header\n"); return 1; }
+        payload.resize(hdr.payloadBytes);
+        if (!readFully(fd, payload.data(), payload.size())) break;
+        if (hdr.width != fw || hdr.height != fh) { fw = hdr.width; fh = hdr.height; fb.assign((size_t)fw * fh, 0); }
+
+        const uint8_t* p = payload.data();
+        const uint8_t* end = p + payload.size();
+        for (uint32_t t = 0; t < hdr.tiles; ++t) {
+            StreamTileHeader th;
+            if (end - p < (ptrdiff_t)sizeof(th)) { std::fprintf(stderr, "truncated frame\n"); return 1; }
+            std::memcpy(&th, p, sizeof(th));
+            p += sizeof(th);
+            int x0 = th.tx * (int)hdr.tile, y0 = th.ty * (int)hdr.tile;
+            int tw = std::min((int)hdr.tile, (int)fw - x0), tht = std::min((int)hdr.tile, (int)fh - y0);
+            if (tw <= 0 || tht <= 0 || end - p < (ptrdiff_t)th.bytes ||
+                !decodeTile(p, th.bytes, &fb[(size_t)y0 * fw + x0], (int)fw, tw, tht)) {
+                std::fprintf(stderr, "bad tile %u,%u in frame %llu\n", th.tx, th.ty, (unsigned long long)hdr.frame);
+                return 1;
+            }
+            p += th.bytes;
+        }
+        double ms = (steadyNs() - hdr.publishNs) / 1e6;
+        latency.push_back(ms);
+        uint64_t sum = 0;
+        for (uint32_t v : fb) sum = sum * 31 + v;
+        uint64_t bytes = sizeof(hdr) + hdr.payloadBytes;
+        if (last && hdr.frame > last + 1) skipped += hdr.frame - last - 1;
+        std::printf("frame %llu  %ux%u  %u tiles  %llu bytes (%.1f%% of raw)  checksum %016llx  latency %.3f ms\n",
+                    (unsigned long long)hdr.frame, fw, fh, hdr.tiles, (unsigned long long)bytes,
+                    hdr.tiles ? 100.0 * bytes / (hdr.tiles * (double)hdr.tile * hdr.tile * 4) : 0.0,
+                    (unsigned long long)sum, ms);
+        last = hdr.frame;
+        totalBytes += bytes;
+        totalTiles += hdr.tiles;
+
+        if (delayMs) std::this_thread::sleep_for(std::chrono::milliseconds(delayMs));
+        if (send(fd, &hdr.frame, sizeof(hdr.frame), MSG_NOSIGNAL) != (ssize_t)sizeof(hdr.frame)) break;
+    }
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (!latency.empty()) {
+        std::vector<double> sorted(latency);
+        std::sort(sorted.begin(), sorted.end());
+        double mean = 0;
+        for (double v : sorted) mean += v;
+        std::printf("%zu frames (%llu coalesced), %llu tiles, %.2f MB, %.2f MB/s, %.0f bytes/frame\n",
+                    sorted.size(), (unsigned long long)skipped, (unsigned long long)totalTiles,
+                    totalBytes / (1024.0 * 1024.0), totalBytes / (1024.0 * 1024.0) / secs, (double)totalBytes / sorted.size());
+        std::printf("latency: mean %.3f  p50 %.3f  p99 %.3f  max %.3f ms\n", mean / sorted.size(),
+                    sorted[sorted.size() / 2], sorted[std::min(sorted.size() - 1, sorted.size() * 99 / 100)], sorted.back());
+    }
+    ::close(fd);
+    return 0;
+#else
+    (void)argc; (void)argv;
+    std::fprintf(stderr, "--stream-view needs Unix domain sockets\n");
+    return 1;
+#endif
+}
+
+// --------------- PNG encoder benchmark ---------------
+// Renders random segments into a width x height frame (4K by default), then
+// times savePng() for each level at 1 thread and at the given thread count.
+// Usage: --pngbench [width] [height] [threads]
+
+int pngBenchMain(int argc, char** argv)
+{
+    int W = argc > 2 ? std::max(16, std::atoi(argv[2])) : 3840;
+    int H = argc > 3 ? std::max(16, std::atoi(argv[3])) : 2160;
+    int threads = argc > 4 ? std::max(1, std::atoi(argv[4])) : (int)std::max(1u, std::thread::hardware_concurrency());
+    std::vector<uint32_t> px((size_t)W * H, CANVAS_BG);
+    unsigned rng = 20251024u;
+    auto rnd = [&rng]() { rng = rng * 1664525u + 1013904223u; return rng >> 8; };
+    Box all = { 0, 0, W - 1, H - 1 }, clip = { W / 4, H / 4, W - W / 4, H - H / 4 };
+    auto r0 = std::chrono::steady_clock::now();
+    for (int i = 0; i < 20000; ++i) {
+        Seg s;
+        s.a.x = (int)(rnd() % (unsigned)W); s.a.y = (int)(rnd() % (unsigned)H);
+        s.b.x = clampi(s.a.x + (int)(rnd() % 401) - 200, 0, W - 1);
+        s.b.y = clampi(s.a.y + (int)(rnd() % 401) - 200, 0, H - 1);
+        rasterSegmentInRect(s, all, CANVAS_GRAY, px.data(), W);
+        rasterSegmentInRect(s, clip, CANVAS_CYAN, px.data(), W);
+    }
+    double renderMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - r0).count();
+    std::printf("%dx%d frame, 20000 segments rendered in %.1f ms; raw RGB %.1f MB\n", W, H, renderMs, 3.0 * W * H / (1024.0 * 1024.0));
+
+    const char* names[3] = { "stored", "fast", "better" };
+    bool ok = true;
+    for (int level = PNG_STORED; level <= PNG_BETTER; ++level)
+        for (int t : { 1, threads }) {
+            char path[64];
+            std::snprintf(path, sizeof(path), "pngbench-%s.png", names[level]);
+            double best = 1e30;
+            for (int rep = 0; rep < 3; ++rep) {
+                auto t0 = std::chrono::steady_clock::now();
+                ok = savePng(path, px.data(), W, H, W, true, t, level) && ok;
+                best = std::min(best, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count());
+            }
+            FILE* f = std::fopen(path, "rb");
+            long size = 0;
+            if (f) { std::fseek(f, 0, SEEK_END); size = std::ftell(f); std::fclose(f); }
+            std::printf("  %-7s %2d thread%s  %8.1f ms  %7.2f MB (%5.1f%% of raw)  -> %s\n", names[level], t, t == 1 ? " " : "s",
+                        best, size / (1024.0 * 1024.0), 100.0 * size / (3.0 * W * H), path);
+            if (t == threads) break;
+        }
+    return ok ? 0 : 1;
+}
+
+// --------------- Render job server ---------------
+// A long-running, windowless renderer for scripts: no process start-up or
+// GL context per image. Clients connect to a Unix socket and send one job
+// per request, each a text line, optionally followed by its segments one
+// "x0 y0 x1 y1" per line:
+//   lines W H FMT N                   N segments, gray on the canvas background
+//   rings W H FMT COUNT BASE STEP THICK THICKSTEP
+//                                     concentric rings about the center, hue gradient
+//   clip W H FMT X0 Y0 X1 Y1 N        N segments clipped to the window; FMT text
+//                                     returns the visible parts, one per line
+//                                     ("-" when rejected), else an image as drawn
+//                                     in the app (gray, cyan clipped parts, yellow window)
+//   stats                             the metrics dump (Prometheus text)
+//   shutdown                          stop after the jobs in flight
+// FMT is png, ppm or rgba (raw, top row first). The reply is
+// "ok BYTES QUEUE_MS RENDER_MS" and BYTES of payload, or "err MESSAGE".
+// Connection threads only parse and reply; rendering and encoding run on a
+// shared pool of worker threads, with framebuffers taken from a pool so
+// steady traffic does not allocate. Jobs from different connections run
+// in parallel; a connection's jobs run in order.
+// Usage: --serve PATH [threads]    and    --render-client PATH < job > reply
+static const int SERVE_MAX_SIDE = 16384;
+static const long long SERVE_MAX_SEGMENTS = 50000000;
+static const long long SERVE_MAX_RADIUS = 2LL * SERVE_MAX_SIDE;   // ring radius and width
+static const size_t SERVE_POOL_BYTES = 512u << 20;   // idle framebuffers kept at most
+
+enum ServeFormat { SERVE_TEXT, SERVE_PNG, SERVE_PPM, SERVE_RGBA };
+static const uint32_t CANVAS_YELLOW = 0xFF00FFFFu;
+
+struct RenderJob {
+    enum Kind { LINES, RINGS, CLIP } kind = LINES;
+    int w = 0, h = 0;
+    ServeFormat format = SERVE_PNG;
+    int rings = 0, base = 0, step = 0, thick = 0, thickStep = 0;
+    Box window = EMPTY_BOX;
+    std::vector<Seg> segs;
+
+    uint64_t queuedNs = 0;
+    bool done = false;
+    std::string error;
+    std::vector<uint8_t> out;
+    double queueMs = 0.0, renderMs = 0.0;
+};
+
+// Idle framebuffers, reused best-fit by capacity
+struct FramebufferPool
+{
+    std::mutex lock;
+    std::vector<std::vector<uint32_t> > idle;
+    size_t idleBytes = 0;
+
+    std::vector<uint32_t> acquire(size_t n)
+    {
+        {
+            std::lock_guard<std::mutex> g(lock);
+            size_t best = idle.size();
+            for (size_t i = 0; i < idle.size(); ++i)
+                if (idle[i].capacity() >= n && (best == idle.size() || idle[i].capacity() < idle[best].capacity())) best = i;
+            if (best < idle.size()) {
+                std::vector<uint32_t> fb;
+                fb.swap(idle[best]);
+                idle.erase(idle.begin() + best);
+                idleBytes -= fb.capacity() * 4;
+                fb.resize(n);
+                metricAdd(M_SERVE_FB_REUSED);
+                return fb;
+            }
+        }
+        metricAdd(M_SERVE_FB_ALLOCATED);
+        return std::vector<uint32_t>(n);
+    }
+
+    void release(std::vector<uint32_t>& fb)
+    {
+        std::lock_guard<std::mutex> g(lock);
+        if (idleBytes + fb.capacity() * 4 > SERVE_POOL_BYTES) { std::vector<uint32_t>().swap(fb); return; }
+        idleBytes += fb.capacity() * 4;
+        idle.emplace_back();
+        idle.back().swap(fb);
+    }
+};
+
+inline uint32_t hueColor(float h)
+{
+    float r = std::fabs(h * 6.0f - 3.0f) - 1.0f, g = 2.0f - std::fabs(h * 6.0f - 2.0f), b = 2.0f - std::fabs(h * 6.0f - 4.0f);
+    auto c = [](float v) { return (uint32_t)(std::min(1.0f, std::max(0.0f, v)) * 255.0f + 0.5f); };
+    return 0xFF000000u | (c(b) << 16) | (c(g) << 8) | c(r);
+}
+
+// Ring i covers rIn^2 <= d^2 <= rOut^2 around (cx, cy), rIn/rOut = r -/+ thickness/2
+void rasterRings(const RenderJob& j, uint32_t* px)
+{
+    int cx = j.w / 2, cy = j.h / 2;
+    long long fx = std::max(cx, j.w - 1 - cx), fy = std::max(cy, j.h - 1 - cy);
+    const long long farthest2 = fx * fx + fy * fy;             // center to the farthest corner
+    for (int i = 0; i < j.rings; ++i) {
+        long long r = j.base + (long long)i * j.step, W = std::max(1LL, j.thick + (long long)i * j.thickStep);
+        long long rIn = std::max(0LL, r - W / 2), rOut = r + W / 2;
+        if (rOut < 0 || rIn * rIn > farthest2) continue;        // nothing of it is on the image
+        uint32_t color = hueColor(j.rings <= 1 ? 0.0f : 0.85f * i / (j.rings - 1));
+        for (int y = (int)std::max(0LL, cy - rOut); y <= (int)std::min((long long)j.h - 1, cy + rOut); ++y) {
+            long long dy2 = (long long)(y - cy) * (y - cy);
+            long long xo = (long long)std::sqrt((double)(rOut * rOut - dy2));
+            while (xo * xo + dy2 > rOut * rOut) --xo;
+            while ((xo + 1) * (xo + 1) + dy2 <= rOut * rOut) ++xo;
+            long long xi = 0;                                   // first |dx| with dx^2 + dy^2 >= rIn^2
+            if (rIn * rIn > dy2) {
+                xi = (long long)std::sqrt((double)(rIn * rIn - dy2));
+                while (xi * xi + dy2 < rIn * rIn) ++xi;
+                while (xi > 0 && (xi - 1) * (xi - 1) + dy2 >= rIn * rIn) --xi;
+            }
+            if (xi > xo) continue;
+            uint32_t* row = px + (size_t)y * j.w;
+            auto span = [&](long long a, long long b) {
+                a = std::max(0LL, a); b = std::min((long long)j.w - 1, b);
+                if (a <= b) std::fill(row + a, row + b + 1, color);
+            };
+            if (xi == 0) span(cx - xo, cx + xo);
+            else { span(cx - xo, cx - xi); span(cx + xi, cx + xo); }
+        }
+    }
+}
+
+// Whole image as one PNG (the server parallelizes across jobs, not within one)
+void encodePng(const uint32_t* px, int w, int h, int level, std::vector<uint8_t>& out)
+{
+    const int ROWS = 256;
+    auto rowAt = [&](int y) { return px + (size_t)(h - 1 - y) * w; };
+    out = pngHeader(w, h);
+    uint32_t adler = 1;
+    PngBlock blk;
+    for (int y = 0; y < h; y += ROWS) {
+        encodePngBlock(rowAt, w, y, std::min(h, y + ROWS), level, y == 0, y + ROWS >= h, blk);
+        out.insert(out.end(), blk.chunk.begin(), blk.chunk.end());
+        adler = adler32Combine(adler, blk.adler, blk.filtered);
+    }
+    std::vector<uint8_t> tail = pngTrailer(adler);
+    out.insert(out.end(), tail.begin(), tail.end());
+}
+
+struct RenderServer
+{
+    std::string path;
+    int listenFd = -1;
+    FramebufferPool framebuffers;
+    std::vector<std::thread> workers;
+    std::mutex lock;
+    std::condition_variable work, finished;
+    std::deque<RenderJob*> queue;
+    bool stopping = false;
+    std::vector<int> clients;           // open connections, under lock
+    std::vector<std::thread> connections;       // owned by the accept loop
+    std::vector<std::thread::id> exited;        // connection threads done, under lock
+    std::atomic<uint64_t> jobsDone{0};
+    uint64_t startNs = 0;
+
+    bool open(const char* sockPath, int threads)
+    {
+#ifndef _WIN32
+        sockaddr_un addr;
+        std::memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        if (std::strlen(sockPath) >= sizeof(addr.sun_path)) { std::fprintf(stderr, "socket path too long\n"); return false; }
+        std::strcpy(addr.sun_path, sockPath);
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0) { std::perror("socket"); return false; }
+        ::unlink(sockPath);
+        if (bind(fd, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, 64) != 0) {
+            std::perror(sockPath); ::close(fd); return false;
+        }
+        path = sockPath;
+        listenFd = fd;
+        startNs = steadyNs();
+        for (int t = 0; t < threads; ++t) workers.emplace_back(&RenderServer::workerLoop, this);
+        return true;
+#else
+        (void)sockPath; (void)threads;
+        std::fprintf(stderr, "--serve needs Unix domain sockets\n");
+        return false;
+#endif
+    }
+
+    // Queue a job and wait for a worker to finish it
+    void run(RenderJob& j)
+    {
+        std::unique_lock<std::mutex> g(lock);
+        j.queuedNs = steadyNs();
+        queue.push_back(&j);
+        work.notify_one();
+        finished.wait(g, [&] { return j.done; });
+    }
+
+    void workerLoop()
+    {
+        for (;;) {
+            RenderJob* j;
+            {
+                std::unique_lock<std::mutex> g(lock);
+                work.wait(g, [&] { return stopping || !queue.empty(); });
+                if (queue.empty()) return;
+                j = queue.front();
+                queue.pop_front();
+            }
+            uint64_t t0 = steadyNs();
+            j->queueMs = (t0 - j->queuedNs) / 1e6;
+            render(*j);
+            j->renderMs = (steadyNs() - t0) / 1e6;
+            metricObserve(H_SERVE_QUEUE_MS, j->queueMs);
+            metricObserve(H_SERVE_JOB_MS, j->renderMs);
+            metricAdd(j->error.empty() ? M_SERVE_JOBS : M_SERVE_JOB_ERRORS);
+            ++jobsDone;
+            std::lock_guard<std::mutex> g(lock);
+            j->done = true;
+            finished.notify_all();
+        }
+    }
+
+    void render(RenderJob& j)
+    {
+        if (j.kind == RenderJob::CLIP && j.format == SERVE_TEXT) {
+            std::string text;
+            char line[96];
+            for (const Seg& s : j.segs) {
+                float cx0, cy0, cx1, cy1;
+                if (liangBarskyClip(j.window.x0, j.window.y0, j.window.x1, j.window.y1,
+                                    (float)s.a.x, (float)s.a.y, (float)s.b.x, (float)s.b.y, cx0, cy0, cx1, cy1)) {
+                    std::snprintf(line, sizeof(line), "%.3f %.3f %.3f %.3f\n", cx0, cy0, cx1, cy1);
+                    text += line;
+                } else text += "-\n";
+            }
+            j.out.assign(text.begin(), text.end());
+            return;
+        }
+
+        std::vector<uint32_t> fb = framebuffers.acquire((size_t)j.w * j.h);
+        std::fill(fb.begin(), fb.end(), CANVAS_BG);
+        Box all = { 0, 0, j.w - 1, j.h - 1 };
+        if (j.kind == RenderJob::RINGS) rasterRings(j, fb.data());
+        else {
+            long long plotted = 0;
+            for (const Seg& s : j.segs) plotted += rasterSegmentInRect(s, all, CANVAS_GRAY, fb.data(), j.w);
+            if (j.kind == RenderJob::CLIP) {
+                Box vis = { std::max(0, j.window.x0), std::max(0, j.window.y0), std::min(j.w - 1, j.window.x1), std::min(j.h - 1, j.window.y1) };
+                for (const Seg& s : j.segs) plotted += rasterSegmentInRect(s, vis, CANVAS_CYAN, fb.data(), j.w);
+                const Box& b = j.window;
+                Seg edges[4] = { { { b.x0, b.y0 }, { b.x1, b.y0 } }, { { b.x1, b.y0 }, { b.x1, b.y1 } },
+                                 { { b.x1, b.y1 }, { b.x0, b.y1 } }, { { b.x0, b.y1 }, { b.x0, b.y0 } } };
+                for (const Seg& e : edges) rasterSegmentInRect(e, all, CANVAS_YELLOW, fb.data(), j.w);
+            }
+            metricAdd(M_PIXELS_PLOTTED, (uint64_t)plotted);
+        }
+
+        // Rows bottom-up in fb (world y up), top-down in every format
+        if (j.format == SERVE_PNG) encodePng(fb.data(), j.w, j.h, PNG_FAST, j.out);
+        else {
+            char header[64];
+            int headerLen = j.format == SERVE_PPM ? std::snprintf(header, sizeof(header), "P6\n%d %d\n255\n", j.w, j.h) : 0;
+            int bpp = j.format == SERVE_PPM ? 3 : 4;
+            j.out.resize((size_t)headerLen + (size_t)j.w * j.h * bpp);
+            std::memcpy(j.out.data(), header, (size_t)headerLen);
+            uint8_t* o = j.out.data() + headerLen;
+            for (int y = j.h - 1; y >= 0; --y) {
+                const uint32_t* row = fb.data() + (size_t)y * j.w;
+                if (bpp == 4) { std::memcpy(o, row, (size_t)j.w * 4); o += (size_t)j.w * 4; continue; }
+                for (int x = 0; x < j.w; ++x) { *o++ = (uint8_t)row[x]; *o++ = (uint8_t)(row[x] >> 8); *o++ = (uint8_t)(row[x] >> 16); }
+            }
+        }
+        framebuffers.release(fb);
+    }
+
+    // Parse one request line (and its segment lines); false ends the connection
+    bool readJob(int fd, std::string& buf, RenderJob& j, std::string& command)
+    {
+        auto readLine = [&](std::string& line) {
+            size_t nl;
+            while ((nl = buf.find('\n')) == std::string::npos) {
+                char tmp[65536];
+                ssize_t r = recv(fd, tmp, sizeof(tmp), 0);
+                if (r < 0 && errno == EINTR) continue;
+                if (r <= 0) return false;
+                buf.append(tmp, (size_t)r);
+            }
+            line.assign(buf, 0, nl);
+            buf.erase(0, nl + 1);
+            return true;
+        };
+        std::string line;
+        do { if (!readLine(line)) return false; } while (line.find_first_not_of(" \t\r") == std::string::npos);
+
+        char kind[16] = {}, fmt[8] = {};
+        long long n = 0;
+        int x0, y0, x1, y1;
+        j = RenderJob();
+        command.clear();
+        if (std::sscanf(line.c_str(), "%15s", kind) != 1) return false;
+        if (!std::strcmp(kind, "stats") || !std::strcmp(kind, "shutdown")) { command = kind; return true; }
+        if (!std::strcmp(kind, "lines") && std::sscanf(line.c_str(), "%*s %d %d %7s %lld", &j.w, &j.h, fmt, &n) == 4)
+            j.kind = RenderJob::LINES;
+        else if (!std::strcmp(kind, "rings") && std::sscanf(line.c_str(), "%*s %d %d %7s %d %d %d %d %d", &j.w, &j.h, fmt,
+                                                           &j.rings, &j.base, &j.step, &j.thick, &j.thickStep) == 8)
+            j.kind = RenderJob::RINGS;
+        else if (!std::strcmp(kind, "clip") && std::sscanf(line.c_str(), "%*s %d %d %7s %d %d %d %d %lld", &j.w, &j.h, fmt,
+                                                          &x0, &y0, &x1, &y1, &n) == 8) {
+            j.kind = RenderJob::CLIP;
+            j.window = { std::min(x0, x1), std::min(y0, y1), std::max(x0, x1), std::max(y0, y1) };
+        } else { j.error = "bad request: " + line; return true; }
+
+        if (!std::strcmp(fmt, "png")) j.format = SERVE_PNG;
+        else if (!std::strcmp(fmt, "ppm")) j.format = SERVE_PPM;
+        else if (!std::strcmp(fmt, "rgba")) j.format = SERVE_RGBA;
+        else if (!std::strcmp(fmt, "text") && j.kind == RenderJob::CLIP) j.format = SERVE_TEXT;
+        else j.error = std::string("bad format ") + fmt;
+        if (j.w < 1 || j.h < 1 || j.w > SERVE_MAX_SIDE || j.h > SERVE_MAX_SIDE) j.error = "bad size";
+        if (j.rings < 0 || j.rings > 100000) j.error = "bad ring count";
+        else if (j.kind == RenderJob::RINGS && j.rings > 0) {
+            // Radius and width are linear in the ring index, so the first
+            // and last rings bound them all
+            for (long long i : { 0LL, (long long)j.rings - 1 }) {
+                long long r = j.base + i * j.step, W = j.thick + i * j.thickStep;
+                if (std::llabs(r) > SERVE_MAX_RADIUS || std::llabs(W) > SERVE_MAX_RADIUS) j.error = "ring radius out of range";
+            }
+        }
+        if (n < 0 || n > SERVE_MAX_SEGMENTS) return false;   // cannot skip the body safely
+
+        j.segs.resize((size_t)n);
+        for (Seg& s : j.segs) {
+            if (!readLine(line)) return false;
+            if (std::sscanf(line.c_str(), "%d %d %d %d", &s.a.x, &s.a.y, &s.b.x, &s.b.y) != 4 && j.error.empty())
+                j.error = "bad segment: " + line;
+        }
+        if (j.kind == RenderJob::LINES || (j.kind == RenderJob::CLIP && j.format != SERVE_TEXT))
+            for (const Seg& s : j.segs)
+                if (std::abs(s.a.x) > 1 << 28 || std::abs(s.a.y) > 1 << 28 || std::abs(s.b.x) > 1 << 28 || std::abs(s.b.y) > 1 << 28) {
+                    j.error = "segment out of range";
+                    break;
+                }
+        return true;
+    }
+
+    void connection(int fd)
+    {
+        std::string buf, command;
+        RenderJob j;
+        while (readJob(fd, buf, j, command)) {
+            if (command == "shutdown") { shutdown(); break; }
+            if (command == "stats") {
+                char* text = nullptr;
+                size_t len = 0;
+                FILE* f = open_memstream(&text, &len);
+                if (f) {
+                    metrics.dump(f);
+                    double up = (steadyNs() - startNs) / 1e9;
+                    std::fprintf(f, "# HELP serve_uptime_seconds Time since the server started\n# TYPE serve_uptime_seconds gauge\n"
+                                    "serve_uptime_seconds %.3f\n", up);
+                    std::fprintf(f, "# HELP serve_jobs_per_second Jobs rendered per second since the start\n"
+                                    "# TYPE serve_jobs_per_second gauge\nserve_jobs_per_second %.3f\n", up > 0 ? jobsDone / up : 0.0);
+                    std::lock_guard<std::mutex> g(lock);
+                    std::fprintf(f, "# HELP serve_queue_depth Jobs waiting for a worker\n# TYPE serve_queue_depth gauge\n"
+                                    "serve_queue_depth %zu\n", queue.size());
+                    std::fprintf(f, "# HELP serve_connections Open client connections\n# TYPE serve_connections gauge\n"
+                                    "serve_connections %zu\n", clients.size());
+                    std::fclose(f);
+                }
+                j.out.assign(text, text + len);
+                std::free(text);
+            } else if (j.error.empty()) run(j);
+            else metricAdd(M_SERVE_JOB_ERRORS);     // rejected before reaching a worker
+
+            char head[128];
+            int n = j.error.empty()
+                  ? std::snprintf(head, sizeof(head), "ok %zu %.3f %.3f\n", j.out.size(), j.queueMs, j.renderMs)
+                  : std::snprintf(head, sizeof(head), "err %.100s\n", j.error.c_str());
+            if (!writeFully(fd, head, (size_t)n) || !writeFully(fd, j.out.data(), j.out.size())) break;
+            metricAdd(M_SERVE_BYTES_OUT, (uint64_t)n + j.out.size());
+        }
+        std::lock_guard<std::mutex> g(lock);
+        clients.erase(std::find(clients.begin(), clients.end(), fd));
+        ::close(fd);
+        exited.push_back(std::this_thread::get_id());
+    }
+
+    // Join connection threads that have finished (accept loop only)
+    void reapConnections()
+    {
+        std::vector<std::thread::id> done;
+        {
+            std::lock_guard<std::mutex> g(lock);
+            done.swap(exited);
+        }
+        for (std::thread::id id : done)
+            for (size_t i = 0; i < connections.size(); ++i)
+                if (connections[i].get_id() == id) {
+                    connections[i].join();
+                    connections.erase(connections.begin() + i);
+                    break;
+                }
+    }
+
+    static bool writeFully(int fd, const void* src, size_t n)
+    {
+        for (size_t put = 0; put < n; ) {
+            ssize_t r = send(fd, (const char*)src + put, n - put, MSG_NOSIGNAL);
+            if (r < 0 && errno == EINTR) continue;
+            if (r <= 0) return false;
+            put += (size_t)r;
+        }
+        return true;
+    }
+
+    void serve()
+    {
+        for (;;) {
+            int fd = accept(listenFd, nullptr, nullptr);
+            if (fd < 0) {
+                if (errno == EINTR) continue;
+                break;                                   // listener shut down
+            }
+            reapConnections();
+            std::lock_guard<std::mutex> g(lock);
+            clients.push_back(fd);
+            connections.emplace_back(&RenderServer::connection, this, fd);
+        }
+        // Idle connections see end of input; busy ones finish their job
+        // first. Every connection thread is joined before the server goes.
+        {
+            std::lock_guard<std::mutex> g(lock);
+            for (int fd : clients) ::shutdown(fd, SHUT_RD);
+        }
+        for (auto& t : connections) t.join();
+        connections.clear();
+        exited.clear();
+        {
+            std::lock_guard<std::mutex> g(lock);
+            stopping = true;
+        }
+        work.notify_all();
+        for (auto& t : workers) t.join();
+        workers.clear();
+        ::close(listenFd);
+        ::unlink(path.c_str());
+    }
+
+    // Wakes serve() out of accept(); queued jobs still finish
+    void shutdown() { ::shutdown(listenFd, SHUT_RDWR); }
+};
+
+int serveMain(int argc, char** argv)
+{
+#ifndef _WIN32
+    if (argc < 3) { std::fprintf(stderr, "usage: %s --serve PATH [threads]\n", argv[0]); return 1; }
+    int threads = argc > 3 ? std::max(1, std::atoi(argv[3])) : (int)std::max(1u, std::thread::hardware_concurrency());
+    headless = true;
+    static RenderServer server;
+    if (!server.open(argv[2], threads)) return 1;
+    std::fprintf(stderr, "serving on %s with %d render threads\n", argv[2], threads);
+    server.serve();
+    dumpMetrics();
+    return 0;
+#else
+    (void)argc; (void)argv;
+    std::fprintf(stderr, "--serve needs Unix domain sockets\n");
+    return 1;
+#endif
+}
+
+// Sends stdin as requests and writes the payloads to stdout; status lines
+// go to stderr. Exits non-zero if any job failed.
+int renderClientMain(int argc, char** argv)
+{
+#ifndef _WIN32
+    if (argc < 3) { std::fprintf(stderr, "usage: %s --render-client PATH < requests > payloads\n", argv[0]); return 1; }
+    sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    std::strncpy(addr.sun_path, argv[2], sizeof(addr.sun_path) - 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (sockaddr*)&addr, sizeof(addr)) != 0) { std::perror(argv[2]); return 1; }
+
+    // Count the requests, so we know how many replies to read
+    std::string in;
+    char tmp[65536];
+    for (size_t r; (r = std::fread(tmp, 1, sizeof(tmp), stdin)) > 0; ) in.append(tmp, r);
+    int requests = 0;
+    for (size_t p = 0; p < in.size(); ) {
+        size_t nl = in.find('\n', p);
+        std::string line = in.substr(p, nl == std::string::npos ? std::string::npos : nl - p);
+        p = nl == std::string::npos ? in.size() : nl + 1;
+        char kind[16] = {};
+        long long n = 0;
+        if (std::sscanf(line.c_str(), "%15s", kind) != 1) continue;
+        if (!std::strcmp(kind, "shutdown")) continue;          // no reply
+        ++requests;
+        if (!std::strcmp(kind, "lines")) std::sscanf(line.c_str(), "%*s %*d %*d %*s %lld", &n);
+        else if (!std::strcmp(kind, "clip")) std::sscanf(line.c_str(), "%*s %*d %*d %*s %*d %*d %*d %*d %lld", &n);
+        for (long long k = 0; k < n && p < in.size(); ++k) {     // skip the segment lines
+            nl = in.find('\n', p);
+            p = nl == std::string::npos ? in.size() : nl + 1;
+        }
+    }
+    if (!in.empty() && in.back() != '\n') in += '\n';
+    // Sent from a thread: replies must be drained while a long batch is still going out
+    std::thread sender([&] { if (!RenderServer::writeFully(fd, in.data(), in.size())) std::perror("send"); });
+
+    int failed = 0;
+    std::vector<char> payload;
+    for (int k = 0; k < requests; ++k) {
+        std::string head;
+        char c;
+        while (readFully(fd, &c, 1) && c != '\n') head += c;
+        std::fprintf(stderr, "%s\n", head.c_str());
+        unsigned long long bytes = 0;
+        if (std::sscanf(head.c_str(), "ok %llu", &bytes) != 1) { ++failed; if (head.empty()) break; continue; }
+        payload.resize((size_t)bytes);
+        if (!readFully(fd, payload.data(), payload.size())) { ++failed; break; }
+        std::fwrite(payload.data(), 1, payload.size(), stdout);
     }
+    sender.join();
+    ::close(fd);
+    return failed ? 1 : 0;
+#else
+    (void)argc; (void)argv;
+    std::fprintf(stderr, "--render-client needs Unix domain sockets\n");
+    return 1;
+#endif
 }
 
 // --------------- main ---------------
 int main(int argc, char** argv)
 {
+    // --metrics-out FILE may appear anywhere; the other modes never see it
+    for (int i = 1; i + 1 < argc; ++i)
+        if (std::strcmp(argv[i], "--metrics-out") == 0) {
+            metricsPath = argv[i + 1];
+            for (int k = i; k + 2 <= argc; ++k) argv[k] = argv[k + 2];
+            argc -= 2;
+            break;
+        }
+    for (int i = 1; i + 1 < argc; ++i)
+        if (std::strcmp(argv[i], "--export-shm") == 0) {
+            if (!frameExport.open(argv[i + 1])) return 1;
+            std::atexit([] { frameExport.close(); });
+            for (int k = i; k + 2 <= argc; ++k) argv[k] = argv[k + 2];
+            argc -= 2;
+            break;
+        }
+    for (int i = 1; i + 1 < argc; ++i)
+        if (std::strcmp(argv[i], "--record") == 0) {
+            recorder.start(argv[i + 1]);
+            std::atexit([] { recorder.stop(); });
+            for (int k = i; k + 2 <= argc; ++k) argv[k] = argv[k + 2];
+            argc -= 2;
+            break;
+        }
+    for (int i = 1; i + 1 < argc; ++i)
+        if (std::strcmp(argv[i], "--stream-sock") == 0) {
+            if (!frameStream.open(argv[i + 1])) return 1;
+            std::atexit([] { frameStream.close(); });
+            for (int k = i; k + 2 <= argc; ++k) argv[k] = argv[k + 2];
+            argc -= 2;
+            break;
+        }
+#ifdef SIGUSR1
+    std::signal(SIGUSR1, onMetricsSignal);
+#endif
+
+    if (argc > 1 && std::strcmp(argv[1], "--poster") == 0) return posterMain(argc, argv);
+    if (argc > 1 && std::strcmp(argv[1], "--bench") == 0) {
+        if (recorder.path == "-") { std::fprintf(stderr, "--record - would mix video into the --bench table on stdout\n"); recorder.path.clear(); return 1; }
+        return benchMain(argc, argv);
+    }
+    if (argc > 1 && std::strcmp(argv[1], "--packbench") == 0) return packBenchMain(argc, argv);
+    if (argc > 1 && std::strcmp(argv[1], "--pngbench") == 0) return pngBenchMain(argc, argv);
+    if (argc > 1 && std::strcmp(argv[1], "--shm-view") == 0) return shmViewMain(argc, argv);
+    if (argc > 1 && std::strcmp(argv[1], "--stream-view") == 0) return streamViewMain(argc, argv);
+    if (argc > 1 && std::strcmp(argv[1], "--serve") == 0) return serveMain(argc, argv);
+    if (argc > 1 && std::strcmp(argv[1], "--render-client") == 0) return renderClientMain(argc, argv);
+
     glutInit(&argc, argv);
     glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB);
     glutInitWindowSize(winW, winH);
@@ -275,6 +5336,9 @@ int main(int argc, char** argv)
     glutKeyboardFunc(keyboard);
     glutSpecialFunc(special);
     glutMouseFunc(mouse);
+    glutTimerFunc(200, metricsPoll, 0);
+    if (frameStream.active()) glutTimerFunc(4, streamPoll, 0);
+    std::atexit(stopProducers);
 
     glutMainLoop();
     return 0;